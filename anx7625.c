@@ -4,6 +4,11 @@
 
 #include "edid.h"
 #include "anx7625.h"
+#include "stats.h"
+
+#if defined(MICROPY_HW_QSPIFLASH_SIZE_BITS_LOG2)
+#include "qspi.h"
+#endif
 
 extern mp_anx7625_t *anx7625_obj;
 
@@ -12,6 +17,7 @@ int readfrom_(mp_obj_base_t *self, uint16_t addr, uint8_t *dest, size_t len, boo
     mp_machine_i2c_p_t *i2c_p = (mp_machine_i2c_p_t *)MP_OBJ_TYPE_GET_SLOT(self->type, protocol);
     mp_machine_i2c_buf_t buf = {.len = len, .buf = dest};
     unsigned int flags = MP_MACHINE_I2C_FLAG_READ | (stop ? MP_MACHINE_I2C_FLAG_STOP : 0);
+    stats_i2c(len);
     return i2c_p->transfer(self, addr, 1, &buf, flags);
 }
 
@@ -20,6 +26,7 @@ int writeto_(mp_obj_base_t *self, uint16_t addr, const uint8_t *src, size_t len,
     mp_machine_i2c_p_t *i2c_p = (mp_machine_i2c_p_t *)MP_OBJ_TYPE_GET_SLOT(self->type, protocol);
     mp_machine_i2c_buf_t buf = {.len = len, .buf = (uint8_t *)src};
     unsigned int flags = stop ? MP_MACHINE_I2C_FLAG_STOP : 0;
+    stats_i2c(len);
     return i2c_p->transfer(self, addr, 1, &buf, flags);
 }
 
@@ -62,6 +69,7 @@ int write_mem_(mp_obj_t self_in, uint16_t addr, uint32_t memaddr, uint8_t addrsi
 
     // Do I2C transfer
     mp_machine_i2c_p_t *i2c_p = (mp_machine_i2c_p_t *)MP_OBJ_TYPE_GET_SLOT(self->type, protocol);
+    stats_i2c(memaddr_len + len);
     return i2c_p->transfer(self, addr, 2, bufs, MP_MACHINE_I2C_FLAG_STOP);
 }
 
@@ -425,6 +433,44 @@ static int anx7625_odfc_config(uint8_t bus, uint8_t post_divider)
     return ret;
 }
 
+/* anx7625_calculate_m_n() results of recently used pixel clocks */
+#define MN_CACHE_SIZE 4
+
+typedef struct _mn_cache_t
+{
+    u32 pixelclock;
+    unsigned long m;
+    unsigned long n;
+    uint8_t post_divider;
+} mn_cache_t;
+
+static mn_cache_t mn_cache[MN_CACHE_SIZE];
+static uint32_t mn_cache_next = 0;
+
+static int anx7625_cached_m_n(u32 pixelclock, unsigned long *m,
+                              unsigned long *n, uint8_t *pd)
+{
+    for (uint32_t i = 0; i < MN_CACHE_SIZE; i++)
+    {
+        if (mn_cache[i].pixelclock == pixelclock)
+        {
+            *m = mn_cache[i].m;
+            *n = mn_cache[i].n;
+            *pd = mn_cache[i].post_divider;
+            return 0;
+        }
+    }
+
+    *pd = 0;
+    if (anx7625_calculate_m_n(pixelclock, m, n, pd) != 0)
+    {
+        return 1;
+    }
+    mn_cache[mn_cache_next] = (mn_cache_t){pixelclock, *m, *n, *pd};
+    mn_cache_next = (mn_cache_next + 1) % MN_CACHE_SIZE;
+    return 0;
+}
+
 static int anx7625_dsi_video_config(uint8_t bus, struct display_timing *dt)
 {
     unsigned long m, n;
@@ -432,8 +478,8 @@ static int anx7625_dsi_video_config(uint8_t bus, struct display_timing *dt)
     int ret;
     uint8_t post_divider = 0;
 
-    ret = anx7625_calculate_m_n(dt->pixelclock * 1000, &m, &n,
-                                &post_divider);
+    ret = anx7625_cached_m_n(dt->pixelclock * 1000, &m, &n,
+                             &post_divider);
 
     if (ret != 0)
     {
@@ -519,6 +565,27 @@ static int anx7625_dsi_video_config(uint8_t bus, struct display_timing *dt)
     return ret;
 }
 
+/* Timing and M/N of the MIPI receiver, latched by toggling m, n ready */
+static int anx7625_dsi_video_timing(uint8_t bus, struct display_timing *dt)
+{
+    int ret;
+
+    ret = anx7625_dsi_video_config(bus, dt);
+    if (ret < 0)
+    {
+        ANXERROR("dsi video tg config failed\n");
+        return ret;
+    }
+
+    /* toggle m, n ready */
+    ret = anx7625_write_and(bus, RX_P1_ADDR, MIPI_DIGITAL_PLL_6,
+                            ~(MIPI_M_NUM_READY | MIPI_N_NUM_READY));
+    mdelay(1);
+    ret |= anx7625_write_or(bus, RX_P1_ADDR, MIPI_DIGITAL_PLL_6,
+                            MIPI_M_NUM_READY | MIPI_N_NUM_READY);
+    return ret;
+}
+
 static int anx7625_swap_dsi_lane3(uint8_t bus)
 {
     int ret;
@@ -572,20 +639,12 @@ static int anx7625_api_dsi_config(uint8_t bus, struct display_timing *dt)
     ret |= anx7625_write_or(bus, RX_P1_ADDR, MIPI_DIGITAL_PLL_18,
                             SELECT_DSI << MIPI_DPI_SELECT);
 
-    ret |= anx7625_dsi_video_config(bus, dt);
+    ret |= anx7625_dsi_video_timing(bus, dt);
     if (ret < 0)
     {
-        ANXERROR("dsi video tg config failed\n");
         return ret;
     }
 
-    /* toggle m, n ready */
-    ret = anx7625_write_and(bus, RX_P1_ADDR, MIPI_DIGITAL_PLL_6,
-                            ~(MIPI_M_NUM_READY | MIPI_N_NUM_READY));
-    mdelay(1);
-    ret |= anx7625_write_or(bus, RX_P1_ADDR, MIPI_DIGITAL_PLL_6,
-                            MIPI_M_NUM_READY | MIPI_N_NUM_READY);
-
     /* configure integer stable register */
     ret |= anx7625_reg_write(bus, RX_P1_ADDR, MIPI_VIDEO_STABLE_CNT, 0x02);
     /* power on MIPI RX */
@@ -601,6 +660,7 @@ static int anx7625_api_dsi_config(uint8_t bus, struct display_timing *dt)
 static int anx7625_dsi_config(uint8_t bus, struct display_timing *dt)
 {
     int ret;
+    stats_phase_t outer = stats_begin(STATS_DSI_CONFIG);
 
     ANXINFO("config dsi.\n");
 
@@ -611,6 +671,7 @@ static int anx7625_dsi_config(uint8_t bus, struct display_timing *dt)
     if (ret < 0)
     {
         ANXERROR("IO error: api dsi config error.\n");
+        stats_end(STATS_DSI_CONFIG, outer);
         return ret;
     }
 
@@ -624,6 +685,7 @@ static int anx7625_dsi_config(uint8_t bus, struct display_timing *dt)
     else
         ANXINFO("success to config DSI\n");
 
+    stats_end(STATS_DSI_CONFIG, outer);
     return ret;
 }
 
@@ -865,45 +927,6 @@ static void anx7625_disable_pd_protocol(uint8_t bus)
 #define FLASH_LOAD_STA 0x05
 #define FLASH_LOAD_STA_CHK (1 << 7)
 
-static int anx7625_power_on_init(uint8_t bus)
-{
-    int i, ret;
-    uint8_t val, version, revision;
-
-    anx7625_reg_write(bus, RX_P0_ADDR, XTAL_FRQ_SEL, XTAL_FRQ_27M);
-
-    for (i = 0; i < OCM_LOADING_TIME; i++)
-    {
-        /* check interface */
-        ret = anx7625_reg_read(bus, RX_P0_ADDR, FLASH_LOAD_STA, &val);
-        if (ret < 0)
-        {
-            ANXERROR("Failed to load flash\n");
-            return ret;
-        }
-
-        if ((val & FLASH_LOAD_STA_CHK) != FLASH_LOAD_STA_CHK)
-        {
-            mdelay(1);
-            continue;
-        }
-        ANXINFO("Init interface.\n");
-
-        // anx7625_disable_pd_protocol(bus);
-        anx7625_reg_read(bus, RX_P0_ADDR, OCM_FW_VERSION, &version);
-        anx7625_reg_read(bus, RX_P0_ADDR, OCM_FW_REVERSION, &revision);
-
-        if (version == 0 && revision == 0)
-        {
-            continue;
-        }
-
-        ANXINFO("Firmware: ver %02x, rev %02x.\n", version, revision);
-        return 0;
-    }
-    return -1;
-}
-
 static void anx7625_start_dp_work(uint8_t bus)
 {
     int ret;
@@ -1070,32 +1093,45 @@ static struct envie_edid_mode envie_known_modes[NUM_KNOWN_MODES] = {
     },
 };
 
-int anx7625_dp_start(uint8_t bus, const struct edid *edid, enum edid_modes mode, uint32_t fb_address)
+/* Override the timing with a fixed mode */
+void anx7625_mode_timing(enum edid_modes mode, struct display_timing *dt)
 {
-    int ret;
-    struct display_timing dt;
+    dt->pixelclock = envie_known_modes[mode].pixel_clock;
+
+    dt->hactive = envie_known_modes[mode].hactive;
+    dt->hsync_len = envie_known_modes[mode].hsync_len;
+    dt->hback_porch = envie_known_modes[mode].hback_porch;
+    dt->hfront_porch = envie_known_modes[mode].hfront_porch;
+
+    dt->vactive = envie_known_modes[mode].vactive;
+    dt->vsync_len = envie_known_modes[mode].vsync_len;
+    dt->vback_porch = envie_known_modes[mode].vback_porch;
+    dt->vfront_porch = envie_known_modes[mode].vfront_porch;
+    dt->hpol = envie_known_modes[mode].hpol;
+    dt->vpol = envie_known_modes[mode].vpol;
+}
 
-    anx7625_parse_edid(edid, &dt);
+/* Timing of a mode, the preferred one of the EDID for EDID_MODE_AUTO */
+void anx7625_get_timing(const struct edid *edid, enum edid_modes mode, struct display_timing *dt)
+{
+    anx7625_parse_edid(edid, dt);
 
     if (mode != EDID_MODE_AUTO)
     {
+        anx7625_mode_timing(mode, dt);
+    }
+}
 
-        dt.pixelclock = envie_known_modes[mode].pixel_clock;
-
-        dt.hactive = envie_known_modes[mode].hactive;
-        dt.hsync_len = envie_known_modes[mode].hsync_len;
-        dt.hback_porch = envie_known_modes[mode].hback_porch;
-        dt.hfront_porch = envie_known_modes[mode].hfront_porch;
+int anx7625_dp_start(uint8_t bus, const struct edid *edid, enum edid_modes mode, uint32_t fb_address)
+{
+    int ret;
+    struct display_timing dt;
 
-        dt.vactive = envie_known_modes[mode].vactive;
-        dt.vsync_len = envie_known_modes[mode].vsync_len;
-        dt.vback_porch = envie_known_modes[mode].vback_porch;
-        dt.vfront_porch = envie_known_modes[mode].vfront_porch;
-        dt.hpol = envie_known_modes[mode].hpol;
-        dt.vpol = envie_known_modes[mode].vpol;
-    }
+    anx7625_get_timing(edid, mode, &dt);
 
+    stats_start(STATS_LTDC_CONFIG);
     config(bus, (struct edid *)edid, &dt, fb_address);
+    stats_stop(STATS_LTDC_CONFIG);
 
     ret = anx7625_dsi_config(bus, &dt);
     if (ret < 0)
@@ -1106,20 +1142,34 @@ int anx7625_dp_start(uint8_t bus, const struct edid *edid, enum edid_modes mode,
     return ret;
 }
 
+/*
+ * Start of EDID block 0 as last read: header, vendor, product and serial
+ * number, enough to tell whether the same monitor came back.
+ */
+static u8 edid_id[MAX_DPCD_BUFFER_SIZE];
+static bool edid_id_valid = false;
+
 int anx7625_dp_get_edid(uint8_t bus, struct edid *out)
 {
     int block_num;
     int ret;
     u8 edid[FOUR_BLOCK_SIZE];
+    stats_phase_t outer;
 
+    outer = stats_begin(STATS_EDID_READ);
     block_num = sp_tx_edid_read(bus, edid, FOUR_BLOCK_SIZE);
+    stats_end(STATS_EDID_READ, outer);
     if (block_num < 0)
     {
         ANXERROR("Failed to get eDP EDID.\n");
         return -1;
     }
+    memcpy(edid_id, edid, sizeof(edid_id));
+    edid_id_valid = true;
 
+    stats_start(STATS_EDID_DECODE);
     ret = decode_edid(edid, (block_num + 1) * ONE_BLOCK_SIZE, out);
+    stats_stop(STATS_EDID_DECODE);
     if (ret != EDID_CONFORMANT)
     {
         ANXERROR("Failed to decode EDID.\n");
@@ -1129,410 +1179,2173 @@ int anx7625_dp_get_edid(uint8_t bus, struct edid *out)
     return 0;
 }
 
-int anx7625_init(uint8_t bus)
+/* Read just the first 16 bytes of EDID block 0 */
+static int anx7625_read_edid_id(uint8_t bus, u8 *id)
 {
-    int retry_power_on = 3;
+    int ret;
 
-    ANXINFO("OTG_ON = 1 -> VBUS OFF\n");
-    if (mp_hal_pin_read(mp_hal_get_pin_obj(anx7625_obj->pin_otg_on_obj)) != 0)
-    {
-        mp_hal_pin_config(mp_hal_get_pin_obj(anx7625_obj->pin_otg_on_obj), MP_HAL_PIN_MODE_OUTPUT, MP_HAL_PIN_PULL_NONE, 0);
-        mp_hal_pin_high(mp_hal_get_pin_obj(anx7625_obj->pin_otg_on_obj));
-    }
-    else
+    ret = anx7625_reg_write(bus, RX_P0_ADDR, AP_AUX_ADDR_7_0, 0x50);
+    ret |= anx7625_reg_write(bus, RX_P0_ADDR, AP_AUX_ADDR_15_8, 0);
+    ret |= anx7625_write_and(bus, RX_P0_ADDR, AP_AUX_ADDR_19_16, 0xf0);
+    if (ret == 0)
     {
-        ANXERROR("Cannot disable VBUS, someone is actively driving OTG_ON (PJ_6, USB_HS ID Pin)\n");
+        ret = edid_read(bus, 0, id) ? -1 : 0;
     }
-    mdelay(1000); // @TODO: wait for VBUS to discharge (VBUS is activated during bootloader, can be removed when fixed)
 
-    ANXINFO("Powering on anx7625...\n");
-    mp_hal_pin_high(mp_hal_get_pin_obj(anx7625_obj->pin_video_on_obj));
-    mdelay(10);
-    mp_hal_pin_high(mp_hal_get_pin_obj(anx7625_obj->pin_video_rst_obj));
-    mdelay(10);
+    /* reset aux channel */
+    sp_tx_rst_aux(bus);
+    return ret;
+}
+
+/*
+ * What the last successful bring-up left running. Static data survives a
+ * soft reset, so the next constructor can find the bridge still streaming.
+ */
+typedef struct _anx7625_warm_t
+{
+    bool valid;
+    uint8_t version;
+    uint8_t revision;
+    enum edid_modes mode;
+    struct display_timing timing;
+    struct edid edid;
+} anx7625_warm_t;
+
+static anx7625_warm_t warm_start;
+
+/*
+ * Hot-plug service, called at a low rate or on the bridge alert once the
+ * display runs. Returns 1 when a monitor came, 0 when it went, -1 for no
+ * change. A new connection gets the bridge DSI set-up again for the
+ * running timing. The EDID is read in full only when the monitor identity
+ * differs from the cached one, and the STM32 side is only reprogrammed
+ * when that EDID asks for another timing.
+ */
+int anx7625_hotplug_poll(uint8_t bus, anx7625_hotplug_t *h, anx7625_bringup_t *b)
+{
+    uint8_t alert = 0, change = 0, status;
 
-    while (--retry_power_on)
+    /* acknowledge the alert line and the latched HPD change */
+    if (anx7625_reg_read(bus, TCPC_INTERFACE_ADDR, INTR_ALERT_1, &alert) == 0 && alert != 0)
     {
-        if (anx7625_power_on_init(bus) == 0)
-            break;
+        anx7625_reg_write(bus, TCPC_INTERFACE_ADDR, INTR_ALERT_1, 0xFF);
+    }
+    if (anx7625_reg_read(bus, RX_P0_ADDR, INTERFACE_CHANGE_INT, &change) == 0 && change != 0)
+    {
+        anx7625_reg_write(bus, RX_P0_ADDR, INTERFACE_CHANGE_INT, 0);
     }
-    if (!retry_power_on)
+    if (anx7625_reg_read(bus, RX_P0_ADDR, SYSTEM_STSTUS, &status) < 0)
     {
-        ANXERROR("Failed to power on.\n");
         return -1;
     }
 
-    ANXINFO("Powering on anx7625 successfull.\n");
-    mdelay(200); // Wait for anx7625 to be stable
-
-    if (anx7625_is_power_provider(0))
+    if (h->connected && (!(status & HPD_STATUS) || (change & HPD_STATUS_CHANGE)))
     {
-        ANXINFO("OTG_ON = 0 -> VBUS ON\n");
-        mp_hal_pin_low(mp_hal_get_pin_obj(anx7625_obj->pin_otg_on_obj)); // If the pin is still input this has not effect
-        mdelay(1000);                                                    // Wait for powered device to be stable
+        /* gone, or gone and back since the last poll: the next poll reconnects */
+        ANXINFO("HPD low, monitor disconnected.\n");
+        h->connected = false;
+        h->disconnects++;
+        return 0;
     }
 
-    return 0;
-}
+    if (!h->connected && (status & HPD_STATUS))
+    {
+        u8 id[MAX_DPCD_BUFFER_SIZE];
 
-int anx7625_wait_hpd_event(uint8_t bus)
-{
-    ANXINFO("Waiting for hdmi hot plug event...\n");
+        ANXINFO("HPD event received 0x7e:0x45=%02x\n", status);
+        anx7625_start_dp_work(bus);
 
-    int retry_hpd_change = 10000;
-    while (--retry_hpd_change)
-    {
-        mdelay(10);
-        int detected = anx7625_hpd_change_detect(bus);
-        if (detected < 0)
+        h->edid_read = !edid_id_valid || anx7625_read_edid_id(bus, id) < 0 || memcmp(id, edid_id, sizeof(id)) != 0;
+        if (h->edid_read && anx7625_dp_get_edid(bus, &b->edid) < 0)
+        {
+            /* try again at the next poll */
             return -1;
-        if (detected > 0)
-            return 0;
-    }
+        }
+        ANXINFO("EDID %s.\n", h->edid_read ? "read again" : "unchanged");
 
-    ANXERROR("Timed out to detect HPD change on bus %d.\n", bus);
+        h->resized = false;
+        if (h->edid_read)
+        {
+            /* another monitor, whose EDID may prefer another timing */
+            struct display_timing edid_dt;
+            anx7625_get_timing(&b->edid, b->mode, &edid_dt);
+            if (getFramebufferBytes(&edid_dt) > b->fb_size)
+            {
+                ANXERROR("Buffer too small for the new monitor's mode, keeping the current one.\n");
+            }
+            else
+            {
+                h->resized = SetDisplayTiming(&edid_dt) > 0;
+            }
+            if (warm_start.valid)
+            {
+                warm_start.timing = *getActiveTiming();
+                warm_start.edid = b->edid;
+            }
+        }
+
+        struct display_timing dt = *getActiveTiming();
+        if (anx7625_dsi_config(bus, &dt) < 0)
+        {
+            return -1;
+        }
+        h->connected = true;
+        h->connects++;
+        return 1;
+    }
     return -1;
 }
 
-int anx7625_read_system_status(uint8_t bus, uint8_t *sys_status)
+/*
+ * Check the bridge MIPI receiver for an HS checksum error since the last
+ * call and clear it. Returns 1 for an error, 0 for none, -1 on I/O error.
+ */
+int anx7625_mipi_alert_poll(uint8_t bus)
 {
-    int ret = 0;
-    ret = anx7625_reg_read(bus, RX_P0_ADDR, SYSTEM_STSTUS, sys_status); // 0x7e, 0x45
-    if (ret < 0)
+    uint8_t alert;
+
+    if (anx7625_reg_read(bus, RX_P1_ADDR, MIPI_ALERT_OUT_0, &alert) < 0)
     {
-        ANXERROR("Failed %s", __func__);
-        return ret;
+        return -1;
     }
-    if (*sys_status & (1 << 2))
-        ANXDEBUG("anx: - VCONN status ON\n");
-    if (!(*sys_status & (1 << 2)))
-        ANXDEBUG("anx: - VCONN status OFF\n");
+    if (!(alert & (1 << check_sum_err_hs_sync)))
+    {
+        return 0;
+    }
+    CountMipiAlert();
+    /* self clearing */
+    anx7625_write_or(bus, RX_P1_ADDR, MIPI_ALERT_CLR_0, 1 << HS_link_error_clear);
+    return 1;
+}
 
-    if (*sys_status & (1 << 3))
-        ANXDEBUG("anx: - VBUS power provider\n");
-    if (!(*sys_status & (1 << 3)))
-        ANXDEBUG("anx: - VBUS power consumer\n");
+/* Step names for anx7625_state_name() */
+static const char *const anx7625_state_names[] = {
+    [ANX7625_STATE_IDLE] = "idle",
+    [ANX7625_STATE_PROBE] = "probe",
+    [ANX7625_STATE_VBUS_OFF] = "vbus_off",
+    [ANX7625_STATE_POWER_ON] = "power_on",
+    [ANX7625_STATE_RESET] = "reset",
+    [ANX7625_STATE_FIRMWARE] = "firmware",
+    [ANX7625_STATE_STABLE] = "stable",
+    [ANX7625_STATE_VBUS_ON] = "vbus_on",
+    [ANX7625_STATE_HPD] = "hpd",
+    [ANX7625_STATE_START] = "start",
+    [ANX7625_STATE_READY] = "ready",
+    [ANX7625_STATE_FAILED] = "failed",
+};
 
-    if (*sys_status & (1 << 5))
-        ANXDEBUG("anx: - Data Role: DFP\n");
-    if (!(*sys_status & (1 << 5)))
-        ANXDEBUG("anx: - Data Role: UFP\n");
+const char *anx7625_state_name(anx7625_state_t state)
+{
+    return anx7625_state_names[state];
+}
 
-    if (*sys_status & (1 << 7))
-        ANXDEBUG("anx: - DP HPD high\n");
-    if (!(*sys_status & (1 << 7)))
-        ANXDEBUG("anx: - DP HPD low\n");
-    return ret;
+void anx7625_bringup_init(anx7625_bringup_t *b, enum edid_modes mode, uint32_t fb_address, uint32_t fb_size)
+{
+    memset(b, 0, sizeof(*b));
+    /* the pins are only looked at, left as they are until a cold start */
+    b->state = (warm_start.valid && warm_start.mode == mode) ? ANX7625_STATE_PROBE : ANX7625_STATE_VBUS_OFF;
+    b->mode = mode;
+    b->fb_address = fb_address;
+    b->fb_size = fb_size;
+    b->retries = OCM_POWER_ON_RETRIES;
+    b->start_tick = mp_hal_ticks_ms();
+    b->step_tick = b->start_tick;
+    b->step_state = b->state;
+    b->stats_phase = STATS_PHASES;
 }
 
-// This function is used to understand if we need to provide VBUS on USB-C
-// connector or not
-bool anx7625_is_power_provider(uint8_t bus)
+/*
+ * The bridge is powered and out of reset, runs the firmware seen at the
+ * last start, has HPD high and its MIPI receiver on and unmuted.
+ */
+static bool anx7625_bringup_is_warm(uint8_t bus)
 {
-    int ret = 0;
-    uint8_t sys_status = 0;
-    anx7625_read_system_status(bus, &sys_status);
-    if (ret < 0)
+    uint8_t version, revision, status, av_status;
+
+    if (mp_hal_pin_read(mp_hal_get_pin_obj(anx7625_obj->pin_video_on_obj)) == 0 ||
+        mp_hal_pin_read(mp_hal_get_pin_obj(anx7625_obj->pin_video_rst_obj)) == 0)
     {
-        ANXERROR("Failed %s", __func__);
-        return false; // Conservative
+        return false;
     }
-    else
+    if (anx7625_reg_read(bus, RX_P0_ADDR, OCM_FW_VERSION, &version) < 0 ||
+        anx7625_reg_read(bus, RX_P0_ADDR, OCM_FW_REVERSION, &revision) < 0 ||
+        version != warm_start.version || revision != warm_start.revision)
     {
-        if (sys_status & (1 << 3))
-            return true;
-        else
-            return false;
+        return false;
+    }
+    if (anx7625_read_system_status(bus, &status) < 0 || (status & HPD_STATUS) == 0)
+    {
+        return false;
+    }
+    if (anx7625_reg_read(bus, RX_P0_ADDR, AP_AV_STATUS, &av_status) < 0 ||
+        (av_status & (AP_MIPI_RX_EN | AP_MIPI_MUTE)) != AP_MIPI_RX_EN)
+    {
+        return false;
     }
+    return true;
 }
 
-#define LCD_MAX_X_SIZE 1280
-#define LCD_MAX_Y_SIZE 1024
-#define BYTES_PER_PIXEL 2
-
-static uint32_t lcd_x_size = LCD_MAX_X_SIZE;
-static uint32_t lcd_y_size = LCD_MAX_Y_SIZE;
-static uint32_t framebuffer_address_0 = -1;
-static uint32_t framebuffer_address_1 = -1;
-static uint32_t pend_buffer = 0;
-volatile uint32_t reloadLTDC_status = 0;
-
-static DMA2D_HandleTypeDef dma2d = {0};
-static LTDC_HandleTypeDef ltdc = {0};
-static DSI_HandleTypeDef dsi = {0};
-
-static void LayerInit(uint16_t LayerIndex, uint32_t FB_Address)
+/* Power the bridge down and let OTG_ON float, the start of a cold bring-up */
+static void anx7625_power_off(void)
 {
-    LTDC_LayerCfgTypeDef Layercfg;
+    /* video on */
+    mp_hal_pin_config(mp_hal_get_pin_obj(anx7625_obj->pin_video_on_obj), MP_HAL_PIN_MODE_OUTPUT, MP_HAL_PIN_PULL_NONE, 0);
+    mp_hal_pin_config_speed(mp_hal_get_pin_obj(anx7625_obj->pin_video_on_obj), MP_HAL_PIN_SPEED_HIGH);
+    mp_hal_pin_low(mp_hal_get_pin_obj(anx7625_obj->pin_video_on_obj));
+
+    /* video rst */
+    mp_hal_pin_config(mp_hal_get_pin_obj(anx7625_obj->pin_video_rst_obj), MP_HAL_PIN_MODE_OUTPUT, MP_HAL_PIN_PULL_NONE, 0);
+    mp_hal_pin_config_speed(mp_hal_get_pin_obj(anx7625_obj->pin_video_rst_obj), MP_HAL_PIN_SPEED_HIGH);
+    mp_hal_pin_low(mp_hal_get_pin_obj(anx7625_obj->pin_video_rst_obj));
+
+    /* otg on */
+    mp_hal_pin_config(mp_hal_get_pin_obj(anx7625_obj->pin_otg_on_obj), MP_HAL_PIN_MODE_OUTPUT, MP_HAL_PIN_PULL_NONE, 0);
+    mp_hal_pin_config_speed(mp_hal_get_pin_obj(anx7625_obj->pin_otg_on_obj), MP_HAL_PIN_SPEED_HIGH);
+    mp_hal_pin_low(mp_hal_get_pin_obj(anx7625_obj->pin_otg_on_obj));
+
+    mp_hal_pin_config(mp_hal_get_pin_obj(anx7625_obj->pin_otg_on_obj), MP_HAL_PIN_MODE_INPUT, MP_HAL_PIN_PULL_UP, 0);
+    mp_hal_pin_config_speed(mp_hal_get_pin_obj(anx7625_obj->pin_otg_on_obj), MP_HAL_PIN_SPEED_HIGH);
+}
 
-    /* Layer Init */
-    Layercfg.WindowX0 = 0;
-    Layercfg.WindowX1 = lcd_x_size;
-    Layercfg.WindowY0 = 0;
-    Layercfg.WindowY1 = lcd_y_size;
-    Layercfg.PixelFormat = LTDC_PIXEL_FORMAT_RGB565; // LTDC_PIXEL_FORMAT_ARGB8888;
-    Layercfg.FBStartAdress = FB_Address;
-    Layercfg.Alpha = 255;
-    Layercfg.Alpha0 = 0;
-    Layercfg.Backcolor.Blue = 0;
-    Layercfg.Backcolor.Green = 0;
-    Layercfg.Backcolor.Red = 0;
-    Layercfg.BlendingFactor1 = LTDC_BLENDING_FACTOR1_PAxCA;
-    Layercfg.BlendingFactor2 = LTDC_BLENDING_FACTOR2_PAxCA;
-    Layercfg.ImageWidth = lcd_x_size;
-    Layercfg.ImageHeight = lcd_y_size;
+static int anx7625_bringup_fail(anx7625_bringup_t *b, const char *what)
+{
+    ANXERROR("%s\n", what);
+    b->state = ANX7625_STATE_FAILED;
+    return -1;
+}
 
-    HAL_LTDC_ConfigLayer(&ltdc, &Layercfg, LayerIndex);
+/* The constructor checks fixed modes, modes taken from the EDID are checked here */
+static bool anx7625_bringup_fits(const anx7625_bringup_t *b, const struct display_timing *dt)
+{
+    return getFramebufferBytes(dt) <= b->fb_size;
 }
 
-int config(uint8_t bus, struct edid *edid, struct display_timing *dt, uint32_t fb_address)
+/*
+ * Account STM32 set-up run at the start of a bridge wait of wait ms and
+ * return what is left of the wait.
+ */
+static int anx7625_bringup_overlap(anx7625_bringup_t *b, uint32_t start, int wait)
 {
-    static const uint32_t DSI_PLLNDIV = 40;
-    static const uint32_t DSI_PLLIDF = DSI_PLL_IN_DIV2;
-    static const uint32_t DSI_PLLODF = DSI_PLL_OUT_DIV1;
-    static const uint32_t DSI_TXEXCAPECLOCKDIV = 4;
+    uint32_t elapsed = mp_hal_ticks_ms() - start;
+    b->local_ms += elapsed;
+    b->hidden_ms += MIN(elapsed, (uint32_t)wait);
+    return MAX(wait - (int)elapsed, 0);
+}
 
-    static uint32_t LTDC_FREQ_STEP = 100;
-    // set PLL3 to start from a 1MHz reference and increment by 100 or 200 KHz based on the frequency range
+/*
+ * Bring-up without the waits of the original sequence, which are returned
+ * to the caller instead of slept through. The STM32 side of the display
+ * is set up inside them: LTDC and DMA2D while VBUS discharges, the DSI host
+ * once the bridge firmware runs.
+ */
+static int anx7625_bringup_next(uint8_t bus, anx7625_bringup_t *b)
+{
+    uint8_t val, version, revision;
+    uint32_t start;
 
-    if (dt->pixelclock / LTDC_FREQ_STEP > 512)
-        LTDC_FREQ_STEP = 200;
+    switch (b->state)
+    {
+    case ANX7625_STATE_PROBE:
+        if (!anx7625_bringup_is_warm(bus))
+        {
+            ANXINFO("No running bridge, cold start.\n");
+            b->state = ANX7625_STATE_VBUS_OFF;
+            return 0;
+        }
+        ANXINFO("Bridge still running, firmware ver %02x, rev %02x.\n", warm_start.version, warm_start.revision);
+        {
+            /* only the STM32 side lost its configuration */
+            struct display_timing dt = warm_start.timing;
+            b->version = warm_start.version;
+            b->revision = warm_start.revision;
+            b->edid = warm_start.edid;
+            if (!anx7625_bringup_fits(b, &dt))
+            {
+                return anx7625_bringup_fail(b, "Buffer too small for this mode.");
+            }
+            start = mp_hal_ticks_ms();
+            stats_start(STATS_LTDC_CONFIG);
+            config(bus, &b->edid, &dt, b->fb_address);
+            stats_stop(STATS_LTDC_CONFIG);
+            b->local_ms += mp_hal_ticks_ms() - start;
+        }
+        b->state = ANX7625_STATE_READY;
+        return -1;
 
-    uint32_t LTDC_PLL3M = HSE_VALUE / 1000000;
-    uint32_t LTDC_PLL3N = dt->pixelclock / LTDC_FREQ_STEP;
-    static uint32_t LTDC_PLL3P = 2;
-    static uint32_t LTDC_PLL3Q = 7;
-    uint32_t LTDC_PLL3R = 1000 / LTDC_FREQ_STEP;  // expected pixel clock
-    dt->pixelclock = (LTDC_PLL3N)*LTDC_FREQ_STEP; // real pixel clock
+    case ANX7625_STATE_VBUS_OFF:
+        warm_start.valid = false;
+        anx7625_power_off();
 
-    static const uint32_t LANE_BYTE_CLOCK = 62500;
+        ANXINFO("OTG_ON = 1 -> VBUS OFF\n");
+        if (mp_hal_pin_read(mp_hal_get_pin_obj(anx7625_obj->pin_otg_on_obj)) != 0)
+        {
+            mp_hal_pin_config(mp_hal_get_pin_obj(anx7625_obj->pin_otg_on_obj), MP_HAL_PIN_MODE_OUTPUT, MP_HAL_PIN_PULL_NONE, 0);
+            mp_hal_pin_high(mp_hal_get_pin_obj(anx7625_obj->pin_otg_on_obj));
+        }
+        else
+        {
+            ANXERROR("Cannot disable VBUS, someone is actively driving OTG_ON (PJ_6, USB_HS ID Pin)\n");
+        }
+        b->state = ANX7625_STATE_POWER_ON;
+
+        start = mp_hal_ticks_ms();
+        stats_start(STATS_LTDC_CONFIG);
+        if (b->mode != EDID_MODE_AUTO)
+        {
+            struct display_timing dt = {0};
+            anx7625_mode_timing(b->mode, &dt);
+            PrepareDisplay(&dt, b->fb_address);
+        }
+        else
+        {
+            /* the timing comes with the EDID */
+            PrepareDisplay(NULL, b->fb_address);
+        }
+        stats_stop(STATS_LTDC_CONFIG);
+        return anx7625_bringup_overlap(b, start, 1000); // @TODO: wait for VBUS to discharge (VBUS is activated during bootloader, can be removed when fixed)
+
+    case ANX7625_STATE_POWER_ON:
+        ANXINFO("Powering on anx7625...\n");
+        mp_hal_pin_high(mp_hal_get_pin_obj(anx7625_obj->pin_video_on_obj));
+        b->state = ANX7625_STATE_RESET;
+        return 10;
+
+    case ANX7625_STATE_RESET:
+        mp_hal_pin_high(mp_hal_get_pin_obj(anx7625_obj->pin_video_rst_obj));
+        b->state = ANX7625_STATE_FIRMWARE;
+        b->polls = 0;
+        return 10;
+
+    case ANX7625_STATE_FIRMWARE:
+        if (b->polls == 0)
+        {
+            anx7625_reg_write(bus, RX_P0_ADDR, XTAL_FRQ_SEL, XTAL_FRQ_27M);
+        }
+        if (b->polls++ >= OCM_LOADING_TIME)
+        {
+            if (--b->retries == 0)
+            {
+                return anx7625_bringup_fail(b, "Failed to power on.");
+            }
+            b->polls = 0;
+            return 0;
+        }
+        /* check interface */
+        if (anx7625_reg_read(bus, RX_P0_ADDR, FLASH_LOAD_STA, &val) < 0)
+        {
+            ANXERROR("Failed to load flash\n");
+            /* start over with the next attempt */
+            b->polls = OCM_LOADING_TIME;
+            return 1;
+        }
+        if ((val & FLASH_LOAD_STA_CHK) != FLASH_LOAD_STA_CHK)
+        {
+            return 1;
+        }
+        ANXINFO("Init interface.\n");
+        anx7625_reg_read(bus, RX_P0_ADDR, OCM_FW_VERSION, &version);
+        anx7625_reg_read(bus, RX_P0_ADDR, OCM_FW_REVERSION, &revision);
+        if (version == 0 && revision == 0)
+        {
+            return 0;
+        }
+        ANXINFO("Firmware: ver %02x, rev %02x.\n", version, revision);
+        b->version = version;
+        b->revision = revision;
+        ANXINFO("Powering on anx7625 successfull.\n");
+        b->state = ANX7625_STATE_STABLE;
+
+        start = mp_hal_ticks_ms();
+        stats_start(STATS_LTDC_CONFIG);
+        PrepareDsi();
+        stats_stop(STATS_LTDC_CONFIG);
+        return anx7625_bringup_overlap(b, start, 200); // Wait for anx7625 to be stable
+
+    case ANX7625_STATE_STABLE:
+        b->state = ANX7625_STATE_VBUS_ON;
+        if (anx7625_is_power_provider(bus))
+        {
+            ANXINFO("OTG_ON = 0 -> VBUS ON\n");
+            mp_hal_pin_low(mp_hal_get_pin_obj(anx7625_obj->pin_otg_on_obj)); // If the pin is still input this has not effect
+            return 1000;                                                     // Wait for powered device to be stable
+        }
+        return 0;
+
+    case ANX7625_STATE_VBUS_ON:
+        ANXINFO("Waiting for hdmi hot plug event...\n");
+        b->state = ANX7625_STATE_HPD;
+        b->polls = 0;
+        return 10;
+
+    case ANX7625_STATE_HPD:
+    {
+        int detected = anx7625_hpd_change_detect(bus);
+        if (detected < 0)
+        {
+            return anx7625_bringup_fail(b, "HPD detection failed.");
+        }
+        if (detected == 0)
+        {
+            if (++b->polls >= HPD_POLL_COUNT)
+            {
+                return anx7625_bringup_fail(b, "Timed out to detect HPD change.");
+            }
+            return 10;
+        }
+        b->state = ANX7625_STATE_START;
+        return 0;
+    }
+
+    case ANX7625_STATE_START:
+    {
+        anx7625_dp_get_edid(bus, &b->edid);
+        struct display_timing dt;
+        anx7625_get_timing(&b->edid, b->mode, &dt);
+        if (!anx7625_bringup_fits(b, &dt))
+        {
+            return anx7625_bringup_fail(b, "Buffer too small for this mode.");
+        }
+        if (anx7625_dp_start(bus, &b->edid, b->mode, b->fb_address) < 0)
+        {
+            return anx7625_bringup_fail(b, "anx7625_dp_start failed.");
+        }
+        warm_start.version = b->version;
+        warm_start.revision = b->revision;
+        warm_start.mode = b->mode;
+        warm_start.timing = *getActiveTiming();
+        warm_start.edid = b->edid;
+        warm_start.valid = true;
+        b->state = ANX7625_STATE_READY;
+        return -1;
+    }
+
+    default:
+        return -1;
+    }
+}
+
+/* Profiler phase of each step, its wait included */
+static const uint8_t anx7625_state_stats[] = {
+    [ANX7625_STATE_IDLE] = STATS_OTHER,
+    [ANX7625_STATE_PROBE] = STATS_PROBE,
+    [ANX7625_STATE_VBUS_OFF] = STATS_VBUS,
+    [ANX7625_STATE_POWER_ON] = STATS_OCM,
+    [ANX7625_STATE_RESET] = STATS_OCM,
+    [ANX7625_STATE_FIRMWARE] = STATS_OCM,
+    [ANX7625_STATE_STABLE] = STATS_VBUS,
+    [ANX7625_STATE_VBUS_ON] = STATS_HPD,
+    [ANX7625_STATE_HPD] = STATS_HPD,
+    [ANX7625_STATE_START] = STATS_DP_START,
+    [ANX7625_STATE_READY] = STATS_OTHER,
+    [ANX7625_STATE_FAILED] = STATS_OTHER,
+};
+
+/*
+ * One step of the bring-up, timed per state. Returns the delay in ms
+ * before the next step, or -1 once the state is READY or FAILED.
+ */
+int anx7625_bringup_step(uint8_t bus, anx7625_bringup_t *b)
+{
+    uint32_t now = mp_hal_ticks_ms();
+    if (b->step_state < ANX7625_STATE_READY)
+    {
+        /* the previous step and the wait it asked for */
+        b->phase_ms[b->step_state] += now - b->step_tick;
+    }
+    b->step_tick = now;
+    b->step_state = b->state;
+
+    stats_phase_t phase = anx7625_state_stats[b->state];
+    if (phase != b->stats_phase)
+    {
+        stats_stop(b->stats_phase);
+        stats_start(phase);
+        b->stats_phase = phase;
+    }
+    stats_phase_t outer = stats_enter(phase);
+    int delay = anx7625_bringup_next(bus, b);
+    stats_leave(outer);
+    if (delay < 0)
+    {
+        stats_stop(b->stats_phase);
+        b->stats_phase = STATS_PHASES;
+        now = mp_hal_ticks_ms();
+        if (b->step_state < ANX7625_STATE_READY)
+        {
+            b->phase_ms[b->step_state] += now - b->step_tick;
+        }
+        b->step_state = b->state;
+        b->total_ms = now - b->start_tick;
+
+        for (uint32_t i = ANX7625_STATE_PROBE; i < ANX7625_STATE_READY; i++)
+        {
+            ANXINFO("%-8s %5u ms\n", anx7625_state_name(i), (unsigned int)b->phase_ms[i]);
+        }
+        ANXINFO("total %u ms, local set-up %u ms, %u ms of it inside bridge waits.\n",
+                (unsigned int)b->total_ms, (unsigned int)b->local_ms, (unsigned int)b->hidden_ms);
+    }
+    return delay;
+}
+
+/* Run the whole bring-up, sleeping through the waits */
+int anx7625_bringup_run(uint8_t bus, anx7625_bringup_t *b)
+{
+    int delay;
+    while ((delay = anx7625_bringup_step(bus, b)) >= 0)
+    {
+        mdelay(delay);
+    }
+    return (b->state == ANX7625_STATE_READY) ? 0 : -1;
+}
+
+/*
+ * Switch the running display to another timing. The bridge ignores its
+ * MIPI input meanwhile, so neither the DSI restart nor a PLL3 change
+ * reaches the screen. Returns what SetDisplayTiming() does, or -1 on a
+ * bridge I/O error, left muted.
+ */
+static bool SameTiming(const struct display_timing *a, const struct display_timing *b);
+
+int anx7625_set_mode(uint8_t bus, anx7625_bringup_t *b, enum edid_modes mode, struct display_timing *dt)
+{
+    int ret, resized;
+
+    if (SameTiming(dt, getActiveTiming()))
+    {
+        /* nothing to reprogram, the bridge is left unmuted */
+        b->mode = mode;
+        if (warm_start.valid)
+        {
+            warm_start.mode = mode;
+        }
+        return 0;
+    }
+
+    ret = anx7625_write_or(bus, RX_P0_ADDR, AP_AV_STATUS, AP_MIPI_MUTE);
+    if (ret < 0)
+    {
+        ANXERROR("IO error: mute mipi rx failed.\n");
+        return ret;
+    }
+
+    stats_start(STATS_LTDC_CONFIG);
+    resized = SetDisplayTiming(dt);
+    stats_stop(STATS_LTDC_CONFIG);
+
+    ret = anx7625_dsi_video_timing(bus, dt);
+    if (ret < 0)
+    {
+        return ret;
+    }
+
+    ret = anx7625_write_and(bus, RX_P0_ADDR, AP_AV_STATUS, ~AP_MIPI_MUTE);
+    if (ret < 0)
+    {
+        ANXERROR("IO error: unmute mipi rx failed.\n");
+        return ret;
+    }
+
+    b->mode = mode;
+    if (warm_start.valid)
+    {
+        warm_start.mode = mode;
+        warm_start.timing = *getActiveTiming();
+    }
+    ANXINFO("mode %ux%u, pixel clock %u kHz.\n", dt->hactive, dt->vactive, dt->pixelclock);
+    return resized;
+}
+
+int anx7625_read_system_status(uint8_t bus, uint8_t *sys_status)
+{
+    int ret = 0;
+    ret = anx7625_reg_read(bus, RX_P0_ADDR, SYSTEM_STSTUS, sys_status); // 0x7e, 0x45
+    if (ret < 0)
+    {
+        ANXERROR("Failed %s", __func__);
+        return ret;
+    }
+    if (*sys_status & (1 << 2))
+        ANXDEBUG("anx: - VCONN status ON\n");
+    if (!(*sys_status & (1 << 2)))
+        ANXDEBUG("anx: - VCONN status OFF\n");
+
+    if (*sys_status & (1 << 3))
+        ANXDEBUG("anx: - VBUS power provider\n");
+    if (!(*sys_status & (1 << 3)))
+        ANXDEBUG("anx: - VBUS power consumer\n");
+
+    if (*sys_status & (1 << 5))
+        ANXDEBUG("anx: - Data Role: DFP\n");
+    if (!(*sys_status & (1 << 5)))
+        ANXDEBUG("anx: - Data Role: UFP\n");
+
+    if (*sys_status & (1 << 7))
+        ANXDEBUG("anx: - DP HPD high\n");
+    if (!(*sys_status & (1 << 7)))
+        ANXDEBUG("anx: - DP HPD low\n");
+    return ret;
+}
+
+// This function is used to understand if we need to provide VBUS on USB-C
+// connector or not
+bool anx7625_is_power_provider(uint8_t bus)
+{
+    int ret = 0;
+    uint8_t sys_status = 0;
+    anx7625_read_system_status(bus, &sys_status);
+    if (ret < 0)
+    {
+        ANXERROR("Failed %s", __func__);
+        return false; // Conservative
+    }
+    else
+    {
+        if (sys_status & (1 << 3))
+            return true;
+        else
+            return false;
+    }
+}
+
+#define LCD_MAX_X_SIZE 1280
+#define LCD_MAX_Y_SIZE 1024
+/* Entries of the LTDC colour lookup table used by L8 framebuffers */
+#define CLUT_SIZE 256
+
+#define DCACHE_LINE_SIZE 32
+#define DCACHE_REGION_MAX (16 * 1024)
+
+/* Read-only memory-mapped regions the DMA2D reads assets from in place */
+#define MAPPED_REGIONS_MAX 4
+
+typedef struct _mapped_region_t
+{
+    uint32_t base;
+    uint32_t size;
+} mapped_region_t;
+
+/* Beyond this many regions the dirty list collapses to their bounding box */
+#define DIRTY_RECTS_MAX 16
+
+typedef struct _dirty_rect_t
+{
+    int32_t x0;
+    int32_t y0;
+    int32_t x1;
+    int32_t y1;
+} dirty_rect_t;
+
+static uint32_t lcd_x_size = LCD_MAX_X_SIZE;
+static uint32_t lcd_y_size = LCD_MAX_Y_SIZE;
+/* The DMA2D has no 8-bit output, L8 fills write pairs of indices as RGB565 */
+static const pixel_format_t pixel_formats[] = {
+    {DMA2D_INPUT_RGB565, LTDC_PIXEL_FORMAT_RGB565, DMA2D_OUTPUT_RGB565, 2, 16},
+    {DMA2D_INPUT_ARGB8888, LTDC_PIXEL_FORMAT_ARGB8888, DMA2D_OUTPUT_ARGB8888, 4, 24},
+    {DMA2D_INPUT_RGB888, LTDC_PIXEL_FORMAT_RGB888, DMA2D_OUTPUT_RGB888, 3, 24},
+    {DMA2D_INPUT_ARGB4444, LTDC_PIXEL_FORMAT_ARGB4444, DMA2D_OUTPUT_ARGB4444, 2, 12},
+    {DMA2D_INPUT_L8, LTDC_PIXEL_FORMAT_L8, DMA2D_OUTPUT_RGB565, 1, 24},
+};
+
+static const pixel_format_t *pixel_format = &pixel_formats[0];
+/* Layer window on the screen, the framebuffer is lcd_x_size x lcd_y_size */
+static uint32_t window_x0 = 0;
+static uint32_t window_y0 = 0;
+static uint32_t window_width = 0;
+static uint32_t window_height = 0;
+/* The window as clipped to the running timing */
+static uint32_t layer_x0 = 0;
+static uint32_t layer_y0 = 0;
+static uint32_t background_rgb = 0;
+/* Blanked: both layers off and the LTDC background shows the clear colour */
+static bool blanked = false;
+static bool blank_fill_pending = false;
+static uint32_t blank_color = 0;
+static struct display_timing active_timing = {0};
+static uint32_t clut[CLUT_SIZE];
+static uint32_t framebuffer_address_0 = -1;
+static uint32_t framebuffer_address_1 = -1;
+static uint32_t pend_buffer = 0;
+volatile uint32_t reloadLTDC_status = 0;
+
+static mapped_region_t mapped_regions[MAPPED_REGIONS_MAX];
+static uint32_t mapped_count = 0;
+
+static dirty_rect_t dirty_rects[DIRTY_RECTS_MAX];
+static uint32_t dirty_count = 0;
+static bool copy_forward = false;
+static bool single_buffer = false;
+static bool skip_unchanged = false;
+static uint32_t crc_rows = 0;
+static uint32_t front_crc = 0;
+static uint32_t skipped_frames = 0;
+
+/* A flip on its way to the screen, see GetFrameStats() */
+typedef struct _frame_flight_t
+{
+    bool valid;
+    bool marked;
+    uint32_t request_us;
+    uint32_t request_refresh;
+    uint32_t show_refresh;
+    uint32_t marker_id;
+    uint32_t mark_us;
+} frame_flight_t;
+
+/* Written by the LTDC interrupt, read in atomic sections */
+static frame_stats_t frame_stats = {0};
+static frame_flight_t frame_pending = {0};  /* flush under way, until its reload */
+static frame_flight_t frame_inflight = {0}; /* latched, until its refresh starts */
+static frame_marker_t frame_markers[FRAME_MARKERS_MAX];
+static uint32_t frame_marker_count = 0;
+static bool mark_pending = false;
+static uint32_t mark_id = 0;
+static uint32_t mark_us = 0;
+
+/* Written by the LTDC and DSI interrupts, read in atomic sections */
+static link_health_t link_health = {0};
+static bool underrun_seen = false;
+static bool underrun_throttle = false;
+static uint32_t underrun_clean = 0; /* refreshes since the last underrun */
+
+/* DMA2D pacing, -1 for the default of the scanout load */
+static int32_t throttle_dead_time_cfg = -1;
+static int32_t throttle_bands_cfg = -1;
+static uint32_t throttle_dead_time = 0;
+static uint32_t band_lines = 0;
+
+static void ApplyDMA2DThrottle(void);
+
+/* Line callback, run from the LTDC interrupt at a layer row of every refresh */
+static void (*line_event_handler)(uint32_t refresh) = NULL;
+static int32_t line_event_row = 0;
+static bool line_event_user = false; /* LIPCR at that row, not at line 0 */
+
+static DMA2D_HandleTypeDef dma2d = {0};
+static LTDC_HandleTypeDef ltdc = {0};
+static DSI_HandleTypeDef dsi = {0};
+
+static void LayerInit(uint16_t LayerIndex, uint32_t FB_Address)
+{
+    LTDC_LayerCfgTypeDef Layercfg;
+
+    /* Layer Init */
+    Layercfg.WindowX0 = layer_x0;
+    Layercfg.WindowX1 = layer_x0 + lcd_x_size;
+    Layercfg.WindowY0 = layer_y0;
+    Layercfg.WindowY1 = layer_y0 + lcd_y_size;
+    Layercfg.PixelFormat = pixel_format->ltdc;
+    Layercfg.FBStartAdress = FB_Address;
+    Layercfg.Alpha = 255;
+    Layercfg.Alpha0 = 0;
+    Layercfg.Backcolor.Blue = 0;
+    Layercfg.Backcolor.Green = 0;
+    Layercfg.Backcolor.Red = 0;
+    Layercfg.BlendingFactor1 = LTDC_BLENDING_FACTOR1_PAxCA;
+    Layercfg.BlendingFactor2 = LTDC_BLENDING_FACTOR2_PAxCA;
+    Layercfg.ImageWidth = lcd_x_size;
+    Layercfg.ImageHeight = lcd_y_size;
+
+    HAL_LTDC_ConfigLayer(&ltdc, &Layercfg, LayerIndex);
+
+    if (pixel_format->dma2d == DMA2D_INPUT_L8)
+    {
+        HAL_LTDC_ConfigCLUT(&ltdc, clut, CLUT_SIZE, LayerIndex);
+        HAL_LTDC_EnableCLUT(&ltdc, LayerIndex);
+    }
+}
+
+const pixel_format_t *FindPixelFormat(uint32_t format)
+{
+    for (uint32_t i = 0; i < MP_ARRAY_SIZE(pixel_formats); i++)
+    {
+        if (pixel_formats[i].dma2d == format)
+        {
+            return &pixel_formats[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Select the framebuffer format by its DMA2D input colour mode, before the
+ * display is started. The L8 palette starts out as RGB332.
+ */
+int SetPixelFormat(uint32_t format)
+{
+    const pixel_format_t *f = FindPixelFormat(format);
+    if (f == NULL)
+    {
+        return -1;
+    }
+    pixel_format = f;
+
+    for (uint32_t i = 0; i < CLUT_SIZE; i++)
+    {
+        uint32_t r = (i >> 5) * 255 / 7;
+        uint32_t g = ((i >> 2) & 7) * 255 / 7;
+        uint32_t b = (i & 3) * 255 / 3;
+        clut[i] = (r << 16) | (g << 8) | b;
+    }
+    return 0;
+}
+
+/*
+ * Back only a w x h window at (x, y) of the screen with the framebuffer,
+ * before the display is started. The LTDC fills the rest with the
+ * background colour without reading memory. A zero size is full screen.
+ */
+void SetLayerWindow(uint32_t x, uint32_t y, uint32_t w, uint32_t h)
+{
+    window_x0 = x;
+    window_y0 = y;
+    window_width = w;
+    window_height = h;
+}
+
+uint32_t getWindowX()
+{
+    return layer_x0;
+}
+
+uint32_t getWindowY()
+{
+    return layer_y0;
+}
+
+/* Colour (0xRRGGBB) the LTDC shows wherever no layer pixel covers the screen */
+void SetBackgroundColor(uint32_t rgb)
+{
+    background_rgb = rgb & 0x00FFFFFF;
+    if (ltdc.Instance != NULL && !blanked)
+    {
+        /* not shadowed, takes effect on the next pixel */
+        ltdc.Instance->BCCR = background_rgb;
+    }
+}
+
+const pixel_format_t *getPixelFormat(void)
+{
+    return pixel_format;
+}
+
+uint32_t getBytesPerPixel()
+{
+    return pixel_format->bpp;
+}
+
+/* Peak of the 16-bit SDRAM at 120 MHz holding the framebuffers */
+#define SDRAM_BANDWIDTH (240 * 1000 * 1000)
+/*
+ * Default DMA2D pacing by the scanout share of the SDRAM bandwidth, in
+ * per mille: a dead time growing from 0 to 255 cycles past the first
+ * threshold, bands past the second.
+ */
+#define DMA2D_THROTTLE_LOAD 250
+#define DMA2D_BANDS_LOAD 400
+#define DMA2D_BAND_LINES 32
+
+/* Two lanes at 500 Mbit/s, from the 62.5 MHz lane byte clock */
+#define DSI_LANE_BYTE_CLOCK 62500
+#define DSI_CAPACITY (DSI_LANE_BYTE_CLOCK * 8 * 2)
+
+/*
+ * RGB888 on the link when the framebuffer holds more than 16 colour bits
+ * and the lanes keep up with 24 bits per pixel, RGB565 otherwise.
+ */
+static uint32_t DsiColorCoding(const pixel_format_t *f, uint32_t pixelclock)
+{
+    if (f->depth > 16 && pixelclock * 24 <= DSI_CAPACITY)
+    {
+        return DSI_RGB888;
+    }
+    return DSI_RGB565;
+}
+
+/*
+ * Memory and link cost of a framebuffer format at the timing and layer
+ * window of the running display. Returns -1 before the display is started or for unknown formats.
+ */
+int EstimateBandwidth(uint32_t format, bandwidth_t *bw)
+{
+    const pixel_format_t *f = FindPixelFormat(format);
+    const struct display_timing *dt = &active_timing;
+    if (f == NULL || dt->pixelclock == 0)
+    {
+        return -1;
+    }
+
+    uint32_t htotal = dt->hactive + dt->hsync_len + dt->hback_porch + dt->hfront_porch;
+    uint32_t vtotal = dt->vactive + dt->vsync_len + dt->vback_porch + dt->vfront_porch;
+
+    /* only the layer window is read, the LTDC makes up the rest */
+    bw->frame_bytes = lcd_x_size * lcd_y_size * f->bpp;
+    bw->scanout = (uint64_t)bw->frame_bytes * dt->pixelclock * 1000 / (htotal * vtotal);
+    bw->dsi_coding = DsiColorCoding(f, dt->pixelclock);
+    bw->dsi_rate = dt->pixelclock * ((bw->dsi_coding == DSI_RGB888) ? 24 : 16);
+    bw->dsi_capacity = DSI_CAPACITY;
+    return 0;
+}
+
+/*
+ * Replace the first count palette entries (0x00RRGGBB). With vblank the
+ * tables are written once the LTDC has finished scanning the active area,
+ * so a palette animation never changes colours mid-frame.
+ */
+int SetPalette(const uint32_t *colors, uint32_t count, bool vblank)
+{
+    if (pixel_format->dma2d != DMA2D_INPUT_L8)
+    {
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < MIN(count, CLUT_SIZE); i++)
+    {
+        clut[i] = colors[i] & 0x00FFFFFF;
+    }
+
+    if (vblank)
+    {
+        uint32_t tickstart = HAL_GetTick();
+        /* wait for the start of the next blanking interval */
+        while (!(LTDC->CDSR & LTDC_CDSR_VDES) && (HAL_GetTick() - tickstart) < 50)
+        {
+        }
+        while ((LTDC->CDSR & LTDC_CDSR_VDES) && (HAL_GetTick() - tickstart) < 50)
+        {
+        }
+    }
+
+    HAL_LTDC_ConfigCLUT(&ltdc, clut, CLUT_SIZE, 0);
+    HAL_LTDC_ConfigCLUT(&ltdc, clut, CLUT_SIZE, 1);
+    return 0;
+}
+
+/* Parts of config() already done by PrepareDisplay() and PrepareDsi() */
+#define PREPARED_CLOCKS (1 << 0)
+#define PREPARED_LTDC (1 << 1)
+#define PREPARED_DSI_HOST (1 << 2)
+#define PREPARED_DSI_VIDEO (1 << 3)
+
+static uint32_t prepared = 0;
+/* Timing the prepared parts were set up for, as requested */
+static struct display_timing prepared_timing = {0};
+
+static bool SameTiming(const struct display_timing *a, const struct display_timing *b)
+{
+    return a->pixelclock == b->pixelclock &&
+           a->hactive == b->hactive && a->hfront_porch == b->hfront_porch &&
+           a->hback_porch == b->hback_porch && a->hsync_len == b->hsync_len &&
+           a->vactive == b->vactive && a->vfront_porch == b->vfront_porch &&
+           a->vback_porch == b->vback_porch && a->vsync_len == b->vsync_len &&
+           a->hpol == b->hpol && a->vpol == b->vpol;
+}
+
+/*
+ * PLL3 starts from a 1MHz reference and steps by 100 or 200 KHz based on
+ * the frequency range. Returns the real pixel clock for a requested one.
+ */
+static uint32_t LtdcFreqStep(uint32_t pixelclock)
+{
+    return (pixelclock / 100 > 512) ? 200 : 100;
+}
+
+static uint32_t RoundPixelClock(uint32_t pixelclock)
+{
+    uint32_t step = LtdcFreqStep(pixelclock);
+    return (pixelclock / step) * step;
+}
+
+/* Clocks, resets and interrupts of the LTDC, DMA2D and DSI */
+static void DisplayClocksInit(void)
+{
+    /** @brief Enable the LTDC clock */
+    __HAL_RCC_LTDC_CLK_ENABLE();
+
+    /** @brief Toggle Sw reset of LTDC IP */
+    __HAL_RCC_LTDC_FORCE_RESET();
+    __HAL_RCC_LTDC_RELEASE_RESET();
+
+    /** @brief Enable the DMA2D clock */
+    __HAL_RCC_DMA2D_CLK_ENABLE();
+
+    /** @brief Toggle Sw reset of DMA2D IP */
+    __HAL_RCC_DMA2D_FORCE_RESET();
+    __HAL_RCC_DMA2D_RELEASE_RESET();
+    link_health.dead_time = 0;
+
+    /** @brief Enable DSI Host and wrapper clocks */
+    __HAL_RCC_DSI_CLK_ENABLE();
+
+    /** @brief Soft Reset the DSI Host and wrapper */
+    __HAL_RCC_DSI_FORCE_RESET();
+    __HAL_RCC_DSI_RELEASE_RESET();
+
+    /** @brief NVIC configuration for LTDC interrupt that is now enabled */
+    HAL_NVIC_SetPriority(LTDC_IRQn, 0x0F, 0);
+    HAL_NVIC_EnableIRQ(LTDC_IRQn);
+
+    /** @brief NVIC configuration for DMA2D interrupt that is now enabled */
+    HAL_NVIC_SetPriority(DMA2D_IRQn, 0x0F, 0);
+    HAL_NVIC_EnableIRQ(DMA2D_IRQn);
+
+    /** @brief NVIC configuration for DSI interrupt that is now enabled */
+    HAL_NVIC_SetPriority(DSI_IRQn, 0x0F, 0);
+    HAL_NVIC_EnableIRQ(DSI_IRQn);
+}
+
+/* DSI host and its PLL, the same for every display timing */
+static void DsiHostInit(void)
+{
+    static const uint32_t DSI_PLLNDIV = 40;
+    static const uint32_t DSI_PLLIDF = DSI_PLL_IN_DIV2;
+    static const uint32_t DSI_PLLODF = DSI_PLL_OUT_DIV1;
+    static const uint32_t DSI_TXEXCAPECLOCKDIV = 4;
+
+    DSI_PLLInitTypeDef dsiPllInit;
+
+    /* Base address of DSI Host/Wrapper registers to be set before calling De-Init */
+    dsi.Instance = DSI;
+
+    HAL_DSI_DeInit(&(dsi));
+
+    /* Configure the DSI PLL */
+    dsiPllInit.PLLNDIV = DSI_PLLNDIV;
+    dsiPllInit.PLLIDF = DSI_PLLIDF;
+    dsiPllInit.PLLODF = DSI_PLLODF;
+
+    /* Set number of Lanes */
+    dsi.Init.NumberOfLanes = DSI_TWO_DATA_LANES;
+    /* Set the TX escape clock division ratio */
+    dsi.Init.TXEscapeCkdiv = DSI_TXEXCAPECLOCKDIV;
+    /* Disable the automatic clock lane control (the ANX7265 must be clocked) */
+    dsi.Init.AutomaticClockLaneControl = DSI_AUTO_CLK_LANE_CTRL_DISABLE;
+
+    /* Init the DSI */
+    HAL_DSI_Init(&dsi, &dsiPllInit);
+
+    /* the link only transmits, the acknowledge and receive errors never come */
+    HAL_DSI_ConfigErrorMonitor(&dsi, HAL_DSI_ERROR_PHY | HAL_DSI_ERROR_TX | HAL_DSI_ERROR_PSE | HAL_DSI_ERROR_GEN);
+}
+
+/* DSI video mode timing, dt->pixelclock already rounded */
+static void DsiVideoInit(const struct display_timing *dt)
+{
+    static const uint32_t LANE_BYTE_CLOCK = DSI_LANE_BYTE_CLOCK;
+
+    DSI_PHY_TimerTypeDef dsiPhyInit;
+    DSI_VidCfgTypeDef hdsivideo_handle;
+
+    hdsivideo_handle.VirtualChannelID = 0;
+
+    /* Timing parameters for Video modes
+     Set Timing parameters of DSI depending on its chosen format */
+    hdsivideo_handle.ColorCoding = DsiColorCoding(pixel_format, dt->pixelclock);
+    hdsivideo_handle.LooselyPacked = DSI_LOOSELY_PACKED_DISABLE;
+    hdsivideo_handle.VSPolarity = DSI_VSYNC_ACTIVE_LOW;
+    hdsivideo_handle.HSPolarity = DSI_HSYNC_ACTIVE_LOW;
+    hdsivideo_handle.DEPolarity = DSI_DATA_ENABLE_ACTIVE_HIGH;
+    hdsivideo_handle.Mode = DSI_VID_MODE_BURST;
+    hdsivideo_handle.NullPacketSize = 0xFFF;
+    hdsivideo_handle.NumberOfChunks = 1;
+    hdsivideo_handle.PacketSize = dt->hactive;
+    hdsivideo_handle.HorizontalSyncActive = dt->hsync_len * LANE_BYTE_CLOCK / dt->pixelclock;
+    hdsivideo_handle.HorizontalBackPorch = dt->hback_porch * LANE_BYTE_CLOCK / dt->pixelclock;
+    hdsivideo_handle.HorizontalLine = (dt->hactive + dt->hsync_len + dt->hback_porch + dt->hfront_porch) * LANE_BYTE_CLOCK / dt->pixelclock;
+    hdsivideo_handle.VerticalSyncActive = dt->vsync_len;
+    hdsivideo_handle.VerticalBackPorch = dt->vback_porch;
+    hdsivideo_handle.VerticalFrontPorch = dt->vfront_porch;
+    hdsivideo_handle.VerticalActive = dt->vactive;
+
+    /* Enable or disable sending LP command while streaming is active in video mode */
+    hdsivideo_handle.LPCommandEnable = DSI_LP_COMMAND_ENABLE; /* Enable sending commands in mode LP (Low Power) */
+
+    /* Largest packet size possible to transmit in LP mode in VSA, VBP, VFP regions */
+    /* Only useful when sending LP packets is allowed while streaming is active in video mode */
+    hdsivideo_handle.LPLargestPacketSize = 16;
+
+    /* Largest packet size possible to transmit in LP mode in HFP region during VACT period */
+    /* Only useful when sending LP packets is allowed while streaming is active in video mode */
+    hdsivideo_handle.LPVACTLargestPacketSize = 0;
+
+    /* Specify for each region, if the going in LP mode is allowed */
+    /* while streaming is active in video mode                     */
+    hdsivideo_handle.LPHorizontalFrontPorchEnable = DSI_LP_HFP_ENABLE; /* Allow sending LP commands during HFP period */
+    hdsivideo_handle.LPHorizontalBackPorchEnable = DSI_LP_HBP_ENABLE;  /* Allow sending LP commands during HBP period */
+    hdsivideo_handle.LPVerticalActiveEnable = DSI_LP_VACT_ENABLE;      /* Allow sending LP commands during VACT period */
+    hdsivideo_handle.LPVerticalFrontPorchEnable = DSI_LP_VFP_ENABLE;   /* Allow sending LP commands during VFP period */
+    hdsivideo_handle.LPVerticalBackPorchEnable = DSI_LP_VBP_ENABLE;    /* Allow sending LP commands during VBP period */
+    hdsivideo_handle.LPVerticalSyncActiveEnable = DSI_LP_VSYNC_ENABLE; /* Allow sending LP commands during VSync = VSA period */
+
+    /* Configure DSI Video mode timings with settings set above */
+    HAL_DSI_ConfigVideoMode(&dsi, &hdsivideo_handle);
+
+    /* Configure DSI PHY HS2LP and LP2HS timings */
+    dsiPhyInit.ClockLaneHS2LPTime = 35;
+    dsiPhyInit.ClockLaneLP2HSTime = 35;
+    dsiPhyInit.DataLaneHS2LPTime = 35;
+    dsiPhyInit.DataLaneLP2HSTime = 35;
+    dsiPhyInit.DataLaneMaxReadTime = 0;
+    dsiPhyInit.StopWaitTime = 10;
+    HAL_DSI_ConfigPhyTimer(&dsi, &dsiPhyInit);
+}
+
+/* The layer window clipped to dt, an empty window is full screen */
+static void ClipWindowTo(const struct display_timing *dt, uint32_t wx, uint32_t wy, uint32_t ww, uint32_t wh,
+                         uint32_t *x0, uint32_t *y0, uint32_t *w, uint32_t *h)
+{
+    *x0 = MIN(wx, dt->hactive - 1);
+    *y0 = MIN(wy, dt->vactive - 1);
+    *w = (ww != 0) ? MIN(ww, dt->hactive - *x0) : dt->hactive - *x0;
+    *h = (wh != 0) ? MIN(wh, dt->vactive - *y0) : dt->vactive - *y0;
+}
+
+static void ClipWindow(const struct display_timing *dt, uint32_t *x0, uint32_t *y0, uint32_t *w, uint32_t *h)
+{
+    ClipWindowTo(dt, window_x0, window_y0, window_width, window_height, x0, y0, w, h);
+}
+
+/*
+ * Memory the framebuffers would take at the timing dt with a format, window
+ * and buffer count not applied yet, so a constructor can check it first.
+ */
+uint32_t FramebufferBytesFor(const struct display_timing *dt, const pixel_format_t *format,
+                             uint32_t wx, uint32_t wy, uint32_t ww, uint32_t wh, bool single)
+{
+    uint32_t x0, y0, w, h;
+    ClipWindowTo(dt, wx, wy, ww, wh, &x0, &y0, &w, &h);
+    return (single ? 1 : 2) * w * h * format->bpp;
+}
+
+/* Memory the framebuffers take at the timing dt */
+uint32_t getFramebufferBytes(const struct display_timing *dt)
+{
+    return FramebufferBytesFor(dt, pixel_format, window_x0, window_y0, window_width, window_height, single_buffer);
+}
+
+/* PLL3 for an already rounded pixel clock */
+static void LtdcClockInit(uint32_t pixelclock)
+{
+    uint32_t LTDC_FREQ_STEP = LtdcFreqStep(pixelclock);
+    uint32_t LTDC_PLL3M = HSE_VALUE / 1000000;
+    uint32_t LTDC_PLL3N = pixelclock / LTDC_FREQ_STEP;
+    static uint32_t LTDC_PLL3P = 2;
+    static uint32_t LTDC_PLL3Q = 7;
+    uint32_t LTDC_PLL3R = 1000 / LTDC_FREQ_STEP; // expected pixel clock
+
+    RCC_PeriphCLKInitTypeDef PeriphClkInitStruct;
+
+    /* LCD clock configuration */
+    /* PLL3_VCO Input = HSE_VALUE/PLL3M = 1 Mhz */
+    /* PLL3_VCO Output = PLL3_VCO Input * PLL3N */
+    /* PLLLCDCLK = PLL3_VCO Output/PLL3R */
+    /* LTDC clock frequency = PLLLCDCLK */
+    PeriphClkInitStruct.PeriphClockSelection = RCC_PERIPHCLK_LTDC;
+    PeriphClkInitStruct.PLL3.PLL3M = LTDC_PLL3M;
+    PeriphClkInitStruct.PLL3.PLL3N = LTDC_PLL3N;
+    PeriphClkInitStruct.PLL3.PLL3P = LTDC_PLL3P;
+    PeriphClkInitStruct.PLL3.PLL3Q = LTDC_PLL3Q;
+    PeriphClkInitStruct.PLL3.PLL3R = LTDC_PLL3R;
+    HAL_RCCEx_PeriphCLKConfig(&PeriphClkInitStruct);
+}
+
+/* Sync, porch and polarity settings of dt in the LTDC handle */
+static void LtdcTimingSet(const struct display_timing *dt)
+{
+    /* Timing Configuration */
+    ltdc.Init.HorizontalSync = (dt->hsync_len - 1);
+    ltdc.Init.AccumulatedHBP = (dt->hsync_len + dt->hback_porch - 1);
+    ltdc.Init.AccumulatedActiveW = (dt->hactive + dt->hsync_len + dt->hback_porch - 1);
+    ltdc.Init.TotalWidth = (dt->hactive + dt->hsync_len + dt->hback_porch + dt->hfront_porch - 1);
+    ltdc.Init.VerticalSync = (dt->vsync_len - 1);
+    ltdc.Init.AccumulatedVBP = (dt->vsync_len + dt->vback_porch - 1);
+    ltdc.Init.AccumulatedActiveH = (dt->vactive + dt->vsync_len + dt->vback_porch - 1);
+    ltdc.Init.TotalHeigh = (dt->vactive + dt->vsync_len + dt->vback_porch + dt->vfront_porch - 1);
+
+    /* Polarity */
+    ltdc.Init.HSPolarity = dt->hpol ? LTDC_HSPOLARITY_AH : LTDC_HSPOLARITY_AL;
+    ltdc.Init.VSPolarity = dt->vpol ? LTDC_VSPOLARITY_AH : LTDC_VSPOLARITY_AL;
+}
+
+static void LogBandwidth(void)
+{
+    bandwidth_t bw;
+    EstimateBandwidth(pixel_format->dma2d, &bw);
+    ANXINFO("frame(%u) scanout(%u B/s) dsi(%u of %u kbit/s).\n",
+            (unsigned int)bw.frame_bytes, (unsigned int)bw.scanout,
+            (unsigned int)bw.dsi_rate, (unsigned int)bw.dsi_capacity);
+}
+
+/*
+ * Pixel clock, LTDC timing, layers and framebuffers, dt->pixelclock already
+ * rounded. Both buffers end up cleared, so drawing can start right after.
+ */
+static void LtdcInit(const struct display_timing *dt, uint32_t fb_address)
+{
+    ClipWindow(dt, &layer_x0, &layer_y0, &lcd_x_size, &lcd_y_size);
+    active_timing = *dt;
+    LogBandwidth();
+    ApplyDMA2DThrottle();
+
+    framebuffer_address_0 = fb_address;
+    framebuffer_address_1 = single_buffer ? fb_address : fb_address + (lcd_x_size * lcd_y_size * pixel_format->bpp);
+
+    LtdcClockInit(dt->pixelclock);
+
+    /* Base address of LTDC registers to be set before calling De-Init */
+    ltdc.Instance = LTDC;
+
+    HAL_LTDC_DeInit(&(ltdc));
+
+    LtdcTimingSet(dt);
+
+    /* background value */
+    ltdc.Init.Backcolor.Blue = background_rgb & 0xFF;
+    ltdc.Init.Backcolor.Green = (background_rgb >> 8) & 0xFF;
+    ltdc.Init.Backcolor.Red = (background_rgb >> 16) & 0xFF;
+
+    ltdc.LayerCfg->ImageWidth = lcd_x_size;
+    ltdc.LayerCfg->ImageHeight = lcd_y_size;
+
+    ltdc.Init.DEPolarity = LTDC_DEPOLARITY_AL;
+    ltdc.Init.PCPolarity = LTDC_PCPOLARITY_IPC;
+
+    /* Initialize & Start the LTDC, it only feeds the DSI wrapper */
+    HAL_LTDC_Init(&ltdc);
+
+    /* line 0 is the start of the vertical sync, after the VBR reload point */
+    HAL_LTDC_ProgramLineEvent(&ltdc, 0);
+    line_event_user = false;
+
+    LayerInit(0, framebuffer_address_0);
+    LayerInit(1, framebuffer_address_1);
+
+    Clear(0);
+    drawCurrentFrameBuffer();
+    Clear(0);
+    drawCurrentFrameBuffer();
+}
+
+/*
+ * Move the running display to the timing dt, rounding its pixel clock,
+ * and reprogram only what differs: PLL3, the LTDC timing registers, the
+ * DSI video mode and the layers. The framebuffers keep their content
+ * unless the layer changes size, then they are laid out again and
+ * cleared. Returns 1 in that case, 0 otherwise. The bridge is expected to
+ * ignore its MIPI input meanwhile.
+ */
+int SetDisplayTiming(struct display_timing *dt)
+{
+    uint32_t x0, y0, w, h;
+
+    dt->pixelclock = RoundPixelClock(dt->pixelclock);
+    if (SameTiming(dt, &active_timing))
+    {
+        return 0;
+    }
+    DMA2D_Wait();
+
+    /* the DSI host takes a new video mode only while stopped */
+    HAL_DSI_Stop(&dsi);
+
+    if (dt->pixelclock != active_timing.pixelclock)
+    {
+        LtdcClockInit(dt->pixelclock);
+    }
+
+    /* a row of the old timing may lie past the new total lines */
+    mp_uint_t state = MICROPY_BEGIN_ATOMIC_SECTION();
+    ltdc.Instance->LIPCR = 0;
+    line_event_user = false;
+    MICROPY_END_ATOMIC_SECTION(state);
+
+    LtdcTimingSet(dt);
+    ltdc.Instance->SSCR = (ltdc.Init.HorizontalSync << 16) | ltdc.Init.VerticalSync;
+    ltdc.Instance->BPCR = (ltdc.Init.AccumulatedHBP << 16) | ltdc.Init.AccumulatedVBP;
+    ltdc.Instance->AWCR = (ltdc.Init.AccumulatedActiveW << 16) | ltdc.Init.AccumulatedActiveH;
+    ltdc.Instance->TWCR = (ltdc.Init.TotalWidth << 16) | ltdc.Init.TotalHeigh;
+    MODIFY_REG(ltdc.Instance->GCR, LTDC_GCR_HSPOL | LTDC_GCR_VSPOL, ltdc.Init.HSPolarity | ltdc.Init.VSPolarity);
+
+    DsiVideoInit(dt);
+
+    ClipWindow(dt, &x0, &y0, &w, &h);
+    bool resized = (w != lcd_x_size || h != lcd_y_size);
+    bool moved = (x0 != layer_x0 || y0 != layer_y0);
+    active_timing = *dt;
+    layer_x0 = x0;
+    layer_y0 = y0;
+    lcd_x_size = w;
+    lcd_y_size = h;
+    if (line_event_row >= (int32_t)lcd_y_size)
+    {
+        line_event_row = lcd_y_size - 1;
+    }
+
+    if (resized)
+    {
+        framebuffer_address_1 = single_buffer ? framebuffer_address_0 : framebuffer_address_0 + (lcd_x_size * lcd_y_size * pixel_format->bpp);
+        LayerInit(0, framebuffer_address_0);
+        LayerInit(1, framebuffer_address_1);
+    }
+    else if (moved)
+    {
+        HAL_LTDC_SetWindowPosition(&ltdc, layer_x0, layer_y0, 0);
+        HAL_LTDC_SetWindowPosition(&ltdc, layer_x0, layer_y0, 1);
+    }
+    LogBandwidth();
+    ApplyDMA2DThrottle();
+
+    HAL_DSI_Start(&dsi);
+    HAL_DSI_Refresh(&dsi);
+
+    if (resized)
+    {
+        Clear(0);
+        drawCurrentFrameBuffer();
+        Clear(0);
+        drawCurrentFrameBuffer();
+    }
+    return resized ? 1 : 0;
+}
+
+/*
+ * Set up the LTDC and DMA2D while the bridge is still powering up. The
+ * timing is known ahead only for a fixed mode, dt is NULL otherwise and
+ * just the clocks are done. With a timing the framebuffers can be drawn
+ * into and flipped from here on, the frames reach the screen once config()
+ * starts the DSI host.
+ */
+void PrepareDisplay(const struct display_timing *dt, uint32_t fb_address)
+{
+    DisplayClocksInit();
+    prepared = PREPARED_CLOCKS;
+    framebuffer_address_0 = -1;
+    framebuffer_address_1 = -1;
+
+    if (dt != NULL)
+    {
+        struct display_timing t = *dt;
+        prepared_timing = *dt;
+        t.pixelclock = RoundPixelClock(t.pixelclock);
+        LtdcInit(&t, fb_address);
+        prepared |= PREPARED_LTDC;
+    }
+}
+
+/*
+ * Set up the DSI host once the bridge is powered, so its lanes do not
+ * drive an unpowered receiver. Takes the timing of PrepareDisplay().
+ */
+void PrepareDsi(void)
+{
+    if ((prepared & PREPARED_CLOCKS) == 0)
+    {
+        return;
+    }
+    DsiHostInit();
+    prepared |= PREPARED_DSI_HOST;
+
+    if (prepared & PREPARED_LTDC)
+    {
+        DsiVideoInit(&active_timing);
+        prepared |= PREPARED_DSI_VIDEO;
+    }
+}
+
+/* Timing of the running display, the pixel clock as PLL3 makes it */
+const struct display_timing *getActiveTiming(void)
+{
+    return &active_timing;
+}
+
+/* True once the framebuffers can be drawn into */
+bool IsDisplayPrepared(void)
+{
+    return framebuffer_address_0 != (uint32_t)-1;
+}
+
+int config(uint8_t bus, struct edid *edid, struct display_timing *dt, uint32_t fb_address)
+{
+    /* keep what was drawn since PrepareDisplay() if the timing still holds */
+    bool same = (prepared & PREPARED_LTDC) && fb_address == framebuffer_address_0 && SameTiming(dt, &prepared_timing);
+
+    dt->pixelclock = RoundPixelClock(dt->pixelclock); // real pixel clock
+
+    if ((prepared & PREPARED_CLOCKS) == 0)
+    {
+        DisplayClocksInit();
+    }
+
+    /*************************DSI Initialization***********************************/
+
+    if ((prepared & PREPARED_DSI_HOST) == 0)
+    {
+        DsiHostInit();
+    }
+    if (!same || (prepared & PREPARED_DSI_VIDEO) == 0)
+    {
+        DsiVideoInit(dt);
+    }
+
+    /*************************End DSI Initialization*******************************/
+
+    /************************LTDC Initialization***********************************/
+
+    if (!same)
+    {
+        LtdcInit(dt, fb_address);
+    }
+    prepared = 0;
+
+    /* Enable the DSI host and wrapper */
+    HAL_DSI_Start(&dsi);
+
+    HAL_DSI_Refresh(&dsi);
+
+    HAL_DSI_PatternGeneratorStop(&dsi);
+
+    return 0;
+}
+
+/*
+ * The DMA2D cannot write 8-bit pixels, so an L8 fill writes pairs of them
+ * as RGB565 pixels and the CPU does the odd columns at either edge.
+ */
+static void LL_FillBuffer8(uint8_t *pDst, uint32_t xSize, uint32_t ySize, uint32_t OffLine, uint8_t Index)
+{
+    uint32_t stride = xSize + OffLine;
+    uint8_t *start = pDst;
+    uint32_t width = xSize;
+
+    DMA2D_Wait();
+
+    if (xSize == 0 || ySize == 0)
+    {
+        return;
+    }
+    if (stride & 1)
+    {
+        for (uint32_t y = 0; y < ySize; y++)
+        {
+            memset(pDst + y * stride, Index, xSize);
+        }
+        CleanInvalidateDCacheRegion((uint32_t)pDst, (ySize - 1) * stride + xSize);
+        return;
+    }
+    if ((uint32_t)pDst & 1)
+    {
+        for (uint32_t y = 0; y < ySize; y++)
+        {
+            pDst[y * stride] = Index;
+        }
+        pDst++;
+        xSize--;
+    }
+    if (xSize & 1)
+    {
+        for (uint32_t y = 0; y < ySize; y++)
+        {
+            pDst[y * stride + xSize - 1] = Index;
+        }
+        xSize--;
+    }
+    CleanInvalidateDCacheRegion((uint32_t)start, (ySize - 1) * stride + width);
+    if (xSize == 0)
+    {
+        return;
+    }
 
-    lcd_x_size = dt->hactive;
-    lcd_y_size = dt->vactive;
+    dma2d_job_t job = {0};
+    job.mode = DMA2D_R2M;
+    job.out_address = (uint32_t)pDst;
+    job.out_offset = (stride - xSize) / 2;
+    job.out_pfc = DMA2D_OUTPUT_RGB565;
+    job.out_color = (Index << 8) | Index;
+    job.width = xSize / 2;
+    job.height = ySize;
+    DMA2D_Submit(&job);
+    DMA2D_Wait();
+}
 
-    framebuffer_address_0 = fb_address;
-    framebuffer_address_1 = fb_address + (lcd_x_size * lcd_y_size * BYTES_PER_PIXEL);
+static void LL_FillBuffer(uint32_t LayerIndex, void *pDst, uint32_t xSize, uint32_t ySize, uint32_t OffLine, uint32_t ColorIndex)
+{
+    if (pixel_format->dma2d == DMA2D_INPUT_L8)
+    {
+        LL_FillBuffer8(pDst, xSize, ySize, OffLine, ColorIndex);
+        return;
+    }
 
-    DSI_PLLInitTypeDef dsiPllInit;
-    DSI_PHY_TimerTypeDef dsiPhyInit;
-    RCC_PeriphCLKInitTypeDef PeriphClkInitStruct;
-    DSI_VidCfgTypeDef hdsivideo_handle;
+    DMA2D_Wait();
 
-    /** @brief Enable the LTDC clock */
-    __HAL_RCC_LTDC_CLK_ENABLE();
+    /* Register to memory mode, the HAL converts the ARGB8888 colour */
+    dma2d.Init.Mode = DMA2D_R2M;
+    dma2d.Init.ColorMode = pixel_format->out;
+    dma2d.Init.OutputOffset = OffLine;
 
-    /** @brief Toggle Sw reset of LTDC IP */
-    __HAL_RCC_LTDC_FORCE_RESET();
-    __HAL_RCC_LTDC_RELEASE_RESET();
+    dma2d.Instance = DMA2D;
 
-    /** @brief Enable the DMA2D clock */
-    __HAL_RCC_DMA2D_CLK_ENABLE();
+    /* DMA2D Initialization */
+    if (HAL_DMA2D_Init(&dma2d) == HAL_OK)
+    {
+        if (HAL_DMA2D_ConfigLayer(&dma2d, 1) == HAL_OK)
+        {
+            if (HAL_DMA2D_Start(&dma2d, ColorIndex, (uint32_t)pDst, xSize, ySize) == HAL_OK)
+            {
+                /* Polling For DMA transfer */
+                stats_start(STATS_DMA2D);
+                HAL_DMA2D_PollForTransfer(&dma2d, 25);
+                stats_stop(STATS_DMA2D);
+            }
+        }
+    }
+}
 
-    /** @brief Toggle Sw reset of DMA2D IP */
-    __HAL_RCC_DMA2D_FORCE_RESET();
-    __HAL_RCC_DMA2D_RELEASE_RESET();
+/* Wait for the last DMA2D transfer started by DMA2D_Submit() to complete */
+int DMA2D_Wait(void)
+{
+    uint32_t tickstart = HAL_GetTick();
 
-    /** @brief Enable DSI Host and wrapper clocks */
-    __HAL_RCC_DSI_CLK_ENABLE();
+    while (DMA2D->CR & DMA2D_CR_START)
+    {
+        if ((HAL_GetTick() - tickstart) > 25)
+        {
+            ANXERROR("DMA2D transfer timeout.\n");
+            DMA2D->CR |= DMA2D_CR_ABORT;
+            stats_stop(STATS_DMA2D);
+            return -1;
+        }
+    }
+    /* submit to completion, as seen here: there is no DMA2D interrupt */
+    stats_stop(STATS_DMA2D);
 
-    /** @brief Soft Reset the DSI Host and wrapper */
-    __HAL_RCC_DSI_FORCE_RESET();
-    __HAL_RCC_DSI_RELEASE_RESET();
+    if (DMA2D->ISR & (DMA2D_ISR_TEIF | DMA2D_ISR_CEIF))
+    {
+        DMA2D->IFCR = DMA2D_IFCR_CTEIF | DMA2D_IFCR_CCEIF;
+        return -1;
+    }
+    return 0;
+}
 
-    /** @brief NVIC configuration for LTDC interrupt that is now enabled */
-    HAL_NVIC_SetPriority(LTDC_IRQn, 0x0F, 0);
-    HAL_NVIC_EnableIRQ(LTDC_IRQn);
+bool IsMappedRegion(uint32_t address, uint32_t size)
+{
+    for (uint32_t i = 0; i < mapped_count; i++)
+    {
+        if (address >= mapped_regions[i].base && address - mapped_regions[i].base + size <= mapped_regions[i].size)
+        {
+            return true;
+        }
+    }
+    return false;
+}
 
-    /** @brief NVIC configuration for DMA2D interrupt that is now enabled */
-    HAL_NVIC_SetPriority(DMA2D_IRQn, 0x0F, 0);
-    HAL_NVIC_EnableIRQ(DMA2D_IRQn);
+/* -1 when the table is full, -2 for a range outside the QSPI window */
+int RegisterMappedRegion(uint32_t base, uint32_t size)
+{
+    /* written so that nothing wraps */
+    if (base - QSPI_MAP_BASE >= QSPI_MAP_SIZE || size > QSPI_MAP_SIZE - (base - QSPI_MAP_BASE))
+    {
+        return -2;
+    }
+    if (IsMappedRegion(base, size))
+    {
+        return 0;
+    }
+    if (mapped_count == MAPPED_REGIONS_MAX)
+    {
+        return -1;
+    }
+    mapped_regions[mapped_count].base = base;
+    mapped_regions[mapped_count].size = size;
+    mapped_count++;
+    EnsureMapped(base);
+    return 0;
+}
 
-    /** @brief NVIC configuration for DSI interrupt that is now enabled */
-    HAL_NVIC_SetPriority(DSI_IRQn, 0x0F, 0);
-    HAL_NVIC_EnableIRQ(DSI_IRQn);
+/*
+ * Filesystem accesses switch the QSPI flash to indirect mode, where the
+ * mapped window faults. Put it back before the DMA2D reads from it.
+ */
+void EnsureMapped(uint32_t address)
+{
+#if defined(MICROPY_HW_QSPIFLASH_SIZE_BITS_LOG2)
+    if (address - QSPI_MAP_BASE < QSPI_MAP_SIZE &&
+        (QUADSPI->CCR & QUADSPI_CCR_FMODE) != QUADSPI_CCR_FMODE)
+    {
+        qspi_memory_map();
+    }
+#endif
+}
 
-    /*************************DSI Initialization***********************************/
+/* Bits per pixel of the DMA2D input colour modes, YCbCr aside */
+static const uint8_t dma2d_input_bits[] = {32, 24, 16, 16, 16, 8, 8, 16, 4, 8, 4};
 
-    /* Base address of DSI Host/Wrapper registers to be set before calling De-Init */
-    dsi.Instance = DSI;
+/* The back buffer is not scanned out, the dead time alone paces it */
+static bool IsScanoutAddress(uint32_t address)
+{
+    uint32_t front = getActiveFrameBuffer();
+    return framebuffer_address_0 != (uint32_t)-1 && address >= front &&
+           address - front < lcd_x_size * lcd_y_size * pixel_format->bpp;
+}
 
-    HAL_DSI_DeInit(&(dsi));
+/*
+ * Hold a band writing into the buffer on screen while the scanout is in
+ * it or one band ahead of it, so the band lands just behind the beam.
+ */
+static void WaitBeamClear(uint32_t address, uint32_t rows)
+{
+    uint32_t front = getActiveFrameBuffer();
+    uint32_t stride = lcd_x_size * pixel_format->bpp;
+    if (address < front || address - front >= stride * lcd_y_size)
+    {
+        return;
+    }
 
-    /* Configure the DSI PLL */
-    dsiPllInit.PLLNDIV = DSI_PLLNDIV;
-    dsiPllInit.PLLIDF = DSI_PLLIDF;
-    dsiPllInit.PLLODF = DSI_PLLODF;
+    int32_t r0 = (address - front) / stride;
+    int32_t r1 = r0 + rows;
+    uint32_t tickstart = HAL_GetTick();
+    while ((HAL_GetTick() - tickstart) < 50)
+    {
+        int32_t row = GetScanline();
+        if (row < r0 - (int32_t)rows || row >= r1)
+        {
+            break;
+        }
+    }
+}
 
-    /* Set number of Lanes */
-    dsi.Init.NumberOfLanes = DSI_TWO_DATA_LANES;
-    /* Set the TX escape clock division ratio */
-    dsi.Init.TXEscapeCkdiv = DSI_TXEXCAPECLOCKDIV;
-    /* Disable the automatic clock lane control (the ANX7265 must be clocked) */
-    dsi.Init.AutomaticClockLaneControl = DSI_AUTO_CLK_LANE_CTRL_DISABLE;
+static void DMA2D_Start(const dma2d_job_t *job);
 
-    /* Init the DSI */
-    HAL_DSI_Init(&dsi, &dsiPllInit);
+/*
+ * Program the DMA2D straight from a register image and start it without
+ * waiting, so the caller can prepare the next job while this one runs.
+ * The HAL handle is bypassed: no re-initialisation, no state tracking.
+ * With bands set, a tall job writing into the buffer on screen runs as
+ * bands of rows, one at a time, the last one left running.
+ */
+void DMA2D_Submit(const dma2d_job_t *job)
+{
+    uint32_t fg_cm = job->fg_pfc & DMA2D_FGPFCCR_CM;
+    if (band_lines == 0 || job->height <= band_lines || !IsScanoutAddress(job->out_address) ||
+        (job->mode != DMA2D_R2M && fg_cm >= MP_ARRAY_SIZE(dma2d_input_bits)))
+    {
+        DMA2D_Start(job);
+        return;
+    }
 
-    hdsivideo_handle.VirtualChannelID = 0;
+    /* the source sides a mode does not read move along unused */
+    uint32_t fg_step = band_lines * (job->width + job->fg_offset) * dma2d_input_bits[MIN(fg_cm, 10)] / 8;
+    uint32_t bg_step = band_lines * (job->width + job->bg_offset) * dma2d_input_bits[MIN(job->bg_pfc & DMA2D_FGPFCCR_CM, 10)] / 8;
+    uint32_t out_step = band_lines * (job->width + job->out_offset) * dma2d_input_bits[job->out_pfc & DMA2D_OPFCCR_CM] / 8;
 
-    /* Timing parameters for Video modes
-     Set Timing parameters of DSI depending on its chosen format */
-    hdsivideo_handle.ColorCoding = DSI_RGB565; // may choose DSI_RGB888
-    hdsivideo_handle.LooselyPacked = DSI_LOOSELY_PACKED_DISABLE;
-    hdsivideo_handle.VSPolarity = DSI_VSYNC_ACTIVE_LOW;
-    hdsivideo_handle.HSPolarity = DSI_HSYNC_ACTIVE_LOW;
-    hdsivideo_handle.DEPolarity = DSI_DATA_ENABLE_ACTIVE_HIGH;
-    hdsivideo_handle.Mode = DSI_VID_MODE_BURST;
-    hdsivideo_handle.NullPacketSize = 0xFFF;
-    hdsivideo_handle.NumberOfChunks = 1;
-    hdsivideo_handle.PacketSize = lcd_x_size;
-    hdsivideo_handle.HorizontalSyncActive = dt->hsync_len * LANE_BYTE_CLOCK / dt->pixelclock;
-    hdsivideo_handle.HorizontalBackPorch = dt->hback_porch * LANE_BYTE_CLOCK / dt->pixelclock;
-    hdsivideo_handle.HorizontalLine = (dt->hactive + dt->hsync_len + dt->hback_porch + dt->hfront_porch) * LANE_BYTE_CLOCK / dt->pixelclock;
-    hdsivideo_handle.VerticalSyncActive = dt->vsync_len;
-    hdsivideo_handle.VerticalBackPorch = dt->vback_porch;
-    hdsivideo_handle.VerticalFrontPorch = dt->vfront_porch;
-    hdsivideo_handle.VerticalActive = dt->vactive;
+    dma2d_job_t band = *job;
+    for (uint32_t y = 0; y < job->height; y += band_lines)
+    {
+        band.height = MIN(band_lines, job->height - y);
+        WaitBeamClear(band.out_address, band.height);
+        DMA2D_Start(&band);
+        if (y + band.height < job->height)
+        {
+            DMA2D_Wait();
+        }
+        band.fg_address += fg_step;
+        band.bg_address += bg_step;
+        band.out_address += out_step;
+    }
+}
 
-    /* Enable or disable sending LP command while streaming is active in video mode */
-    hdsivideo_handle.LPCommandEnable = DSI_LP_COMMAND_ENABLE; /* Enable sending commands in mode LP (Low Power) */
+static void DMA2D_Start(const dma2d_job_t *job)
+{
+    if (!__HAL_RCC_DMA2D_IS_CLK_ENABLED())
+    {
+        /* a FrameBuffer may draw before any display is set up */
+        __HAL_RCC_DMA2D_CLK_ENABLE();
+    }
+    DMA2D_Wait();
+    EnsureMapped(job->fg_address);
+    EnsureMapped(job->bg_address);
+
+    DMA2D->CR = (DMA2D->CR & ~DMA2D_CR_MODE) | job->mode;
+    DMA2D->FGMAR = job->fg_address;
+    DMA2D->FGOR = job->fg_offset;
+    DMA2D->FGPFCCR = job->fg_pfc;
+    DMA2D->FGCOLR = job->fg_color;
+    DMA2D->BGMAR = job->bg_address;
+    DMA2D->BGOR = job->bg_offset;
+    DMA2D->BGPFCCR = job->bg_pfc;
+    DMA2D->OPFCCR = job->out_pfc;
+    DMA2D->OCOLR = job->out_color;
+    DMA2D->OMAR = job->out_address;
+    DMA2D->OOR = job->out_offset;
+    DMA2D->NLR = (job->width << DMA2D_NLR_PL_Pos) | job->height;
+
+    if (job->fg_clut != 0)
+    {
+        /* a few hundred words, loaded before every job as the palette may change */
+        DMA2D->FGCMAR = job->fg_clut;
+        DMA2D->FGPFCCR = job->fg_pfc | ((job->fg_clut_size - 1) << DMA2D_FGPFCCR_CS_Pos) | DMA2D_FGPFCCR_START;
+        uint32_t tickstart = HAL_GetTick();
+        while (DMA2D->FGPFCCR & DMA2D_FGPFCCR_START)
+        {
+            if ((HAL_GetTick() - tickstart) > 25)
+            {
+                ANXERROR("DMA2D CLUT load timeout.\n");
+                DMA2D->CR |= DMA2D_CR_ABORT;
+                return;
+            }
+        }
+        if (DMA2D->ISR & DMA2D_ISR_CAEIF)
+        {
+            /* a job with a half-loaded palette would draw garbage */
+            ANXERROR("DMA2D CLUT access error.\n");
+            DMA2D->IFCR = DMA2D_IFCR_CAECIF;
+            return;
+        }
+    }
 
-    /* Largest packet size possible to transmit in LP mode in VSA, VBP, VFP regions */
-    /* Only useful when sending LP packets is allowed while streaming is active in video mode */
-    hdsivideo_handle.LPLargestPacketSize = 16;
+    DMA2D->CR |= DMA2D_CR_START;
+    stats_start(STATS_DMA2D);
+}
 
-    /* Largest packet size possible to transmit in LP mode in HFP region during VACT period */
-    /* Only useful when sending LP packets is allowed while streaming is active in video mode */
-    hdsivideo_handle.LPVACTLargestPacketSize = 0;
+/*
+ * Make a region coherent before a DMA2D transfer touches it: CPU writes
+ * reach memory and no stale lines survive the DMA2D writes. Beyond the
+ * D-cache size a full clean is cheaper than walking the region.
+ */
+void CleanInvalidateDCacheRegion(uint32_t address, uint32_t size)
+{
+#if defined(__CORTEX_M7)
+    if (IsMappedRegion(address, size))
+    {
+        /* read-only, never dirty and never written behind the cache */
+        return;
+    }
+    if (size > DCACHE_REGION_MAX)
+    {
+        SCB_CleanInvalidateDCache();
+        return;
+    }
+    uint32_t start = address & ~(DCACHE_LINE_SIZE - 1);
+    SCB_CleanInvalidateDCache_by_Addr((uint32_t *)start, size + (address - start));
+#endif
+}
 
-    /* Specify for each region, if the going in LP mode is allowed */
-    /* while streaming is active in video mode                     */
-    hdsivideo_handle.LPHorizontalFrontPorchEnable = DSI_LP_HFP_ENABLE; /* Allow sending LP commands during HFP period */
-    hdsivideo_handle.LPHorizontalBackPorchEnable = DSI_LP_HBP_ENABLE;  /* Allow sending LP commands during HBP period */
-    hdsivideo_handle.LPVerticalActiveEnable = DSI_LP_VACT_ENABLE;      /* Allow sending LP commands during VACT period */
-    hdsivideo_handle.LPVerticalFrontPorchEnable = DSI_LP_VFP_ENABLE;   /* Allow sending LP commands during VFP period */
-    hdsivideo_handle.LPVerticalBackPorchEnable = DSI_LP_VBP_ENABLE;    /* Allow sending LP commands during VBP period */
-    hdsivideo_handle.LPVerticalSyncActiveEnable = DSI_LP_VSYNC_ENABLE; /* Allow sending LP commands during VSync = VSA period */
+DMA2D_HandleTypeDef *get_DMA2D(void)
+{
+    return &dma2d;
+}
 
-    /* Configure DSI Video mode timings with settings set above */
-    HAL_DSI_ConfigVideoMode(&dsi, &hdsivideo_handle);
+/*
+ * Bring the new back buffer up to date with the frame just presented by
+ * copying only what was drawn into it. The back buffer was identical to
+ * the front one after the previous flip, so the dirty regions are all it
+ * is missing. Runs after the reload so the LTDC no longer scans it.
+ */
+static void CopyForward(void)
+{
+    uint32_t src = getActiveFrameBuffer();
+    uint32_t dst = getCurrentFrameBuffer();
 
-    /* Configure DSI PHY HS2LP and LP2HS timings */
-    dsiPhyInit.ClockLaneHS2LPTime = 35;
-    dsiPhyInit.ClockLaneLP2HSTime = 35;
-    dsiPhyInit.DataLaneHS2LPTime = 35;
-    dsiPhyInit.DataLaneLP2HSTime = 35;
-    dsiPhyInit.DataLaneMaxReadTime = 0;
-    dsiPhyInit.StopWaitTime = 10;
-    HAL_DSI_ConfigPhyTimer(&dsi, &dsiPhyInit);
+    for (uint32_t i = 0; i < dirty_count; i++)
+    {
+        const dirty_rect_t *r = &dirty_rects[i];
+        uint32_t offset = (r->y0 * lcd_x_size + r->x0) * pixel_format->bpp;
+        uint32_t w = r->x1 - r->x0;
+        uint32_t h = r->y1 - r->y0;
+        uint32_t size = ((h - 1) * lcd_x_size + w) * pixel_format->bpp;
+
+        dma2d_job_t job = {0};
+        job.mode = DMA2D_M2M;
+        job.fg_address = src + offset;
+        job.fg_offset = lcd_x_size - w;
+        job.fg_pfc = pixel_format->dma2d;
+        job.out_address = dst + offset;
+        job.out_offset = lcd_x_size - w;
+        job.out_pfc = pixel_format->out;
+        job.width = w;
+        job.height = h;
+
+        CleanInvalidateDCacheRegion(job.fg_address, size);
+        CleanInvalidateDCacheRegion(job.out_address, size);
+        DMA2D_Submit(&job);
+    }
+    DMA2D_Wait();
+}
+
+/* Record an area drawn since the last flip, clipped to the screen */
+void InvalidateArea(int32_t x, int32_t y, int32_t xSize, int32_t ySize)
+{
+    PrepareDrawBuffer();
+
+    dirty_rect_t r = {
+        .x0 = MAX(x, 0),
+        .y0 = MAX(y, 0),
+        .x1 = MIN(x + xSize, (int32_t)lcd_x_size),
+        .y1 = MIN(y + ySize, (int32_t)lcd_y_size),
+    };
+
+    if (r.x0 >= r.x1 || r.y0 >= r.y1)
+    {
+        return;
+    }
+
+    for (uint32_t i = 0; i < dirty_count; i++)
+    {
+        dirty_rect_t *d = &dirty_rects[i];
+        if (r.x0 >= d->x0 && r.y0 >= d->y0 && r.x1 <= d->x1 && r.y1 <= d->y1)
+        {
+            /* already covered */
+            return;
+        }
+        if (d->x0 >= r.x0 && d->y0 >= r.y0 && d->x1 <= r.x1 && d->y1 <= r.y1)
+        {
+            /* swallows an existing one, take its slot */
+            *d = r;
+            return;
+        }
+    }
+
+    if (dirty_count == DIRTY_RECTS_MAX)
+    {
+        for (uint32_t i = 1; i < dirty_count; i++)
+        {
+            dirty_rects[0].x0 = MIN(dirty_rects[0].x0, dirty_rects[i].x0);
+            dirty_rects[0].y0 = MIN(dirty_rects[0].y0, dirty_rects[i].y0);
+            dirty_rects[0].x1 = MAX(dirty_rects[0].x1, dirty_rects[i].x1);
+            dirty_rects[0].y1 = MAX(dirty_rects[0].y1, dirty_rects[i].y1);
+        }
+        dirty_rects[0].x0 = MIN(dirty_rects[0].x0, r.x0);
+        dirty_rects[0].y0 = MIN(dirty_rects[0].y0, r.y0);
+        dirty_rects[0].x1 = MAX(dirty_rects[0].x1, r.x1);
+        dirty_rects[0].y1 = MAX(dirty_rects[0].y1, r.y1);
+        dirty_count = 1;
+        return;
+    }
+
+    dirty_rects[dirty_count++] = r;
+}
+
+void SetCopyForward(bool enable)
+{
+    /* nothing to copy to with a single buffer */
+    copy_forward = enable && !single_buffer;
+}
+
+/*
+ * Scan out and draw into one framebuffer, before the bring-up. Tearing is
+ * up to the application, drawing behind the beam with GetScanline() or
+ * from a line event.
+ */
+void SetSingleBuffer(bool enable)
+{
+    single_buffer = enable;
+}
+
+/*
+ * Row of the layer the LTDC is scanning out: negative above the window
+ * and in the blanking before it, lcd_y_size or more below it.
+ */
+int32_t GetScanline(void)
+{
+    return (int32_t)(LTDC->CPSR & LTDC_CPSR_CYPOS) - (int32_t)(ltdc.Init.AccumulatedVBP + 1 + layer_y0);
+}
+
+/*
+ * Call handler from the LTDC interrupt when the scanout reaches row of
+ * the layer, once per refresh, NULL to stop. The line interrupt takes
+ * turns between that row and line 0, where refreshes are counted.
+ */
+void SetLineEvent(int32_t row, void (*handler)(uint32_t refresh))
+{
+    mp_uint_t state = MICROPY_BEGIN_ATOMIC_SECTION();
+    line_event_row = row;
+    line_event_handler = handler;
+    if (handler == NULL && line_event_user)
+    {
+        /* back to refresh counting without waiting for the old row */
+        ltdc.Instance->LIPCR = 0;
+        line_event_user = false;
+    }
+    MICROPY_END_ATOMIC_SECTION(state);
+}
 
-    /*************************End DSI Initialization*******************************/
+/*
+ * Checksum of rows evenly spread over a frame, catching raw CPU writes the
+ * dirty list does not see. Uses the CRC unit when the part has one.
+ */
+static uint32_t SampleFrameCRC(uint32_t address)
+{
+    uint32_t rows = MIN(crc_rows, lcd_y_size);
+    uint32_t row_bytes = lcd_x_size * pixel_format->bpp;
+    uint32_t words = row_bytes / sizeof(uint32_t);
+
+#if defined(CRC)
+    CRC->CR = CRC_CR_RESET;
+#else
+    /* FNV-1a over words */
+    uint32_t hash = 2166136261u;
+#endif
+    for (uint32_t i = 0; i < rows; i++)
+    {
+        uint32_t row_address = address + ((i * lcd_y_size) / rows) * row_bytes;
+        /* the DMA2D may have written the row behind stale cache lines */
+        CleanInvalidateDCacheRegion(row_address, row_bytes);
+        const uint32_t *row = (const uint32_t *)row_address;
+        const uint8_t *tail = (const uint8_t *)(row + words);
+        for (uint32_t j = 0; j < words; j++)
+        {
+#if defined(CRC)
+            CRC->DR = row[j];
+#else
+            hash = (hash ^ row[j]) * 16777619u;
+#endif
+        }
+        for (uint32_t j = 0; j < row_bytes % sizeof(uint32_t); j++)
+        {
+#if defined(CRC)
+            *(volatile uint8_t *)&CRC->DR = tail[j];
+#else
+            hash = (hash ^ tail[j]) * 16777619u;
+#endif
+        }
+    }
+#if defined(CRC)
+    return CRC->DR;
+#else
+    return hash;
+#endif
+}
 
-    /************************LTDC Initialization***********************************/
+/*
+ * Let drawCurrentFrameBuffer() skip presenting a frame identical to the one
+ * on screen. Without copy-forward the back buffer only matches the front
+ * one by content, so that needs rows > 0 to sample.
+ */
+void SetSkipUnchanged(bool enable, uint32_t rows)
+{
+    skip_unchanged = enable;
+    crc_rows = rows;
+    skipped_frames = 0;
+#if defined(CRC)
+    if (rows > 0)
+    {
+        __HAL_RCC_CRC_CLK_ENABLE();
+    }
+#endif
+    front_crc = rows > 0 ? SampleFrameCRC(getActiveFrameBuffer()) : 0;
+}
 
-    /* LCD clock configuration */
-    /* LCD clock configuration */
-    /* PLL3_VCO Input = HSE_VALUE/PLL3M = 1 Mhz */
-    /* PLL3_VCO Output = PLL3_VCO Input * PLL3N */
-    /* PLLLCDCLK = PLL3_VCO Output/PLL3R */
-    /* LTDC clock frequency = PLLLCDCLK */
-    PeriphClkInitStruct.PeriphClockSelection = RCC_PERIPHCLK_LTDC;
-    PeriphClkInitStruct.PLL3.PLL3M = LTDC_PLL3M;
-    PeriphClkInitStruct.PLL3.PLL3N = LTDC_PLL3N;
-    PeriphClkInitStruct.PLL3.PLL3P = LTDC_PLL3P;
-    PeriphClkInitStruct.PLL3.PLL3Q = LTDC_PLL3Q;
-    PeriphClkInitStruct.PLL3.PLL3R = LTDC_PLL3R;
-    HAL_RCCEx_PeriphCLKConfig(&PeriphClkInitStruct);
+uint32_t getSkippedFrames()
+{
+    return skipped_frames;
+}
 
-    /* Base address of LTDC registers to be set before calling De-Init */
-    ltdc.Instance = LTDC;
+void GetFrameStats(frame_stats_t *out)
+{
+    mp_uint_t state = MICROPY_BEGIN_ATOMIC_SECTION();
+    *out = frame_stats;
+    MICROPY_END_ATOMIC_SECTION(state);
+}
 
-    HAL_LTDC_DeInit(&(ltdc));
+/* Clear the frame counts and the histogram, the refresh count goes on */
+void ResetFrameStats(void)
+{
+    mp_uint_t state = MICROPY_BEGIN_ATOMIC_SECTION();
+    frame_stats.presented = 0;
+    frame_stats.missed = 0;
+    frame_stats.max_latency_us = 0;
+    memset(frame_stats.latency, 0, sizeof(frame_stats.latency));
+    MICROPY_END_ATOMIC_SECTION(state);
+}
 
-    /* Timing Configuration */
-    ltdc.Init.HorizontalSync = (dt->hsync_len - 1);
-    ltdc.Init.AccumulatedHBP = (dt->hsync_len + dt->hback_porch - 1);
-    ltdc.Init.AccumulatedActiveW = (dt->hactive + dt->hsync_len + dt->hback_porch - 1);
-    ltdc.Init.TotalWidth = (dt->hactive + dt->hsync_len + dt->hback_porch + dt->hfront_porch - 1);
-    ltdc.Init.VerticalSync = (dt->vsync_len - 1);
-    ltdc.Init.AccumulatedVBP = (dt->vsync_len + dt->vback_porch - 1);
-    ltdc.Init.AccumulatedActiveH = (dt->vactive + dt->vsync_len + dt->vback_porch - 1);
-    ltdc.Init.TotalHeigh = (dt->vactive + dt->vsync_len + dt->vback_porch + dt->vfront_porch - 1);
+void GetLinkHealth(link_health_t *out)
+{
+    mp_uint_t state = MICROPY_BEGIN_ATOMIC_SECTION();
+    *out = link_health;
+    MICROPY_END_ATOMIC_SECTION(state);
+}
 
-    /* background value */
-    ltdc.Init.Backcolor.Blue = 0x00;
-    ltdc.Init.Backcolor.Green = 0x00;
-    ltdc.Init.Backcolor.Red = 0x00;
+/* Clear the error counts, the dead time in force stays */
+void ResetLinkHealth(void)
+{
+    mp_uint_t state = MICROPY_BEGIN_ATOMIC_SECTION();
+    link_health.ltdc_underruns = 0;
+    link_health.ltdc_errors = 0;
+    link_health.dsi_errors = 0;
+    link_health.dsi_error_flags = 0;
+    link_health.mipi_alerts = 0;
+    MICROPY_END_ATOMIC_SECTION(state);
+}
 
-    ltdc.LayerCfg->ImageWidth = lcd_x_size;
-    ltdc.LayerCfg->ImageHeight = lcd_y_size;
+void CountMipiAlert(void)
+{
+    mp_uint_t state = MICROPY_BEGIN_ATOMIC_SECTION();
+    link_health.mipi_alerts++;
+    MICROPY_END_ATOMIC_SECTION(state);
+}
 
-    /* Polarity */
-    ltdc.Init.HSPolarity = dt->hpol ? LTDC_HSPOLARITY_AH : LTDC_HSPOLARITY_AL;
-    ltdc.Init.VSPolarity = dt->vpol ? LTDC_VSPOLARITY_AH : LTDC_VSPOLARITY_AL;
-    ltdc.Init.DEPolarity = LTDC_DEPOLARITY_AL;
-    ltdc.Init.PCPolarity = LTDC_PCPOLARITY_IPC;
+static void SetDMA2DDeadTime(uint32_t cycles)
+{
+    link_health.dead_time = cycles;
+    DMA2D->AMTCR = cycles > 0 ? (cycles << DMA2D_AMTCR_DT_Pos) | DMA2D_AMTCR_EN : 0;
+}
 
-    /* Initialize & Start the LTDC */
-    HAL_LTDC_Init(&ltdc);
+/* Slow the DMA2D down while the LTDC underruns, see THROTTLE_DEAD_TIME_MIN */
+void SetUnderrunThrottle(bool enable)
+{
+    mp_uint_t state = MICROPY_BEGIN_ATOMIC_SECTION();
+    underrun_throttle = enable;
+    underrun_clean = 0;
+    if (!enable && framebuffer_address_0 != (uint32_t)-1)
+    {
+        SetDMA2DDeadTime(throttle_dead_time);
+    }
+    MICROPY_END_ATOMIC_SECTION(state);
+}
 
-    /* Enable the DSI host and wrapper : but LTDC is not started yet at this stage */
-    HAL_DSI_Start(&dsi);
+static uint32_t ScanoutLoad(void)
+{
+    bandwidth_t bw;
+    if (EstimateBandwidth(pixel_format->dma2d, &bw) < 0)
+    {
+        return 0;
+    }
+    return (uint64_t)bw.scanout * 1000 / SDRAM_BANDWIDTH;
+}
 
-    HAL_DSI_Refresh(&dsi);
+/* Dead time and bands for the running mode, by default from its scanout load */
+static void ApplyDMA2DThrottle(void)
+{
+    uint32_t load = ScanoutLoad();
 
-    LayerInit(0, fb_address);
-    LayerInit(1, fb_address + (lcd_x_size * lcd_y_size * BYTES_PER_PIXEL));
+    if (throttle_dead_time_cfg >= 0)
+    {
+        throttle_dead_time = throttle_dead_time_cfg;
+    }
+    else if (load < DMA2D_THROTTLE_LOAD)
+    {
+        throttle_dead_time = 0;
+    }
+    else
+    {
+        throttle_dead_time = MIN((load - DMA2D_THROTTLE_LOAD) * 255 / (1000 - DMA2D_THROTTLE_LOAD), 255);
+    }
 
-    HAL_DSI_PatternGeneratorStop(&dsi);
+    if (throttle_bands_cfg >= 0)
+    {
+        band_lines = throttle_bands_cfg;
+    }
+    else
+    {
+        band_lines = (load < DMA2D_BANDS_LOAD) ? 0 : DMA2D_BAND_LINES;
+    }
 
-    Clear(0);
-    drawCurrentFrameBuffer();
-    Clear(0);
-    drawCurrentFrameBuffer();
+    DMA2D_Wait();
+    mp_uint_t state = MICROPY_BEGIN_ATOMIC_SECTION();
+    SetDMA2DDeadTime(throttle_dead_time);
+    underrun_clean = 0;
+    MICROPY_END_ATOMIC_SECTION(state);
+    ANXINFO("scanout load %u/1000, DMA2D dead time %u, bands of %u lines.\n",
+            (unsigned int)load, (unsigned int)throttle_dead_time, (unsigned int)band_lines);
+}
 
-    return 0;
+/*
+ * DMA2D dead time in AHB cycles and rows per band of the jobs writing
+ * into a framebuffer, -1 for each to follow the scanout load of the mode
+ * or DMA2D_THROTTLE_KEEP.
+ */
+void SetDMA2DThrottle(int32_t dead_time, int32_t lines)
+{
+    if (dead_time != DMA2D_THROTTLE_KEEP)
+    {
+        throttle_dead_time_cfg = dead_time;
+    }
+    if (lines != DMA2D_THROTTLE_KEEP)
+    {
+        /* even, so a band of 4-bit pixels ends on a byte */
+        throttle_bands_cfg = (lines > 0) ? (lines + 1) & ~1 : lines;
+    }
+    if (framebuffer_address_0 != (uint32_t)-1)
+    {
+        ApplyDMA2DThrottle();
+    }
 }
 
-static void LL_FillBuffer(uint32_t LayerIndex, void *pDst, uint32_t xSize, uint32_t ySize, uint32_t OffLine, uint32_t ColorIndex)
+void GetDMA2DThrottle(dma2d_throttle_t *out)
 {
-    /* Register to memory mode with ARGB8888 as color Mode */
-    dma2d.Init.Mode = DMA2D_R2M;
-    dma2d.Init.ColorMode = DMA2D_OUTPUT_RGB565; // DMA2D_OUTPUT_ARGB8888
-    dma2d.Init.OutputOffset = OffLine;
+    out->dead_time = throttle_dead_time;
+    out->band_lines = band_lines;
+    out->load = ScanoutLoad();
+    out->adaptive = underrun_throttle;
+}
 
-    dma2d.Instance = DMA2D;
+/*
+ * Once per refresh: the error interrupts their callback turned off come
+ * back, and the throttle follows the underruns of the last refresh.
+ */
+static void LinkHealthRefresh(void)
+{
+    __HAL_LTDC_ENABLE_IT(&ltdc, LTDC_IT_FU | LTDC_IT_TE);
+    HAL_NVIC_EnableIRQ(DSI_IRQn);
 
-    /* DMA2D Initialization */
-    if (HAL_DMA2D_Init(&dma2d) == HAL_OK)
+    if (underrun_throttle)
     {
-        if (HAL_DMA2D_ConfigLayer(&dma2d, 1) == HAL_OK)
+        if (underrun_seen)
         {
-            if (HAL_DMA2D_Start(&dma2d, ColorIndex, (uint32_t)pDst, xSize, ySize) == HAL_OK)
-            {
-                /* Polling For DMA transfer */
-                HAL_DMA2D_PollForTransfer(&dma2d, 25);
-            }
+            uint32_t cycles = MAX(link_health.dead_time * 2, MAX(throttle_dead_time, THROTTLE_DEAD_TIME_MIN));
+            SetDMA2DDeadTime(MIN(cycles, THROTTLE_DEAD_TIME_MAX));
+            underrun_clean = 0;
+        }
+        else if (link_health.dead_time > throttle_dead_time && ++underrun_clean >= THROTTLE_RELAX_REFRESHES)
+        {
+            uint32_t cycles = link_health.dead_time / 2;
+            SetDMA2DDeadTime(cycles >= MAX(throttle_dead_time, THROTTLE_DEAD_TIME_MIN) ? cycles : throttle_dead_time);
+            underrun_clean = 0;
         }
     }
+    underrun_seen = false;
 }
 
-DMA2D_HandleTypeDef *get_DMA2D(void)
+/*
+ * Tag the next presented frame. Its marker is completed with the time
+ * from now until that frame starts scanning out. A mark made while one
+ * waits for a flush is dropped, the earlier one being the longer latency.
+ */
+void MarkFrame(uint32_t id)
 {
-    return &dma2d;
+    if (!mark_pending)
+    {
+        mark_id = id;
+        mark_us = mp_hal_ticks_us();
+        mark_pending = true;
+    }
 }
 
-void drawCurrentFrameBuffer(void)
+/* Move up to max completed markers to out, oldest first */
+uint32_t TakeFrameMarkers(frame_marker_t *out, uint32_t max)
 {
-    int fb = pend_buffer++ % 2;
+    mp_uint_t state = MICROPY_BEGIN_ATOMIC_SECTION();
+    uint32_t count = MIN(frame_marker_count, max);
+    memcpy(out, frame_markers, count * sizeof(frame_marker_t));
+    memmove(frame_markers, frame_markers + count, (frame_marker_count - count) * sizeof(frame_marker_t));
+    frame_marker_count -= count;
+    MICROPY_END_ATOMIC_SECTION(state);
+    return count;
+}
 
-    /* Enable current LTDC layer */
-    __HAL_LTDC_LAYER_ENABLE(&(ltdc), fb);
-    /* Disable active LTDC layer */
-    __HAL_LTDC_LAYER_DISABLE(&(ltdc), !fb);
+/* Nothing to draw into or flip until the bring-up has started the LTDC */
+/* Drawing and palette calls raise until the framebuffers are set up */
+void CheckDisplayStarted(void)
+{
+    if (framebuffer_address_0 == (uint32_t)-1)
+    {
+        mp_raise_msg(&mp_type_RuntimeError, MP_ERROR_TEXT("display not ready"));
+    }
+}
 
+static void ReloadAtVBlank(void)
+{
     /* LTDC reload request within next vertical blanking */
     reloadLTDC_status = 0;
+    stats_start(STATS_FLIP);
     HAL_LTDC_Reload(&ltdc, LTDC_SRCR_VBR);
 
     while (reloadLTDC_status == 0)
@@ -1542,6 +3355,70 @@ void drawCurrentFrameBuffer(void)
     }
 }
 
+void drawCurrentFrameBuffer(void)
+{
+    uint32_t request_us = mp_hal_ticks_us();
+    uint32_t request_refresh = frame_stats.refreshes;
+
+    CheckDisplayStarted();
+
+    /* drawing submitted without waiting must land before the flip */
+    DMA2D_Wait();
+
+    if (single_buffer && !blanked)
+    {
+        /* what was drawn is already on screen, there is nothing to flip */
+        dirty_count = 0;
+        return;
+    }
+
+    if (skip_unchanged)
+    {
+        uint32_t crc = crc_rows > 0 ? SampleFrameCRC(getCurrentFrameBuffer()) : 0;
+        bool changed = dirty_count > 0 || (crc_rows > 0 ? crc != front_crc : !copy_forward);
+        if (!changed)
+        {
+            skipped_frames++;
+            return;
+        }
+        front_crc = crc;
+    }
+
+    if (blanked)
+    {
+        if (blank_fill_pending)
+        {
+            /* nothing drawn since the blank, the background stays up */
+            return;
+        }
+        blanked = false;
+        ltdc.Instance->BCCR = background_rgb;
+    }
+
+    int fb = pend_buffer++ % 2;
+
+    /* Enable current LTDC layer */
+    __HAL_LTDC_LAYER_ENABLE(&(ltdc), fb);
+    /* Disable active LTDC layer */
+    __HAL_LTDC_LAYER_DISABLE(&(ltdc), !fb);
+
+    frame_pending.request_us = request_us;
+    frame_pending.request_refresh = request_refresh;
+    frame_pending.marked = mark_pending;
+    frame_pending.marker_id = mark_id;
+    frame_pending.mark_us = mark_us;
+    frame_pending.valid = true;
+    mark_pending = false;
+
+    ReloadAtVBlank();
+
+    if (copy_forward)
+    {
+        CopyForward();
+    }
+    dirty_count = 0;
+}
+
 uint32_t getCurrentFrameBuffer()
 {
     return (ltdc.LayerCfg[pend_buffer % 2].FBStartAdress);
@@ -1552,6 +3429,15 @@ uint32_t getActiveFrameBuffer()
     return (ltdc.LayerCfg[(pend_buffer + 1) % 2].FBStartAdress);
 }
 
+/*
+ * Buffer the drawing APIs render into: the back buffer when copy-forward
+ * keeps it complete, otherwise the visible one as before.
+ */
+uint32_t getDrawFrameBuffer()
+{
+    return copy_forward ? getCurrentFrameBuffer() : getActiveFrameBuffer();
+}
+
 uint32_t getXSize()
 {
     return lcd_x_size;
@@ -1564,10 +3450,66 @@ uint32_t getYSize()
 
 void Clear(uint32_t Color)
 {
+    /* a real fill supersedes a deferred one */
+    blank_fill_pending = false;
+
     /* Clear the LCD */
+    InvalidateArea(0, 0, lcd_x_size, lcd_y_size);
     LL_FillBuffer(pend_buffer % 2, (uint32_t *)(ltdc.LayerCfg[pend_buffer % 2].FBStartAdress), lcd_x_size, lcd_y_size, 0, Color);
 }
 
+/*
+ * Solid-colour clear without touching memory: both layers are switched off
+ * at the next vertical blanking and the LTDC background takes the colour.
+ * The fill itself is deferred to the first draw, and the next flush after
+ * that brings the layer back.
+ */
+void BlankScreen(uint32_t Color)
+{
+    DMA2D_Wait();
+
+    uint32_t rgb = Color & 0x00FFFFFF;
+    if (pixel_format->dma2d == DMA2D_INPUT_L8)
+    {
+        rgb = clut[Color & (CLUT_SIZE - 1)];
+    }
+
+    blank_color = Color;
+    blank_fill_pending = true;
+    blanked = true;
+    dirty_count = 0;
+
+    ltdc.Instance->BCCR = rgb;
+    __HAL_LTDC_LAYER_DISABLE(&(ltdc), 0);
+    __HAL_LTDC_LAYER_DISABLE(&(ltdc), 1);
+    ReloadAtVBlank();
+}
+
+/* Run the fill deferred by BlankScreen() before anything draws */
+void PrepareDrawBuffer(void)
+{
+    CheckDisplayStarted();
+    if (!blank_fill_pending)
+    {
+        return;
+    }
+    blank_fill_pending = false;
+
+    uint32_t current = getCurrentFrameBuffer();
+    InvalidateArea(0, 0, lcd_x_size, lcd_y_size);
+    LL_FillBuffer(pend_buffer % 2, (void *)current, lcd_x_size, lcd_y_size, 0, blank_color);
+    if (getDrawFrameBuffer() != current)
+    {
+        /* without copy-forward drawing lands in the other buffer */
+        LL_FillBuffer(pend_buffer % 2, (void *)getDrawFrameBuffer(), lcd_x_size, lcd_y_size, 0, blank_color);
+    }
+}
+
+bool IsBlanked(void)
+{
+    return blanked;
+}
+
 void FillArea(void *pDst, uint32_t xSize, uint32_t ySize, uint32_t ColorMode)
 {
     LL_FillBuffer(pend_buffer % 2, pDst, xSize, ySize, lcd_x_size - xSize, ColorMode);
@@ -1579,9 +3521,13 @@ void DrawImage(void *pSrc, void *pDst, uint32_t xSize, uint32_t ySize, uint32_t
     SCB_CleanInvalidateDCache();
     SCB_InvalidateICache();
 #endif
+    DMA2D_Wait();
+    EnsureMapped((uint32_t)pSrc);
+
     /* Configure the DMA2D Mode, Color Mode and output offset */
-    dma2d.Init.Mode = DMA2D_M2M_PFC;
-    dma2d.Init.ColorMode = DMA2D_OUTPUT_RGB565;
+    /* sources in the framebuffer format are copied as they are */
+    dma2d.Init.Mode = (ColorMode == pixel_format->dma2d) ? DMA2D_M2M : DMA2D_M2M_PFC;
+    dma2d.Init.ColorMode = pixel_format->out;
     dma2d.Init.OutputOffset = lcd_x_size - xSize;
 
     if (pDst == NULL)
@@ -1590,8 +3536,9 @@ void DrawImage(void *pSrc, void *pDst, uint32_t xSize, uint32_t ySize, uint32_t
     }
 
     /* Foreground Configuration */
-    dma2d.LayerCfg[1].AlphaMode = DMA2D_REPLACE_ALPHA;
-    dma2d.LayerCfg[1].InputAlpha = 0x00;
+    /* keep the source alpha so ARGB framebuffers stay opaque */
+    dma2d.LayerCfg[1].AlphaMode = DMA2D_NO_MODIF_ALPHA;
+    dma2d.LayerCfg[1].InputAlpha = 0xFF;
     dma2d.LayerCfg[1].InputColorMode = ColorMode;
     dma2d.LayerCfg[1].InputOffset = 0;
 
@@ -1605,7 +3552,9 @@ void DrawImage(void *pSrc, void *pDst, uint32_t xSize, uint32_t ySize, uint32_t
             if (HAL_DMA2D_Start(&dma2d, (uint32_t)pSrc, (uint32_t)pDst, xSize, ySize) == HAL_OK)
             {
                 /* Polling For DMA transfer */
+                stats_start(STATS_DMA2D);
                 HAL_DMA2D_PollForTransfer(&dma2d, 25);
+                stats_stop(STATS_DMA2D);
             }
         }
     }
@@ -1620,5 +3569,103 @@ void LTDC_IRQHandler(void)
 /* Reload LTDC event callback */
 void HAL_LTDC_ReloadEventCallback(LTDC_HandleTypeDef *hltdc)
 {
+    stats_stop(STATS_FLIP);
+
+    if (frame_pending.valid)
+    {
+        /* the new layers show from the refresh starting next */
+        frame_inflight = frame_pending;
+        frame_inflight.show_refresh = frame_stats.refreshes + 1;
+        frame_pending.valid = false;
+
+        frame_stats.presented++;
+        if ((int32_t)(frame_inflight.show_refresh - frame_inflight.request_refresh) > 1)
+        {
+            frame_stats.missed++;
+        }
+    }
     reloadLTDC_status = 1;
-}
\ No newline at end of file
+}
+
+/* Line event callback, at the start of every refresh */
+void HAL_LTDC_LineEventCallback(LTDC_HandleTypeDef *hltdc)
+{
+    uint32_t now = mp_hal_ticks_us();
+
+    /* the HAL handler turns the line interrupt off each time */
+    __HAL_LTDC_ENABLE_IT(hltdc, LTDC_IT_LI);
+
+    if (line_event_user)
+    {
+        hltdc->Instance->LIPCR = 0;
+        line_event_user = false;
+        if (line_event_handler != NULL)
+        {
+            line_event_handler(frame_stats.refreshes);
+        }
+        return;
+    }
+    uint32_t line = hltdc->Init.AccumulatedVBP + 1 + layer_y0 + line_event_row;
+    if (line_event_handler != NULL && line <= hltdc->Init.TotalHeigh)
+    {
+        /* a row never reached would starve line 0 and the counting */
+        hltdc->Instance->LIPCR = line;
+        line_event_user = true;
+    }
+
+    LinkHealthRefresh();
+
+    if (frame_stats.refreshes > 0)
+    {
+        frame_stats.period_us = now - frame_stats.refresh_us;
+    }
+    frame_stats.refresh_us = now;
+    frame_stats.refreshes++;
+
+    if (frame_inflight.valid && frame_inflight.show_refresh == frame_stats.refreshes)
+    {
+        uint32_t latency = now - frame_inflight.request_us;
+        frame_stats.latency[MIN(latency / FRAME_LATENCY_BUCKET_US, FRAME_LATENCY_BUCKETS - 1)]++;
+        frame_stats.max_latency_us = MAX(frame_stats.max_latency_us, latency);
+
+        if (frame_inflight.marked && frame_marker_count < FRAME_MARKERS_MAX)
+        {
+            frame_marker_t *m = &frame_markers[frame_marker_count++];
+            m->id = frame_inflight.marker_id;
+            m->latency_us = now - frame_inflight.mark_us;
+            m->refresh = frame_stats.refreshes;
+        }
+        frame_inflight.valid = false;
+    }
+}
+
+/* LTDC error callback, the HAL turned the interrupt of the error off */
+void HAL_LTDC_ErrorCallback(LTDC_HandleTypeDef *hltdc)
+{
+    if (hltdc->ErrorCode & HAL_LTDC_ERROR_FU)
+    {
+        link_health.ltdc_underruns++;
+        underrun_seen = true;
+    }
+    if (hltdc->ErrorCode & HAL_LTDC_ERROR_TE)
+    {
+        link_health.ltdc_errors++;
+    }
+    hltdc->ErrorCode = HAL_LTDC_ERROR_NONE;
+    hltdc->State = HAL_LTDC_STATE_READY;
+}
+
+/* Handler for DSI global interrupt request */
+void DSI_IRQHandler(void)
+{
+    HAL_DSI_IRQHandler(&dsi);
+}
+
+/* DSI error callback, off until the next refresh so a repeating error cannot take the CPU */
+void HAL_DSI_ErrorCallback(DSI_HandleTypeDef *hdsi)
+{
+    link_health.dsi_errors++;
+    link_health.dsi_error_flags |= hdsi->ErrorCode;
+    hdsi->ErrorCode = HAL_DSI_ERROR_NONE;
+    HAL_NVIC_DisableIRQ(DSI_IRQn);
+}
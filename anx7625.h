@@ -22,6 +22,9 @@
 
 /* Loading OCM re-trying times */
 #define OCM_LOADING_TIME 10
+#define OCM_POWER_ON_RETRIES 2
+/* 10 ms apart */
+#define HPD_POLL_COUNT 10000
 
 /*********  ANX7625 Register  **********/
 #define ANXI2CSIM
@@ -366,14 +369,216 @@ struct display_timing
     unsigned int vpol : 1;
 };
 
+/* Register image of a single DMA2D transfer, see DMA2D_Submit() */
+typedef struct _dma2d_job_t
+{
+    uint32_t mode;
+    uint32_t fg_address;
+    uint32_t fg_offset;
+    uint32_t fg_pfc;
+    uint32_t fg_color;
+    uint32_t fg_clut; /* ARGB8888 palette of an L8 source, 0 for none */
+    uint32_t fg_clut_size;
+    uint32_t bg_address;
+    uint32_t bg_offset;
+    uint32_t bg_pfc;
+    uint32_t out_address;
+    uint32_t out_offset;
+    uint32_t out_pfc;
+    uint32_t out_color;
+    uint32_t width;
+    uint32_t height;
+} dma2d_job_t;
+
+/* Bring-up of the bridge, one anx7625_bringup_step() at a time */
+typedef enum _anx7625_state_t
+{
+    ANX7625_STATE_IDLE,
+    ANX7625_STATE_PROBE,    /* looking for a bridge still running */
+    ANX7625_STATE_VBUS_OFF, /* VBUS switched off, discharging */
+    ANX7625_STATE_POWER_ON, /* bridge supply on */
+    ANX7625_STATE_RESET,    /* reset released */
+    ANX7625_STATE_FIRMWARE, /* polling for the OCM firmware */
+    ANX7625_STATE_STABLE,   /* firmware up, settling */
+    ANX7625_STATE_VBUS_ON,  /* supplying VBUS to the sink */
+    ANX7625_STATE_HPD,      /* waiting for hot plug */
+    ANX7625_STATE_START,    /* EDID, bridge DSI set-up, DSI start */
+    ANX7625_STATE_READY,
+    ANX7625_STATE_FAILED,
+} anx7625_state_t;
+
+typedef struct _anx7625_bringup_t
+{
+    anx7625_state_t state;
+    uint32_t polls;
+    uint32_t retries;
+    enum edid_modes mode;
+    uint32_t fb_address;
+    uint32_t fb_size; /* bytes of the buffer the framebuffers are carved from */
+    struct edid edid;
+    uint8_t version;
+    uint8_t revision;
+    /* timing report, in ms */
+    uint32_t start_tick;
+    uint32_t step_tick;
+    anx7625_state_t step_state;
+    uint32_t phase_ms[ANX7625_STATE_READY]; /* per step, its wait included */
+    uint32_t local_ms;                      /* STM32 display set-up */
+    uint32_t hidden_ms;                     /* of it, inside bridge waits */
+    uint32_t total_ms;
+    uint8_t stats_phase; /* profiler phase under way, see stats.h */
+} anx7625_bringup_t;
+
+/* Hot-plug service state, polled once the display runs */
+typedef struct _anx7625_hotplug_t
+{
+    bool connected;
+    bool edid_read; /* the EDID was read again at the last connection */
+    bool resized;   /* and the framebuffers were laid out again for it */
+    uint32_t connects;
+    uint32_t disconnects;
+} anx7625_hotplug_t;
+
+/* One framebuffer pixel format and how each block of the pipeline handles it */
+typedef struct _pixel_format_t
+{
+    uint32_t dma2d; /* DMA2D input colour mode, the module constant */
+    uint32_t ltdc;  /* LTDC layer pixel format */
+    uint32_t out;   /* DMA2D output colour mode */
+    uint8_t bpp;    /* bytes per pixel */
+    uint8_t depth;  /* colour bits per pixel reaching the display */
+} pixel_format_t;
+
+/* Framebuffer cost of a pixel format at the current display timing */
+typedef struct _bandwidth_t
+{
+    uint32_t frame_bytes;  /* one framebuffer */
+    uint32_t scanout;      /* bytes per second read by the LTDC */
+    uint32_t dsi_coding;   /* DSI_RGB888 or DSI_RGB565 */
+    uint32_t dsi_rate;     /* kbit/s of pixel data on the DSI link */
+    uint32_t dsi_capacity; /* kbit/s the DSI lanes carry */
+} bandwidth_t;
+
+/* Flush to scanout latency histogram, the last bucket takes the rest */
+#define FRAME_LATENCY_BUCKETS 16
+#define FRAME_LATENCY_BUCKET_US 2000
+#define FRAME_MARKERS_MAX 8
+
+/* Refreshes counted on the LTDC line interrupt at the start of each one */
+typedef struct _frame_stats_t
+{
+    uint32_t refreshes;
+    uint32_t refresh_us;  /* time of the last one */
+    uint32_t period_us;   /* between the last two */
+    uint32_t presented;   /* flips latched */
+    uint32_t missed;      /* of them, shown later than the refresh after the flush */
+    uint32_t max_latency_us;
+    uint32_t latency[FRAME_LATENCY_BUCKETS];
+} frame_stats_t;
+
+/* A marker set before a flush, completed when that frame is scanned out */
+typedef struct _frame_marker_t
+{
+    uint32_t id;
+    uint32_t latency_us; /* mark to scanout */
+    uint32_t refresh;
+} frame_marker_t;
+
+/*
+ * DMA2D dead time between its AHB accesses while underruns go on, in AHB
+ * cycles. It doubles at every refresh with an underrun and halves after
+ * a run of clean ones.
+ */
+#define THROTTLE_DEAD_TIME_MIN 16
+#define THROTTLE_DEAD_TIME_MAX 255
+#define THROTTLE_RELAX_REFRESHES 120
+
+/* SetDMA2DThrottle() value leaving a setting as it is */
+#define DMA2D_THROTTLE_KEEP (-2)
+
+/* DMA2D pacing in force, see SetDMA2DThrottle() */
+typedef struct _dma2d_throttle_t
+{
+    uint32_t dead_time;  /* AHB cycles between accesses, the adaptive floor */
+    uint32_t band_lines; /* rows per band of a framebuffer job, 0 for none */
+    uint32_t load;       /* scanout share of the SDRAM bandwidth, per mille */
+    bool adaptive;
+} dma2d_throttle_t;
+
+/* Link error counts, the interrupt ones at most once per refresh */
+typedef struct _link_health_t
+{
+    uint32_t ltdc_underruns;
+    uint32_t ltdc_errors;     /* LTDC AHB transfer errors */
+    uint32_t dsi_errors;
+    uint32_t dsi_error_flags; /* HAL_DSI_ERROR_* seen */
+    uint32_t mipi_alerts;     /* bridge HS checksum errors, per poll */
+    uint32_t dead_time;       /* DMA2D dead time in force */
+} link_health_t;
+
+/* QSPI flash window when the flash is in memory-mapped mode */
+#define QSPI_MAP_BASE (0x90000000)
+#if defined(MICROPY_HW_QSPIFLASH_SIZE_BITS_LOG2)
+#define QSPI_MAP_SIZE (1 << (MICROPY_HW_QSPIFLASH_SIZE_BITS_LOG2 - 3))
+#else
+#define QSPI_MAP_SIZE (0)
+#endif
+
+static inline uint32_t ConvertRGB565ToRGB888(uint16_t color)
+{
+    uint32_t r = (color >> 11) & 0x1F;
+    uint32_t g = (color >> 5) & 0x3F;
+    uint32_t b = color & 0x1F;
+    r = (r << 3) | (r >> 2);
+    g = (g << 2) | (g >> 4);
+    b = (b << 3) | (b >> 2);
+    return (r << 16) | (g << 8) | b;
+}
+
+/* Opaque framebuffer pixel of an RGB565 colour, for R2M fills */
+static inline uint32_t ConvertRGB565ToFormat(uint16_t color, const pixel_format_t *format)
+{
+    uint32_t rgb = ConvertRGB565ToRGB888(color);
+    switch (format->out)
+    {
+    case DMA2D_OUTPUT_ARGB8888:
+        return 0xFF000000 | rgb;
+    case DMA2D_OUTPUT_RGB888:
+        return rgb;
+    case DMA2D_OUTPUT_ARGB4444:
+        return 0xF000 | ((rgb >> 12) & 0xF00) | ((rgb >> 8) & 0xF0) | ((rgb >> 4) & 0xF);
+    default:
+        return color;
+    }
+}
+
 int anx7625_dp_start(uint8_t bus, const struct edid *edid, enum edid_modes mode, uint32_t fb_address);
 int anx7625_dp_get_edid(uint8_t bus, struct edid *out);
-int anx7625_init(uint8_t bus);
+void anx7625_bringup_init(anx7625_bringup_t *b, enum edid_modes mode, uint32_t fb_address, uint32_t fb_size);
+int anx7625_bringup_step(uint8_t bus, anx7625_bringup_t *b);
+int anx7625_bringup_run(uint8_t bus, anx7625_bringup_t *b);
+const char *anx7625_state_name(anx7625_state_t state);
+int anx7625_hotplug_poll(uint8_t bus, anx7625_hotplug_t *h, anx7625_bringup_t *b);
+void anx7625_get_timing(const struct edid *edid, enum edid_modes mode, struct display_timing *dt);
+void anx7625_mode_timing(enum edid_modes mode, struct display_timing *dt);
+int anx7625_set_mode(uint8_t bus, anx7625_bringup_t *b, enum edid_modes mode, struct display_timing *dt);
 int anx7625_read_system_status(uint8_t bus, uint8_t *sys_status);
+int anx7625_mipi_alert_poll(uint8_t bus);
 bool anx7625_is_power_provider(uint8_t bus);
-int anx7625_wait_hpd_event(uint8_t bus);
 int config(uint8_t bus, struct edid *edid, struct display_timing *dt, uint32_t fb_address);
+void PrepareDisplay(const struct display_timing *dt, uint32_t fb_address);
+void PrepareDsi(void);
+bool IsDisplayPrepared(void);
+void CheckDisplayStarted(void);
+const struct display_timing *getActiveTiming(void);
+uint32_t getFramebufferBytes(const struct display_timing *dt);
+uint32_t FramebufferBytesFor(const struct display_timing *dt, const pixel_format_t *format,
+                             uint32_t wx, uint32_t wy, uint32_t ww, uint32_t wh, bool single);
+int SetDisplayTiming(struct display_timing *dt);
 void Clear(uint32_t color);
+void BlankScreen(uint32_t color);
+void PrepareDrawBuffer(void);
+bool IsBlanked(void);
 void DrawImage(void *pSrc, void *pDst, uint32_t xSize, uint32_t ySize, uint32_t ColorMode);
 void FillArea(void *pDst, uint32_t xSize, uint32_t ySize, uint32_t ColorMode);
 uint32_t getNextFrameBuffer();
@@ -383,6 +588,58 @@ uint32_t getYSize();
 void drawCurrentFrameBuffer();
 uint32_t getCurrentFrameBuffer();
 uint32_t getActiveFrameBuffer();
+uint32_t getDrawFrameBuffer();
+void InvalidateArea(int32_t x, int32_t y, int32_t xSize, int32_t ySize);
+const pixel_format_t *FindPixelFormat(uint32_t format);
+int SetPixelFormat(uint32_t format);
+const pixel_format_t *getPixelFormat(void);
+void SetLayerWindow(uint32_t x, uint32_t y, uint32_t w, uint32_t h);
+uint32_t getWindowX();
+uint32_t getWindowY();
+void SetBackgroundColor(uint32_t rgb);
+uint32_t getBytesPerPixel();
+int EstimateBandwidth(uint32_t format, bandwidth_t *bw);
+int SetPalette(const uint32_t *colors, uint32_t count, bool vblank);
+void SetCopyForward(bool enable);
+void SetSkipUnchanged(bool enable, uint32_t rows);
+uint32_t getSkippedFrames();
+void GetFrameStats(frame_stats_t *out);
+void ResetFrameStats(void);
+void MarkFrame(uint32_t id);
+uint32_t TakeFrameMarkers(frame_marker_t *out, uint32_t max);
+void GetLinkHealth(link_health_t *out);
+void ResetLinkHealth(void);
+void CountMipiAlert(void);
+void SetUnderrunThrottle(bool enable);
+void SetDMA2DThrottle(int32_t dead_time, int32_t band_lines);
+void GetDMA2DThrottle(dma2d_throttle_t *out);
+void SetSingleBuffer(bool enable);
+int32_t GetScanline(void);
+void SetLineEvent(int32_t row, void (*handler)(uint32_t refresh));
+void DMA2D_Submit(const dma2d_job_t *job);
+int DMA2D_Wait(void);
+void CleanInvalidateDCacheRegion(uint32_t address, uint32_t size);
+int RegisterMappedRegion(uint32_t base, uint32_t size);
+bool IsMappedRegion(uint32_t address, uint32_t size);
+void EnsureMapped(uint32_t address);
+
+/* Drawing paths that blend on the DMA2D need a direct colour framebuffer */
+static inline void CheckDirectColorFramebuffer(void)
+{
+    if (getPixelFormat()->dma2d == DMA2D_INPUT_L8)
+    {
+        mp_raise_msg(&mp_type_RuntimeError, MP_ERROR_TEXT("not supported with an L8 framebuffer"));
+    }
+}
+
+/* Paths that write pixels with the CPU handle RGB565 only */
+static inline void CheckRGB565Framebuffer(void)
+{
+    if (getPixelFormat()->dma2d != DMA2D_INPUT_RGB565)
+    {
+        mp_raise_msg(&mp_type_RuntimeError, MP_ERROR_TEXT("only supported with an RGB565 framebuffer"));
+    }
+}
 
 typedef struct _mp_anx7625_t
 {
@@ -398,6 +655,26 @@ typedef struct _mp_anx7625_t
     int32_t width;
     int32_t height;
     int32_t background_color;
+    bool copy_forward;
+    bool skip_unchanged;
+    uint32_t crc_rows;
+    bool drawable;
+    anx7625_bringup_t bringup;
+    anx7625_hotplug_t hotplug;
 } mp_anx7625_t;
 
+typedef struct _mp_anx7625_blit_t
+{
+    mp_obj_base_t base;
+    mp_obj_t src_obj;
+    mp_obj_t clut_obj;
+    int32_t width;
+    int32_t height;
+    int32_t stride;
+    uint32_t format;
+    dma2d_job_t job;
+} mp_anx7625_blit_t;
+
+extern const mp_obj_type_t mp_anx7625_blit_type;
+
 #endif /* __ANX7625_H__ */
\ No newline at end of file
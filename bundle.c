@@ -0,0 +1,345 @@
+/* SPDX-License-Identifier: MIT */
+
+/*
+ * Asset bundles: a bundle in memory (bytes, a file read whole, or a mapped
+ * flash region) hands out Blit objects over its pixels without a copy. A
+ * bundle read from a stream only keeps its index in RAM and reads an asset
+ * when it is asked for.
+ */
+
+#include <string.h>
+
+#include "py/stream.h"
+
+#include "anx7625.h"
+#include "bundle.h"
+
+static inline uint32_t bundle_le16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t bundle_le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* Formats a bundle may hold, 0 for anything else */
+static uint32_t bundle_format_bits(uint32_t format)
+{
+    switch (format)
+    {
+    case DMA2D_INPUT_RGB565:
+    case DMA2D_INPUT_ARGB4444:
+        return 16;
+    case DMA2D_INPUT_L8:
+    case DMA2D_INPUT_A8:
+        return 8;
+    case DMA2D_INPUT_A4:
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+static void bundle_read_at(mp_anx7625_bundle_t *self, uint32_t offset, uint8_t *dst, size_t n)
+{
+    int errcode;
+    if (mp_stream_seek(self->src_obj, offset, MP_SEEK_SET, &errcode) == (mp_off_t)-1)
+    {
+        mp_raise_OSError(errcode);
+    }
+    mp_uint_t got = mp_stream_rw(self->src_obj, dst, n, &errcode, MP_STREAM_RW_READ);
+    if (got == MP_STREAM_ERROR)
+    {
+        mp_raise_OSError(errcode);
+    }
+    if (got != n)
+    {
+        mp_raise_ValueError(MP_ERROR_TEXT("truncated bundle"));
+    }
+}
+
+/* Read-only view of part of a bundle in memory, keeping the bundle alive */
+static mp_obj_t bundle_slice(mp_anx7625_bundle_t *self, uint32_t offset, uint32_t size)
+{
+    if (offset > self->len || size > self->len - offset)
+    {
+        mp_raise_ValueError(MP_ERROR_TEXT("truncated bundle"));
+    }
+    mp_obj_t slice = mp_obj_new_slice(MP_OBJ_NEW_SMALL_INT(offset), MP_OBJ_NEW_SMALL_INT(offset + size), mp_const_none);
+    return mp_obj_subscr(self->src_obj, slice, MP_OBJ_SENTINEL);
+}
+
+/* Returns false unless the runs fill dst exactly */
+static bool bundle_unrle(const uint8_t *src, size_t len, uint8_t *dst, size_t size, uint32_t unit)
+{
+    const uint8_t *end = src + len;
+    uint8_t *out = dst + size;
+
+    while (src < end)
+    {
+        uint32_t c = *src++;
+        if (c < 0x80)
+        {
+            size_t n = (c + 1) * unit;
+            if (n > (size_t)(end - src) || n > (size_t)(out - dst))
+            {
+                return false;
+            }
+            memcpy(dst, src, n);
+            src += n;
+            dst += n;
+        }
+        else
+        {
+            uint32_t count = c - 0x7F;
+            if (unit > (size_t)(end - src) || count * unit > (size_t)(out - dst))
+            {
+                return false;
+            }
+            for (uint32_t i = 0; i < count; i++, dst += unit)
+            {
+                memcpy(dst, src, unit);
+            }
+            src += unit;
+        }
+    }
+    return dst == out;
+}
+
+static const uint8_t *bundle_find(mp_anx7625_bundle_t *self, mp_obj_t name_obj)
+{
+    size_t len;
+    const char *name = mp_obj_str_get_data(name_obj, &len);
+
+    if (len < BUNDLE_NAME_SIZE)
+    {
+        for (uint32_t i = 0; i < self->count; i++)
+        {
+            const uint8_t *entry = self->index + i * BUNDLE_ENTRY_SIZE;
+            if (memcmp(entry, name, len) == 0 && entry[len] == '\0')
+            {
+                return entry;
+            }
+        }
+    }
+    mp_raise_type_arg(&mp_type_KeyError, name_obj);
+}
+
+static mp_obj_t bundle_get(mp_anx7625_bundle_t *self, mp_obj_t name_obj, mp_int_t alpha, mp_int_t color)
+{
+    const uint8_t *entry = bundle_find(self, name_obj);
+    uint32_t offset = bundle_le32(entry + 24);
+    uint32_t size = bundle_le32(entry + 28);
+    uint32_t width = bundle_le16(entry + 32);
+    uint32_t height = bundle_le16(entry + 34);
+    uint32_t stride = bundle_le16(entry + 36);
+    uint32_t format = entry[38];
+    uint32_t flags = entry[39];
+    uint32_t clut = bundle_le32(entry + 40);
+    uint32_t clut_size = bundle_le16(entry + 44);
+
+    uint32_t bits = bundle_format_bits(format);
+    if (bits == 0)
+    {
+        mp_raise_ValueError(MP_ERROR_TEXT("unsupported format"));
+    }
+    uint32_t unit = (bits == 4) ? 1 : bits / 8;
+    uint32_t raw = (stride * height * bits + 7) / 8;
+
+    mp_obj_t pixels_obj;
+    if (self->mapped && !(flags & BUNDLE_FLAG_RLE))
+    {
+        /* zero copy, the DMA2D reads the bundle itself */
+        pixels_obj = bundle_slice(self, offset, size);
+    }
+    else
+    {
+        uint8_t *pixels = m_new(uint8_t, raw);
+        if (flags & BUNDLE_FLAG_RLE)
+        {
+            const uint8_t *stored;
+            uint8_t *tmp = NULL;
+            if (self->mapped)
+            {
+                mp_buffer_info_t bufinfo;
+                mp_get_buffer_raise(bundle_slice(self, offset, size), &bufinfo, MP_BUFFER_READ);
+                stored = bufinfo.buf;
+            }
+            else
+            {
+                tmp = m_new(uint8_t, size);
+                bundle_read_at(self, offset, tmp, size);
+                stored = tmp;
+            }
+            bool ok = bundle_unrle(stored, size, pixels, raw, unit);
+            if (tmp != NULL)
+            {
+                m_del(uint8_t, tmp, size);
+            }
+            if (!ok)
+            {
+                mp_raise_ValueError(MP_ERROR_TEXT("corrupt RLE data"));
+            }
+        }
+        else
+        {
+            if (size < raw)
+            {
+                mp_raise_ValueError(MP_ERROR_TEXT("truncated bundle"));
+            }
+            bundle_read_at(self, offset, pixels, raw);
+        }
+        pixels_obj = mp_obj_new_bytearray_by_ref(raw, pixels);
+    }
+
+    mp_obj_t clut_obj = mp_const_none;
+    if (format == DMA2D_INPUT_L8)
+    {
+        if (self->mapped)
+        {
+            clut_obj = bundle_slice(self, clut, clut_size * sizeof(uint32_t));
+        }
+        else
+        {
+            uint8_t *palette = m_new(uint8_t, clut_size * sizeof(uint32_t));
+            bundle_read_at(self, clut, palette, clut_size * sizeof(uint32_t));
+            clut_obj = mp_obj_new_bytearray_by_ref(clut_size * sizeof(uint32_t), palette);
+        }
+    }
+
+    /* the Blit constructor validates the entry like any other source */
+    mp_obj_t args[] = {
+        pixels_obj,
+        MP_OBJ_NEW_SMALL_INT(width),
+        MP_OBJ_NEW_SMALL_INT(height),
+        MP_OBJ_NEW_SMALL_INT(format),
+        MP_OBJ_NEW_QSTR(MP_QSTR_stride),
+        MP_OBJ_NEW_SMALL_INT(stride),
+        MP_OBJ_NEW_QSTR(MP_QSTR_alpha),
+        MP_OBJ_NEW_SMALL_INT(alpha),
+        MP_OBJ_NEW_QSTR(MP_QSTR_color),
+        MP_OBJ_NEW_SMALL_INT(color),
+        MP_OBJ_NEW_QSTR(MP_QSTR_clut),
+        clut_obj,
+    };
+    return mp_call_function_n_kw(MP_OBJ_FROM_PTR(&mp_anx7625_blit_type), 4, 4, args);
+}
+
+static mp_obj_t mp_anx7625_bundle_get(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    enum
+    {
+        ARG_name,
+        ARG_alpha,
+        ARG_color,
+    };
+    static const mp_arg_t allowed_args[] = {
+        {MP_QSTR_name, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL}},
+        {MP_QSTR_alpha, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 255}},
+        {MP_QSTR_color, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0xFFFF}},
+    };
+
+    mp_anx7625_bundle_t *self = MP_OBJ_TO_PTR(args[0]);
+
+    mp_arg_val_t vals[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, vals);
+
+    return bundle_get(self, vals[ARG_name].u_obj, vals[ARG_alpha].u_int, vals[ARG_color].u_int);
+}
+
+static MP_DEFINE_CONST_FUN_OBJ_KW(mp_anx7625_bundle_get_obj, 1, mp_anx7625_bundle_get);
+
+static mp_obj_t mp_anx7625_bundle_names(mp_obj_t self_obj)
+{
+    mp_anx7625_bundle_t *self = MP_OBJ_TO_PTR(self_obj);
+    mp_obj_t list = mp_obj_new_list(0, NULL);
+
+    for (uint32_t i = 0; i < self->count; i++)
+    {
+        const char *name = (const char *)self->index + i * BUNDLE_ENTRY_SIZE;
+        mp_obj_list_append(list, mp_obj_new_str(name, strnlen(name, BUNDLE_NAME_SIZE)));
+    }
+    return list;
+}
+
+static MP_DEFINE_CONST_FUN_OBJ_1(mp_anx7625_bundle_names_obj, mp_anx7625_bundle_names);
+
+static mp_obj_t mp_anx7625_bundle_subscr(mp_obj_t self_obj, mp_obj_t index, mp_obj_t value)
+{
+    if (value != MP_OBJ_SENTINEL)
+    {
+        return MP_OBJ_NULL;
+    }
+    return bundle_get(MP_OBJ_TO_PTR(self_obj), index, 255, 0xFFFF);
+}
+
+static const mp_rom_map_elem_t mp_anx7625_bundle_locals_dict_table[] = {
+    {MP_ROM_QSTR(MP_QSTR_get), MP_ROM_PTR(&mp_anx7625_bundle_get_obj)},
+    {MP_ROM_QSTR(MP_QSTR_names), MP_ROM_PTR(&mp_anx7625_bundle_names_obj)},
+};
+
+static MP_DEFINE_CONST_DICT(mp_anx7625_bundle_locals_dict, mp_anx7625_bundle_locals_dict_table);
+
+static mp_obj_t mp_anx7625_bundle_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *all_args)
+{
+    mp_arg_check_num(n_args, n_kw, 1, 1, false);
+
+    mp_anx7625_bundle_t *self = mp_obj_malloc(mp_anx7625_bundle_t, type);
+    uint8_t header[BUNDLE_HEADER_SIZE];
+    mp_buffer_info_t bufinfo;
+
+    if (mp_get_buffer(all_args[0], &bufinfo, MP_BUFFER_READ))
+    {
+        /* slices of a memoryview keep the underlying object alive */
+        self->src_obj = mp_call_function_1(MP_OBJ_FROM_PTR(&mp_type_memoryview), all_args[0]);
+        self->mapped = true;
+        self->len = bufinfo.len;
+        if (bufinfo.len < BUNDLE_HEADER_SIZE)
+        {
+            mp_raise_ValueError(MP_ERROR_TEXT("truncated bundle"));
+        }
+        memcpy(header, bufinfo.buf, BUNDLE_HEADER_SIZE);
+    }
+    else
+    {
+        mp_get_stream_raise(all_args[0], MP_STREAM_OP_READ);
+        self->src_obj = all_args[0];
+        self->mapped = false;
+        self->len = 0;
+        bundle_read_at(self, 0, header, BUNDLE_HEADER_SIZE);
+    }
+
+    if (memcmp(header, BUNDLE_MAGIC, 4) != 0 || bundle_le16(header + 4) != BUNDLE_VERSION)
+    {
+        mp_raise_ValueError(MP_ERROR_TEXT("not an asset bundle"));
+    }
+    self->count = bundle_le16(header + 6);
+
+    size_t index_size = self->count * BUNDLE_ENTRY_SIZE;
+    if (self->mapped)
+    {
+        if (BUNDLE_HEADER_SIZE + index_size > self->len)
+        {
+            mp_raise_ValueError(MP_ERROR_TEXT("truncated bundle"));
+        }
+        self->index = (const uint8_t *)bufinfo.buf + BUNDLE_HEADER_SIZE;
+    }
+    else
+    {
+        uint8_t *index = m_new(uint8_t, index_size);
+        bundle_read_at(self, BUNDLE_HEADER_SIZE, index, index_size);
+        self->index = index;
+    }
+
+    return MP_OBJ_FROM_PTR(self);
+}
+
+MP_DEFINE_CONST_OBJ_TYPE(
+    mp_anx7625_bundle_type,
+    MP_QSTR_Bundle,
+    MP_TYPE_FLAG_NONE,
+    make_new, mp_anx7625_bundle_make_new,
+    subscr, mp_anx7625_bundle_subscr,
+    locals_dict, &mp_anx7625_bundle_locals_dict);
@@ -0,0 +1,56 @@
+/* SPDX-License-Identifier: MIT */
+
+#ifndef BUNDLE_H
+#define BUNDLE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "py/runtime.h"
+
+/*
+ * Asset bundle written by tools/anxpack.py. All fields are little-endian:
+ *
+ *   header  16 bytes   magic "ANXB", version u16, count u16, reserved
+ *   index   48 bytes   per asset, right after the header:
+ *       name[24]       NUL padded
+ *       offset u32     pixel data from the start of the bundle
+ *       size u32       stored bytes (after RLE when compressed)
+ *       width u16, height u16, stride u16 (pixels)
+ *       format u8      DMA2D input colour mode, as the module constants
+ *       flags u8       BUNDLE_FLAG_*
+ *       clut u32       offset of the ARGB8888 palette of an L8 asset, or 0
+ *       clut_size u16  palette entries
+ *       reserved u16
+ *
+ * Pixel data and palettes start on BUNDLE_ALIGN boundaries so they can be
+ * read by the DMA2D in place and occupy whole cache lines.
+ *
+ * RLE data is a sequence of runs over pixel units (one byte for A4): a
+ * control byte c < 0x80 is followed by c + 1 literal units, c >= 0x80 by a
+ * single unit repeated c - 0x7F times.
+ */
+
+#define BUNDLE_MAGIC "ANXB"
+#define BUNDLE_VERSION 1
+#define BUNDLE_HEADER_SIZE 16
+#define BUNDLE_ENTRY_SIZE 48
+#define BUNDLE_NAME_SIZE 24
+#define BUNDLE_ALIGN 32
+
+#define BUNDLE_FLAG_RLE 0x01
+
+typedef struct _mp_anx7625_bundle_t
+{
+    mp_obj_base_t base;
+    /* memoryview over the whole bundle, or the stream it is read from */
+    mp_obj_t src_obj;
+    bool mapped;
+    size_t len;
+    const uint8_t *index;
+    uint32_t count;
+} mp_anx7625_bundle_t;
+
+extern const mp_obj_type_t mp_anx7625_bundle_type;
+
+#endif /* BUNDLE_H */
@@ -0,0 +1,307 @@
+/* SPDX-License-Identifier: MIT */
+
+#include <string.h>
+
+#include "anx7625.h"
+#include "drawlist.h"
+#include "extmod/font_petme128_8x8.h"
+
+/* Glyphs expanded per DMA2D blend of a text run */
+#define DL_TEXT_CHUNK 32
+
+static uint8_t dl_glyph_run[DL_TEXT_CHUNK * 8 * 8] __attribute__((aligned(32)));
+
+typedef struct _dl_rect_t
+{
+    int32_t x;
+    int32_t y;
+    int32_t w;
+    int32_t h;
+} dl_rect_t;
+
+typedef struct _dl_op_t
+{
+    uint8_t op;
+    uint8_t arg;
+    dl_rect_t r;
+    int32_t sx;
+    int32_t sy;
+    uint16_t color;
+} dl_op_t;
+
+static inline uint16_t dl_u16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static inline int16_t dl_s16(const uint8_t *p)
+{
+    return (int16_t)dl_u16(p);
+}
+
+/* Clip a destination rectangle to the screen, moving the source origin along */
+static bool dl_clip(dl_rect_t *r, int32_t *sx, int32_t *sy)
+{
+    int32_t xsize = getXSize();
+    int32_t ysize = getYSize();
+
+    if (r->x < 0)
+    {
+        *sx -= r->x;
+        r->w += r->x;
+        r->x = 0;
+    }
+    if (r->y < 0)
+    {
+        *sy -= r->y;
+        r->h += r->y;
+        r->y = 0;
+    }
+    if (r->x + r->w > xsize)
+        r->w = xsize - r->x;
+    if (r->y + r->h > ysize)
+        r->h = ysize - r->y;
+
+    return (r->w > 0 && r->h > 0);
+}
+
+/*
+ * Fold op n into the pending op p when they are the same kind of op and
+ * touch edge to edge, both on screen and (for blits) in the atlas.
+ * Ops are never reordered, so painter's order is preserved.
+ */
+static bool dl_merge(dl_op_t *p, const dl_op_t *n)
+{
+    bool fill;
+
+    if (p->op != n->op || p->arg != n->arg)
+        return false;
+
+    switch (p->op)
+    {
+    case DL_OP_FILL:
+        if (p->color != n->color)
+            return false;
+        fill = true;
+        break;
+    case DL_OP_BLIT:
+    case DL_OP_BLEND:
+        fill = false;
+        break;
+    default:
+        return false;
+    }
+
+    if (p->r.y == n->r.y && p->r.h == n->r.h && n->r.x == p->r.x + p->r.w &&
+        (fill || (n->sy == p->sy && n->sx == p->sx + p->r.w)))
+    {
+        p->r.w += n->r.w;
+        return true;
+    }
+
+    if (p->r.x == n->r.x && p->r.w == n->r.w && n->r.y == p->r.y + p->r.h &&
+        (fill || (n->sx == p->sx && n->sy == p->sy + p->r.h)))
+    {
+        p->r.h += n->r.h;
+        return true;
+    }
+
+    return false;
+}
+
+static int dl_issue(const dl_op_t *op, const drawlist_atlas_t *atlas)
+{
+    dl_rect_t r = op->r;
+    int32_t sx = op->sx;
+    int32_t sy = op->sy;
+    uint32_t stride = getXSize();
+    const pixel_format_t *fb = getPixelFormat();
+    dma2d_job_t job = {0};
+
+    if (op->op == DL_OP_END || !dl_clip(&r, &sx, &sy))
+        return 0;
+
+    job.out_address = getDrawFrameBuffer() + (r.y * stride + r.x) * fb->bpp;
+    job.out_offset = stride - r.w;
+    job.out_pfc = fb->out;
+    job.width = r.w;
+    job.height = r.h;
+    InvalidateArea(r.x, r.y, r.w, r.h);
+
+    switch (op->op)
+    {
+    case DL_OP_FILL:
+        job.mode = DMA2D_R2M;
+        job.out_color = ConvertRGB565ToFormat(op->color, fb);
+        break;
+    case DL_OP_BLIT:
+        job.mode = (fb->dma2d == DMA2D_INPUT_RGB565) ? DMA2D_M2M : DMA2D_M2M_PFC;
+        job.fg_address = (uint32_t)(atlas->pixels + sy * atlas->width + sx);
+        job.fg_offset = atlas->width - r.w;
+        job.fg_pfc = DMA2D_INPUT_RGB565;
+        break;
+    case DL_OP_BLEND:
+        job.mode = DMA2D_M2M_BLEND;
+        job.fg_address = (uint32_t)(atlas->pixels + sy * atlas->width + sx);
+        job.fg_offset = atlas->width - r.w;
+        job.fg_pfc = DMA2D_INPUT_RGB565 |
+                     (DMA2D_REPLACE_ALPHA << DMA2D_FGPFCCR_AM_Pos) |
+                     ((uint32_t)op->arg << DMA2D_FGPFCCR_ALPHA_Pos);
+        job.bg_address = job.out_address;
+        job.bg_offset = job.out_offset;
+        job.bg_pfc = fb->dma2d;
+        break;
+    }
+
+    DMA2D_Submit(&job);
+    return 1;
+}
+
+static int dl_text(int32_t x, int32_t y, uint16_t color, const uint8_t *text, size_t len)
+{
+    int issued = 0;
+    uint32_t stride = getXSize();
+    uint32_t fg_color = ConvertRGB565ToRGB888(color);
+    const pixel_format_t *fb = getPixelFormat();
+
+    while (len > 0)
+    {
+        size_t n = MIN(len, DL_TEXT_CHUNK);
+        uint32_t run_width = n * 8;
+        dl_rect_t r = {x, y, run_width, 8};
+        int32_t sx = 0;
+        int32_t sy = 0;
+
+        if (dl_clip(&r, &sx, &sy))
+        {
+            /* the previous run may still be read by the DMA2D */
+            DMA2D_Wait();
+
+            for (size_t i = 0; i < n; i++)
+            {
+                uint8_t chr = text[i];
+                if (chr < 32 || chr > 127)
+                    chr = 127;
+                const uint8_t *chr_data = &font_petme128_8x8[(chr - 32) * 8];
+                for (uint32_t j = 0; j < 8; j++)
+                {
+                    uint8_t column = chr_data[j];
+                    for (uint32_t k = 0; k < 8; k++)
+                        dl_glyph_run[k * run_width + i * 8 + j] = (column >> k) & 1 ? 0xFF : 0x00;
+                }
+            }
+#if defined(__CORTEX_M7)
+            SCB_CleanDCache_by_Addr((uint32_t *)dl_glyph_run, run_width * 8);
+#endif
+            dma2d_job_t job = {0};
+            job.mode = DMA2D_M2M_BLEND;
+            job.fg_address = (uint32_t)(dl_glyph_run + sy * run_width + sx);
+            job.fg_offset = run_width - r.w;
+            job.fg_pfc = DMA2D_INPUT_A8;
+            job.fg_color = fg_color;
+            job.out_address = getDrawFrameBuffer() + (r.y * stride + r.x) * fb->bpp;
+            job.out_offset = stride - r.w;
+            job.out_pfc = fb->out;
+            job.bg_address = job.out_address;
+            job.bg_offset = job.out_offset;
+            job.bg_pfc = fb->dma2d;
+            job.width = r.w;
+            job.height = r.h;
+            InvalidateArea(r.x, r.y, r.w, r.h);
+            DMA2D_Submit(&job);
+            issued++;
+        }
+
+        x += run_width;
+        text += n;
+        len -= n;
+    }
+
+    return issued;
+}
+
+int drawlist_execute(const uint8_t *list, size_t len, const drawlist_atlas_t *atlas, mp_anx7625_font_t *font)
+{
+    dl_op_t pending = {.op = DL_OP_END};
+    size_t pos = 0;
+    int issued = 0;
+
+#if defined(__CORTEX_M7)
+    /* once for the whole list rather than once per op */
+    SCB_CleanInvalidateDCache();
+#endif
+
+    while (pos + 2 <= len)
+    {
+        const uint8_t *p = list + pos;
+        dl_op_t op = {.op = p[0], .arg = p[1]};
+        size_t size;
+
+        if (op.op == DL_OP_END)
+            break;
+
+        switch (op.op)
+        {
+        case DL_OP_FILL:
+            size = 12;
+            if (pos + size > len)
+                goto malformed;
+            op.r.x = dl_s16(p + 2);
+            op.r.y = dl_s16(p + 4);
+            op.r.w = dl_u16(p + 6);
+            op.r.h = dl_u16(p + 8);
+            op.color = dl_u16(p + 10);
+            break;
+        case DL_OP_BLIT:
+        case DL_OP_BLEND:
+            size = 14;
+            if (pos + size > len || atlas == NULL)
+                goto malformed;
+            op.r.x = dl_s16(p + 2);
+            op.r.y = dl_s16(p + 4);
+            op.r.w = dl_u16(p + 6);
+            op.r.h = dl_u16(p + 8);
+            op.sx = dl_u16(p + 10);
+            op.sy = dl_u16(p + 12);
+            if (op.sx + op.r.w > atlas->width || op.sy + op.r.h > atlas->height)
+                goto malformed;
+            break;
+        case DL_OP_TEXT:
+            size = 8 + ((op.arg + 1) & ~1);
+            if (pos + size > len)
+                goto malformed;
+            issued += dl_issue(&pending, atlas);
+            pending.op = DL_OP_END;
+            if (font != NULL)
+            {
+                font_clip_t clip = {0, 0, getXSize(), getYSize()};
+                int32_t advance;
+                issued += font_draw(font, p + 8, op.arg, dl_s16(p + 2), dl_s16(p + 4), dl_u16(p + 6), &clip, &advance);
+            }
+            else
+            {
+                issued += dl_text(dl_s16(p + 2), dl_s16(p + 4), dl_u16(p + 6), p + 8, op.arg);
+            }
+            pos += size;
+            continue;
+        default:
+            goto malformed;
+        }
+
+        if (!dl_merge(&pending, &op))
+        {
+            issued += dl_issue(&pending, atlas);
+            pending = op;
+        }
+        pos += size;
+    }
+
+    issued += dl_issue(&pending, atlas);
+    DMA2D_Wait();
+    return issued;
+
+malformed:
+    dl_issue(&pending, atlas);
+    DMA2D_Wait();
+    return -(int)(pos + 1);
+}
@@ -0,0 +1,47 @@
+/* SPDX-License-Identifier: MIT */
+
+#ifndef DRAWLIST_H
+#define DRAWLIST_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "font.h"
+
+/*
+ * Binary draw-list executed in a single call by ANX7625.execute().
+ *
+ * Every op starts with a one byte opcode and a one byte argument, followed
+ * by little-endian 16-bit fields. Coordinates are in pixels; x and y are
+ * signed so ops may hang off the screen edges and get clipped:
+ *
+ *   DL_OP_END   0x00  -      end of list (optional)
+ *   DL_OP_FILL  0x01  -      x, y, w, h, color                     12 bytes
+ *   DL_OP_BLIT  0x02  -      x, y, w, h, sx, sy                    14 bytes
+ *   DL_OP_BLEND 0x03  alpha  x, y, w, h, sx, sy                    14 bytes
+ *   DL_OP_TEXT  0x04  len    x, y, color, text[len] padded to even 8 + len bytes
+ *
+ * BLIT and BLEND read the (sx, sy, w, h) region of the RGB565 atlas passed
+ * alongside the list. TEXT draws with the font passed alongside the list,
+ * or the built-in 8x8 font without one; y is then the top of the line.
+ * Colours are RGB565 whatever the framebuffer format.
+ */
+
+#define DL_OP_END 0x00
+#define DL_OP_FILL 0x01
+#define DL_OP_BLIT 0x02
+#define DL_OP_BLEND 0x03
+#define DL_OP_TEXT 0x04
+
+typedef struct _drawlist_atlas_t
+{
+    const uint16_t *pixels;
+    uint32_t width;
+    uint32_t height;
+} drawlist_atlas_t;
+
+/* Returns the number of DMA2D transfers issued, or -(offset + 1) of the
+ * first malformed op */
+int drawlist_execute(const uint8_t *list, size_t len, const drawlist_atlas_t *atlas, mp_anx7625_font_t *font);
+
+#endif /* DRAWLIST_H */
@@ -0,0 +1,613 @@
+/* SPDX-License-Identifier: MIT */
+
+/*
+ * Text from a pre-rendered glyph atlas. A string short enough is laid out
+ * once (kerning included), its glyphs merged into an A8 run kept in a small
+ * cache, and the run is then drawn by a single DMA2D blend in the text
+ * colour. Other strings are drawn as one blend per glyph straight from the
+ * atlas.
+ */
+
+#include <string.h>
+
+#include "py/stream.h"
+
+#include "anx7625.h"
+#include "font.h"
+
+typedef struct _font_glyph_t
+{
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+    int32_t left;
+    int32_t top;
+    int32_t pen;
+} font_glyph_t;
+
+typedef struct _font_layout_t
+{
+    const uint8_t *p;
+    const uint8_t *end;
+    int32_t pen;
+    int32_t prev;
+} font_layout_t;
+
+static inline uint32_t font_le16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t font_le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* Next codepoint, a malformed sequence is taken byte by byte as Latin-1 */
+static uint32_t font_utf8(const uint8_t **p, const uint8_t *end)
+{
+    const uint8_t *s = *p;
+    uint32_t c = *s++;
+    uint32_t extra = (c >= 0xF0) ? 3 : (c >= 0xE0) ? 2 : (c >= 0xC0) ? 1 : 0;
+
+    if (extra == 0 || (size_t)(end - s) < extra)
+    {
+        *p = s;
+        return c;
+    }
+    uint32_t cp = c & (0x3F >> extra);
+    for (uint32_t i = 0; i < extra; i++)
+    {
+        if ((s[i] & 0xC0) != 0x80)
+        {
+            *p = s;
+            return c;
+        }
+        cp = (cp << 6) | (s[i] & 0x3F);
+    }
+    *p = s + extra;
+    return cp;
+}
+
+/* Binary search of the glyph table, -1 when the font lacks the codepoint */
+static int32_t font_find_glyph(mp_anx7625_font_t *font, uint32_t cp)
+{
+    int32_t lo = 0;
+    int32_t hi = font->glyph_count - 1;
+
+    while (lo <= hi)
+    {
+        int32_t mid = (lo + hi) / 2;
+        uint32_t c = font_le32(font->glyphs + mid * FONT_GLYPH_SIZE);
+        if (c == cp)
+        {
+            return mid;
+        }
+        if (c < cp)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid - 1;
+        }
+    }
+    return -1;
+}
+
+static int32_t font_find_kerning(mp_anx7625_font_t *font, uint32_t left, uint32_t right)
+{
+    uint32_t key = (left << 16) | right;
+    int32_t lo = 0;
+    int32_t hi = font->kern_count - 1;
+
+    while (lo <= hi)
+    {
+        int32_t mid = (lo + hi) / 2;
+        const uint8_t *pair = font->kerning + mid * FONT_KERN_SIZE;
+        uint32_t k = (font_le16(pair) << 16) | font_le16(pair + 2);
+        if (k == key)
+        {
+            return (int8_t)pair[4];
+        }
+        if (k < key)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid - 1;
+        }
+    }
+    return 0;
+}
+
+/* Next glyph of the text with its pen position; codepoints without a glyph are skipped */
+static bool font_next(mp_anx7625_font_t *font, font_layout_t *l, font_glyph_t *g)
+{
+    while (l->p < l->end)
+    {
+        int32_t index = font_find_glyph(font, font_utf8(&l->p, l->end));
+        if (index < 0)
+        {
+            continue;
+        }
+        if (l->prev >= 0 && font->kern_count != 0)
+        {
+            l->pen += font_find_kerning(font, l->prev, index);
+        }
+
+        const uint8_t *e = font->glyphs + index * FONT_GLYPH_SIZE;
+        g->x = font_le16(e + 4);
+        g->y = font_le16(e + 6);
+        g->width = e[8];
+        g->height = e[9];
+        g->left = (int8_t)e[10];
+        g->top = font->ascent - (int8_t)e[11];
+        g->pen = l->pen;
+
+        l->pen += e[12];
+        l->prev = index;
+        return true;
+    }
+    return false;
+}
+
+static void font_layout_init(font_layout_t *l, const uint8_t *text, size_t len)
+{
+    l->p = text;
+    l->end = text + len;
+    l->pen = 0;
+    l->prev = -1;
+}
+
+/* Blend an A8 or A4 alpha map in the text colour, clipped */
+static int font_blend(uint32_t address, uint32_t stride, uint32_t format, int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color, const font_clip_t *clip)
+{
+    int32_t sx = 0;
+    int32_t sy = 0;
+    uint32_t xsize = getXSize();
+
+    if (x < clip->x0)
+    {
+        sx = clip->x0 - x;
+        w -= sx;
+        x = clip->x0;
+    }
+    if (y < clip->y0)
+    {
+        sy = clip->y0 - y;
+        h -= sy;
+        y = clip->y0;
+    }
+    if (format == DMA2D_INPUT_A4 && (sx & 1))
+    {
+        /* 4-bit sources must start on a byte boundary */
+        sx++;
+        x++;
+        w--;
+    }
+    w = MIN(w, clip->x1 - x);
+    h = MIN(h, clip->y1 - y);
+    if (w <= 0 || h <= 0)
+    {
+        return 0;
+    }
+
+    uint32_t bits = (format == DMA2D_INPUT_A4) ? 4 : 8;
+    const pixel_format_t *fb = getPixelFormat();
+    dma2d_job_t job = {0};
+    job.mode = DMA2D_M2M_BLEND;
+    job.fg_address = address + ((sy * stride + sx) * bits) / 8;
+    job.fg_offset = stride - w;
+    job.fg_pfc = format;
+    job.fg_color = color;
+    job.out_address = getDrawFrameBuffer() + (y * xsize + x) * fb->bpp;
+    job.out_offset = xsize - w;
+    job.out_pfc = fb->out;
+    job.bg_address = job.out_address;
+    job.bg_offset = job.out_offset;
+    job.bg_pfc = fb->dma2d;
+    job.width = w;
+    job.height = h;
+
+    InvalidateArea(x, y, w, h);
+    CleanInvalidateDCacheRegion(job.out_address, ((h - 1) * xsize + w) * fb->bpp);
+    DMA2D_Submit(&job);
+    return 1;
+}
+
+/* Merge a glyph into an A8 run, keeping the strongest coverage where glyphs overlap */
+static void font_compose(mp_anx7625_font_t *font, font_run_t *run, const font_glyph_t *g)
+{
+    int32_t x = g->pen + g->left - run->left;
+
+    for (uint32_t r = 0; r < g->height; r++)
+    {
+        int32_t row = g->top + (int32_t)r;
+        if (row < 0 || row >= (int32_t)font->line_height)
+        {
+            continue;
+        }
+        uint8_t *dst = run->alpha + row * run->width + x;
+        uint32_t offset = (g->y + r) * font->atlas_width + g->x;
+        for (uint32_t c = 0; c < g->width; c++)
+        {
+            uint8_t a;
+            if (font->format == DMA2D_INPUT_A4)
+            {
+                uint8_t b = font->atlas[(offset + c) / 2];
+                a = (((offset + c) & 1) ? (b >> 4) : (b & 0x0F)) * 0x11;
+            }
+            else
+            {
+                a = font->atlas[offset + c];
+            }
+            dst[c] = MAX(dst[c], a);
+        }
+    }
+}
+
+/* Cached run of the text, laid out and composed on a miss; NULL when it does not fit */
+static font_run_t *font_run(mp_anx7625_font_t *font, const uint8_t *text, size_t len)
+{
+    if (font->cache_size == 0 || len > FONT_RUN_TEXT_MAX)
+    {
+        return NULL;
+    }
+
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++)
+    {
+        hash = (hash ^ text[i]) * 16777619u;
+    }
+
+    font_run_t *victim = &font->cache[0];
+    font->stamp++;
+    for (uint32_t i = 0; i < font->cache_size; i++)
+    {
+        font_run_t *run = &font->cache[i];
+        if (run->stamp != 0 && run->hash == hash && run->len == len && memcmp(run->text, text, len) == 0)
+        {
+            run->stamp = font->stamp;
+            font->hits++;
+            return run;
+        }
+        if (run->stamp < victim->stamp)
+        {
+            victim = run;
+        }
+    }
+    font->misses++;
+
+    /* extent of the ink, which may start left of the pen or end past it */
+    font_layout_t l;
+    font_glyph_t g;
+    int32_t x0 = INT32_MAX;
+    int32_t x1 = INT32_MIN;
+    font_layout_init(&l, text, len);
+    while (font_next(font, &l, &g))
+    {
+        if (g.width != 0)
+        {
+            x0 = MIN(x0, g.pen + g.left);
+            x1 = MAX(x1, g.pen + g.left + (int32_t)g.width);
+        }
+    }
+    uint32_t width = (x1 > x0) ? x1 - x0 : 0;
+    uint32_t size = width * font->line_height;
+    if (size > FONT_RUN_MAX)
+    {
+        return NULL;
+    }
+
+    /* the DMA2D may still be reading the run being replaced */
+    DMA2D_Wait();
+    if (victim->size < size)
+    {
+        victim->alpha = m_renew(uint8_t, victim->alpha, victim->size, size);
+        victim->size = size;
+    }
+    if (victim->text == NULL)
+    {
+        victim->text = m_new(uint8_t, FONT_RUN_TEXT_MAX);
+    }
+    victim->hash = hash;
+    victim->stamp = font->stamp;
+    victim->len = len;
+    victim->width = width;
+    victim->left = (width != 0) ? x0 : 0;
+    victim->advance = l.pen;
+    memcpy(victim->text, text, len);
+
+    memset(victim->alpha, 0, size);
+    font_layout_init(&l, text, len);
+    while (font_next(font, &l, &g))
+    {
+        font_compose(font, victim, &g);
+    }
+    CleanInvalidateDCacheRegion((uint32_t)victim->alpha, size);
+    return victim;
+}
+
+int font_draw(mp_anx7625_font_t *font, const uint8_t *text, size_t len, int32_t x, int32_t y, uint16_t color, const font_clip_t *clip, int32_t *advance)
+{
+    uint32_t fg_color = ConvertRGB565ToRGB888(color);
+
+    font_run_t *run = font_run(font, text, len);
+    if (run != NULL)
+    {
+        *advance = run->advance;
+        if (run->width == 0)
+        {
+            return 0;
+        }
+        return font_blend((uint32_t)run->alpha, run->width, DMA2D_INPUT_A8, x + run->left, y, run->width, font->line_height, fg_color, clip);
+    }
+
+    int issued = 0;
+    uint32_t bits = (font->format == DMA2D_INPUT_A4) ? 4 : 8;
+    font_layout_t l;
+    font_glyph_t g;
+    font_layout_init(&l, text, len);
+    while (font_next(font, &l, &g))
+    {
+        if (g.width == 0)
+        {
+            continue;
+        }
+        uint32_t address = (uint32_t)font->atlas + ((g.y * font->atlas_width + g.x) * bits) / 8;
+        issued += font_blend(address, font->atlas_width, font->format, x + g.pen + g.left, y + g.top, g.width, g.height, fg_color, clip);
+    }
+    *advance = l.pen;
+    return issued;
+}
+
+static mp_obj_t mp_anx7625_font_draw(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    enum
+    {
+        ARG_text,
+        ARG_x,
+        ARG_y,
+        ARG_color,
+        ARG_clip,
+    };
+    static const mp_arg_t allowed_args[] = {
+        {MP_QSTR_text, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL}},
+        {MP_QSTR_x, MP_ARG_REQUIRED | MP_ARG_INT, {.u_int = 0}},
+        {MP_QSTR_y, MP_ARG_REQUIRED | MP_ARG_INT, {.u_int = 0}},
+        {MP_QSTR_color, MP_ARG_INT, {.u_int = 0xFFFF}},
+        {MP_QSTR_clip, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_rom_obj = MP_ROM_NONE}},
+    };
+
+    mp_anx7625_font_t *self = MP_OBJ_TO_PTR(args[0]);
+
+    mp_arg_val_t vals[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, vals);
+    CheckDisplayStarted();
+    CheckDirectColorFramebuffer();
+
+    size_t len;
+    const char *text = mp_obj_str_get_data(vals[ARG_text].u_obj, &len);
+
+    font_clip_t clip = {0, 0, getXSize(), getYSize()};
+    if (vals[ARG_clip].u_obj != mp_const_none)
+    {
+        mp_obj_t *items;
+        mp_obj_get_array_fixed_n(vals[ARG_clip].u_obj, 4, &items);
+        mp_int_t cx = mp_obj_get_int(items[0]);
+        mp_int_t cy = mp_obj_get_int(items[1]);
+        clip.x0 = MAX(clip.x0, cx);
+        clip.y0 = MAX(clip.y0, cy);
+        clip.x1 = MIN(clip.x1, cx + mp_obj_get_int(items[2]));
+        clip.y1 = MIN(clip.y1, cy + mp_obj_get_int(items[3]));
+    }
+
+    int32_t advance;
+    font_draw(self, (const uint8_t *)text, len, vals[ARG_x].u_int, vals[ARG_y].u_int, vals[ARG_color].u_int, &clip, &advance);
+    return mp_obj_new_int(advance);
+}
+
+static MP_DEFINE_CONST_FUN_OBJ_KW(mp_anx7625_font_draw_obj, 1, mp_anx7625_font_draw);
+
+static mp_obj_t mp_anx7625_font_measure(mp_obj_t self_obj, mp_obj_t text_obj)
+{
+    mp_anx7625_font_t *self = MP_OBJ_TO_PTR(self_obj);
+
+    size_t len;
+    const char *text = mp_obj_str_get_data(text_obj, &len);
+
+    font_layout_t l;
+    font_glyph_t g;
+    font_layout_init(&l, (const uint8_t *)text, len);
+    while (font_next(self, &l, &g))
+    {
+    }
+    return mp_obj_new_int(l.pen);
+}
+
+static MP_DEFINE_CONST_FUN_OBJ_2(mp_anx7625_font_measure_obj, mp_anx7625_font_measure);
+
+static const mp_rom_map_elem_t mp_anx7625_font_locals_dict_table[] = {
+    {MP_ROM_QSTR(MP_QSTR_draw), MP_ROM_PTR(&mp_anx7625_font_draw_obj)},
+    {MP_ROM_QSTR(MP_QSTR_measure), MP_ROM_PTR(&mp_anx7625_font_measure_obj)},
+    {MP_ROM_QSTR(MP_QSTR_height), MP_ROM_PTR(mp_const_none)},
+    {MP_ROM_QSTR(MP_QSTR_ascent), MP_ROM_PTR(mp_const_none)},
+    {MP_ROM_QSTR(MP_QSTR_hits), MP_ROM_PTR(mp_const_none)},
+    {MP_ROM_QSTR(MP_QSTR_misses), MP_ROM_PTR(mp_const_none)},
+};
+
+static MP_DEFINE_CONST_DICT(mp_anx7625_font_locals_dict, mp_anx7625_font_locals_dict_table);
+
+/*
+ * Size of the whole font from its header alone, checked before anything is
+ * allocated or read from it: 0 when the tables do not fit before the atlas
+ * or the size does not fit in memory.
+ */
+static size_t font_size_from_header(const uint8_t *header)
+{
+    uint8_t format = header[10];
+    uint32_t bits = (format == DMA2D_INPUT_A4) ? 4 : 8;
+    uint64_t atlas_width = font_le16(header + 12);
+    uint64_t atlas_offset = font_le32(header + 20);
+    uint64_t tables = FONT_HEADER_SIZE + (uint64_t)font_le16(header + 6) * FONT_GLYPH_SIZE +
+                      (uint64_t)font_le16(header + 8) * FONT_KERN_SIZE;
+    uint64_t total = atlas_offset + (atlas_width * font_le16(header + 14) * bits) / 8;
+
+    if ((format != DMA2D_INPUT_A8 && format != DMA2D_INPUT_A4) || (bits == 4 && (atlas_width & 1)) ||
+        atlas_offset < tables || total > SIZE_MAX)
+    {
+        return 0;
+    }
+    return (size_t)total;
+}
+
+static mp_obj_t mp_anx7625_font_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *all_args)
+{
+    enum
+    {
+        ARG_src,
+        ARG_cache,
+    };
+
+    static const mp_arg_t allowed_args[] = {
+        {MP_QSTR_src, MP_ARG_OBJ | MP_ARG_REQUIRED, {.u_obj = MP_OBJ_NULL}},
+        {MP_QSTR_cache, MP_ARG_INT | MP_ARG_KW_ONLY, {.u_int = FONT_CACHE_DEFAULT}},
+    };
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all_kw_array(n_args, n_kw, all_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    if (args[ARG_cache].u_int < 0)
+    {
+        mp_raise_ValueError(MP_ERROR_TEXT("cache must not be negative"));
+    }
+
+    mp_anx7625_font_t *self = mp_obj_malloc(mp_anx7625_font_t, type);
+    const uint8_t *data;
+    size_t len;
+    mp_buffer_info_t bufinfo;
+
+    if (mp_get_buffer(args[ARG_src].u_obj, &bufinfo, MP_BUFFER_READ))
+    {
+        /* used in place, which for a mapped region means straight from flash */
+        self->src_obj = args[ARG_src].u_obj;
+        data = bufinfo.buf;
+        len = bufinfo.len;
+    }
+    else
+    {
+        /* the atlas must be addressable by the DMA2D, so read it all */
+        uint8_t header[FONT_HEADER_SIZE];
+        int errcode;
+        mp_get_stream_raise(args[ARG_src].u_obj, MP_STREAM_OP_READ);
+        if (mp_stream_rw(args[ARG_src].u_obj, header, FONT_HEADER_SIZE, &errcode, MP_STREAM_RW_READ) != FONT_HEADER_SIZE ||
+            memcmp(header, FONT_MAGIC, 4) != 0 || font_le16(header + 4) != FONT_VERSION)
+        {
+            mp_raise_ValueError(MP_ERROR_TEXT("not a font"));
+        }
+        len = font_size_from_header(header);
+        if (len == 0)
+        {
+            mp_raise_ValueError(MP_ERROR_TEXT("malformed font"));
+        }
+        uint8_t *buf = m_new(uint8_t, len);
+        memcpy(buf, header, FONT_HEADER_SIZE);
+        if (mp_stream_rw(args[ARG_src].u_obj, buf + FONT_HEADER_SIZE, len - FONT_HEADER_SIZE, &errcode, MP_STREAM_RW_READ) != len - FONT_HEADER_SIZE)
+        {
+            mp_raise_ValueError(MP_ERROR_TEXT("truncated font"));
+        }
+        self->src_obj = mp_obj_new_bytearray_by_ref(len, buf);
+        data = buf;
+    }
+
+    if (len < FONT_HEADER_SIZE || memcmp(data, FONT_MAGIC, 4) != 0 || font_le16(data + 4) != FONT_VERSION)
+    {
+        mp_raise_ValueError(MP_ERROR_TEXT("not a font"));
+    }
+
+    self->glyph_count = font_le16(data + 6);
+    self->kern_count = font_le16(data + 8);
+    self->format = data[10];
+    self->atlas_width = font_le16(data + 12);
+    self->atlas_height = font_le16(data + 14);
+    self->ascent = font_le16(data + 16);
+    self->line_height = font_le16(data + 18);
+
+    uint32_t atlas_offset = font_le32(data + 20);
+    uint32_t bits = (self->format == DMA2D_INPUT_A4) ? 4 : 8;
+    size_t size = font_size_from_header(data);
+    if (size == 0 || size > len)
+    {
+        mp_raise_ValueError(MP_ERROR_TEXT("malformed font"));
+    }
+
+    /* glyph rectangles are trusted from here on */
+    for (uint32_t i = 0; i < self->glyph_count; i++)
+    {
+        const uint8_t *e = data + FONT_HEADER_SIZE + i * FONT_GLYPH_SIZE;
+        if (font_le16(e + 4) + e[8] > self->atlas_width || font_le16(e + 6) + e[9] > self->atlas_height ||
+            (bits == 4 && (font_le16(e + 4) & 1)))
+        {
+            mp_raise_ValueError(MP_ERROR_TEXT("malformed font"));
+        }
+    }
+
+    self->glyphs = data + FONT_HEADER_SIZE;
+    self->kerning = self->glyphs + self->glyph_count * FONT_GLYPH_SIZE;
+    self->atlas = data + atlas_offset;
+    self->cache_size = args[ARG_cache].u_int;
+    self->cache = m_new0(font_run_t, self->cache_size);
+    self->stamp = 0;
+    self->hits = 0;
+    self->misses = 0;
+
+    /* written by the CPU at most once, before the DMA2D first reads it */
+    CleanInvalidateDCacheRegion((uint32_t)self->atlas, (self->atlas_width * self->atlas_height * bits) / 8);
+    return MP_OBJ_FROM_PTR(self);
+}
+
+static void mp_anx7625_font_attr(mp_obj_t obj, qstr attr, mp_obj_t *dest)
+{
+    mp_anx7625_font_t *self = MP_OBJ_TO_PTR(obj);
+    if (dest[0] == MP_OBJ_NULL)
+    {
+        const mp_obj_type_t *type = mp_obj_get_type(obj);
+        mp_map_t *locals_map = (mp_map_t *)mp_obj_dict_get_map(MP_OBJ_TYPE_GET_SLOT(type, locals_dict));
+        mp_map_elem_t *elem = mp_map_lookup(locals_map, MP_OBJ_NEW_QSTR(attr), MP_MAP_LOOKUP);
+        if (elem != NULL)
+        {
+            if (attr == MP_QSTR_height)
+            {
+                dest[0] = mp_obj_new_int(self->line_height);
+                return;
+            }
+            if (attr == MP_QSTR_ascent)
+            {
+                dest[0] = mp_obj_new_int(self->ascent);
+                return;
+            }
+            if (attr == MP_QSTR_hits)
+            {
+                dest[0] = mp_obj_new_int_from_uint(self->hits);
+                return;
+            }
+            if (attr == MP_QSTR_misses)
+            {
+                dest[0] = mp_obj_new_int_from_uint(self->misses);
+                return;
+            }
+            mp_convert_member_lookup(obj, type, elem->value, dest);
+        }
+    }
+}
+
+MP_DEFINE_CONST_OBJ_TYPE(
+    mp_anx7625_font_type,
+    MP_QSTR_Font,
+    MP_TYPE_FLAG_NONE,
+    make_new, mp_anx7625_font_make_new,
+    attr, mp_anx7625_font_attr,
+    locals_dict, &mp_anx7625_font_locals_dict);
@@ -0,0 +1,94 @@
+/* SPDX-License-Identifier: MIT */
+
+#ifndef FONT_H
+#define FONT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "py/runtime.h"
+
+/*
+ * Font written by tools/anxfont.py: glyphs pre-rendered into an A8 or A4
+ * atlas. All fields are little-endian:
+ *
+ *   header  24 bytes   magic "ANXF", version u16, glyphs u16, kerning pairs
+ *                      u16, format u8 (DMA2D A8 or A4), reserved u8, atlas
+ *                      width u16, atlas height u16, ascent u16, line height
+ *                      u16, atlas offset u32
+ *   glyphs  16 bytes   per glyph, sorted by codepoint: codepoint u32, x u16,
+ *                      y u16 (in the atlas), width u8, height u8, left
+ *                      bearing s8, top above the baseline s8, advance u8,
+ *                      reserved[3]
+ *   kerning  8 bytes   per pair, sorted by left then right: left glyph u16,
+ *                      right glyph u16, adjustment s8, reserved[3]
+ *   atlas              width * height pixels, 32 byte aligned
+ *
+ * In an A4 atlas glyphs start on even columns and the first pixel of a byte
+ * is its low nibble.
+ */
+
+#define FONT_MAGIC "ANXF"
+#define FONT_VERSION 1
+#define FONT_HEADER_SIZE 24
+#define FONT_GLYPH_SIZE 16
+#define FONT_KERN_SIZE 8
+
+/* Strings up to this long are laid out once and kept as a single A8 run */
+#define FONT_RUN_TEXT_MAX 64
+/* Largest run kept in the cache, longer ones are drawn glyph by glyph */
+#define FONT_RUN_MAX (16 * 1024)
+#define FONT_CACHE_DEFAULT 8
+
+typedef struct _font_run_t
+{
+    uint32_t hash;
+    uint32_t stamp;
+    uint16_t len;
+    uint16_t width;
+    int16_t left;
+    int16_t advance;
+    uint32_t size;
+    uint8_t *text;
+    uint8_t *alpha;
+} font_run_t;
+
+typedef struct _mp_anx7625_font_t
+{
+    mp_obj_base_t base;
+    mp_obj_t src_obj;
+    const uint8_t *glyphs;
+    const uint8_t *kerning;
+    const uint8_t *atlas;
+    uint32_t glyph_count;
+    uint32_t kern_count;
+    uint32_t format;
+    uint32_t atlas_width;
+    uint32_t atlas_height;
+    uint32_t ascent;
+    uint32_t line_height;
+    uint32_t cache_size;
+    uint32_t stamp;
+    font_run_t *cache;
+    uint32_t hits;
+    uint32_t misses;
+} mp_anx7625_font_t;
+
+/* Destination clip rectangle, already inside the screen */
+typedef struct _font_clip_t
+{
+    int32_t x0;
+    int32_t y0;
+    int32_t x1;
+    int32_t y1;
+} font_clip_t;
+
+/*
+ * Draw UTF-8 text with the top of its line at (x, y). Returns the number
+ * of DMA2D transfers issued and sets the pen advance in pixels.
+ */
+int font_draw(mp_anx7625_font_t *font, const uint8_t *text, size_t len, int32_t x, int32_t y, uint16_t color, const font_clip_t *clip, int32_t *advance);
+
+extern const mp_obj_type_t mp_anx7625_font_type;
+
+#endif /* FONT_H */
@@ -0,0 +1,313 @@
+/* SPDX-License-Identifier: MIT */
+
+/*
+ * FrameBuffer type compatible with framebuf.FrameBuffer. Large fills and
+ * blits on RGB565 buffers run on the DMA2D, everything else (small areas,
+ * text, pixel, lines, other formats) is forwarded to a framebuf.FrameBuffer
+ * over the same memory.
+ */
+
+#include <string.h>
+
+#include "anx7625.h"
+#include "framebuffer.h"
+
+static mp_obj_t fb_call_inner(mp_anx7625_framebuffer_t *self, qstr method, size_t n_args, const mp_obj_t *args)
+{
+    mp_obj_t dest[2 + 5];
+    mp_load_method(self->fb_obj, method, dest);
+    for (size_t i = 0; i < n_args; i++)
+    {
+        dest[2 + i] = args[i];
+    }
+    return mp_call_method_n_kw(n_args, 0, dest);
+}
+
+static bool fb_clip(const mp_anx7625_framebuffer_t *self, mp_int_t *x, mp_int_t *y, mp_int_t *w, mp_int_t *h, mp_int_t *sx, mp_int_t *sy)
+{
+    if (*x < 0)
+    {
+        *sx -= *x;
+        *w += *x;
+        *x = 0;
+    }
+    if (*y < 0)
+    {
+        *sy -= *y;
+        *h += *y;
+        *y = 0;
+    }
+    if (*x + *w > self->width)
+    {
+        *w = self->width - *x;
+    }
+    if (*y + *h > self->height)
+    {
+        *h = self->height - *y;
+    }
+    return (*w > 0 && *h > 0);
+}
+
+/*
+ * Drawing into the display's draw buffer is recorded like that of the other
+ * drawing calls, and before it lands so that a deferred blank fill runs first.
+ */
+static void fb_invalidate(const mp_anx7625_framebuffer_t *self, mp_int_t x, mp_int_t y, mp_int_t w, mp_int_t h)
+{
+    if (!IsDisplayPrepared() || self->format != FRAMEBUF_RGB565 || getBytesPerPixel() != sizeof(uint16_t) ||
+        self->stride != (int32_t)getXSize())
+    {
+        return;
+    }
+
+    uint32_t base = getDrawFrameBuffer();
+    uint32_t address = (uint32_t)self->buf;
+    if (address < base || address - base >= getXSize() * getYSize() * sizeof(uint16_t))
+    {
+        return;
+    }
+    uint32_t pixel = (address - base) / sizeof(uint16_t);
+    InvalidateArea(x + pixel % getXSize(), y + pixel / getXSize(), w, h);
+}
+
+static void fb_dma2d_fill(mp_anx7625_framebuffer_t *self, mp_int_t x, mp_int_t y, mp_int_t w, mp_int_t h, uint16_t color)
+{
+    dma2d_job_t job = {0};
+    job.mode = DMA2D_R2M;
+    job.out_address = (uint32_t)(self->buf + (y * self->stride + x) * sizeof(uint16_t));
+    job.out_offset = self->stride - w;
+    job.out_pfc = DMA2D_OUTPUT_RGB565;
+    job.out_color = color;
+    job.width = w;
+    job.height = h;
+
+    CleanInvalidateDCacheRegion(job.out_address, ((h - 1) * self->stride + w) * sizeof(uint16_t));
+    DMA2D_Submit(&job);
+    /* the CPU may draw into the same lines right after we return */
+    DMA2D_Wait();
+}
+
+static bool fb_fill_rect_fast(mp_anx7625_framebuffer_t *self, const mp_obj_t *args)
+{
+    mp_int_t x = mp_obj_get_int(args[0]);
+    mp_int_t y = mp_obj_get_int(args[1]);
+    mp_int_t w = mp_obj_get_int(args[2]);
+    mp_int_t h = mp_obj_get_int(args[3]);
+    mp_int_t sx = 0;
+    mp_int_t sy = 0;
+
+    if (self->format != FRAMEBUF_RGB565)
+    {
+        return false;
+    }
+    if (fb_clip(self, &x, &y, &w, &h, &sx, &sy))
+    {
+        fb_invalidate(self, x, y, w, h);
+        if (w * h < FRAMEBUF_DMA2D_MIN_PIXELS)
+        {
+            return false;
+        }
+        fb_dma2d_fill(self, x, y, w, h, mp_obj_get_int(args[4]));
+    }
+    return true;
+}
+
+static mp_obj_t mp_anx7625_framebuffer_fill(mp_obj_t self_obj, mp_obj_t color_obj)
+{
+    mp_anx7625_framebuffer_t *self = MP_OBJ_TO_PTR(self_obj);
+
+    fb_invalidate(self, 0, 0, self->width, self->height);
+    if (self->format == FRAMEBUF_RGB565 && self->width * self->height >= FRAMEBUF_DMA2D_MIN_PIXELS)
+    {
+        fb_dma2d_fill(self, 0, 0, self->width, self->height, mp_obj_get_int(color_obj));
+        return mp_const_none;
+    }
+    return fb_call_inner(self, MP_QSTR_fill, 1, &color_obj);
+}
+
+static MP_DEFINE_CONST_FUN_OBJ_2(mp_anx7625_framebuffer_fill_obj, mp_anx7625_framebuffer_fill);
+
+static mp_obj_t mp_anx7625_framebuffer_fill_rect(size_t n_args, const mp_obj_t *args)
+{
+    mp_anx7625_framebuffer_t *self = MP_OBJ_TO_PTR(args[0]);
+
+    if (fb_fill_rect_fast(self, args + 1))
+    {
+        return mp_const_none;
+    }
+    return fb_call_inner(self, MP_QSTR_fill_rect, n_args - 1, args + 1);
+}
+
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mp_anx7625_framebuffer_fill_rect_obj, 6, 6, mp_anx7625_framebuffer_fill_rect);
+
+static mp_obj_t mp_anx7625_framebuffer_rect(size_t n_args, const mp_obj_t *args)
+{
+    mp_anx7625_framebuffer_t *self = MP_OBJ_TO_PTR(args[0]);
+
+    if (n_args > 6 && mp_obj_is_true(args[6]) && fb_fill_rect_fast(self, args + 1))
+    {
+        return mp_const_none;
+    }
+    fb_invalidate(self, mp_obj_get_int(args[1]), mp_obj_get_int(args[2]), mp_obj_get_int(args[3]), mp_obj_get_int(args[4]));
+    return fb_call_inner(self, MP_QSTR_rect, n_args - 1, args + 1);
+}
+
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mp_anx7625_framebuffer_rect_obj, 6, 7, mp_anx7625_framebuffer_rect);
+
+static mp_obj_t mp_anx7625_framebuffer_blit(size_t n_args, const mp_obj_t *args)
+{
+    mp_anx7625_framebuffer_t *self = MP_OBJ_TO_PTR(args[0]);
+    mp_obj_t source_obj = args[1];
+    const uint8_t *src = NULL;
+    mp_int_t src_width = 0;
+    mp_int_t src_height = 0;
+    mp_int_t src_stride = 0;
+
+    bool plain = (n_args < 5 || mp_obj_get_int(args[4]) == -1) && (n_args < 6 || args[5] == mp_const_none);
+
+    if (mp_obj_is_type(source_obj, &mp_anx7625_framebuffer_type))
+    {
+        mp_anx7625_framebuffer_t *source = MP_OBJ_TO_PTR(source_obj);
+        if (source->format == FRAMEBUF_RGB565 && source != self)
+        {
+            src = source->buf;
+            src_width = source->width;
+            src_height = source->height;
+            src_stride = source->stride;
+        }
+        source_obj = source->fb_obj;
+    }
+    else if (mp_obj_is_type(source_obj, &mp_type_tuple))
+    {
+        size_t len;
+        mp_obj_t *items;
+        mp_obj_get_array(source_obj, &len, &items);
+        if ((len == 4 || len == 5) && mp_obj_get_int(items[3]) == FRAMEBUF_RGB565)
+        {
+            mp_buffer_info_t bufinfo;
+            mp_get_buffer_raise(items[0], &bufinfo, MP_BUFFER_READ);
+            src_width = mp_obj_get_int(items[1]);
+            src_height = mp_obj_get_int(items[2]);
+            src_stride = (len == 5) ? mp_obj_get_int(items[4]) : src_width;
+            if (src_width > 0 && src_height > 0 && src_stride >= src_width &&
+                (size_t)((src_height - 1) * src_stride + src_width) * sizeof(uint16_t) <= bufinfo.len)
+            {
+                src = bufinfo.buf;
+            }
+        }
+    }
+
+    if (plain && src != NULL && self->format == FRAMEBUF_RGB565)
+    {
+        mp_int_t x = mp_obj_get_int(args[2]);
+        mp_int_t y = mp_obj_get_int(args[3]);
+        mp_int_t w = src_width;
+        mp_int_t h = src_height;
+        mp_int_t sx = 0;
+        mp_int_t sy = 0;
+
+        if (!fb_clip(self, &x, &y, &w, &h, &sx, &sy))
+        {
+            return mp_const_none;
+        }
+        /* the CPU path below draws the same area */
+        fb_invalidate(self, x, y, w, h);
+        if (w * h >= FRAMEBUF_DMA2D_MIN_PIXELS)
+        {
+            dma2d_job_t job = {0};
+            job.mode = DMA2D_M2M;
+            job.fg_address = (uint32_t)(src + (sy * src_stride + sx) * sizeof(uint16_t));
+            job.fg_offset = src_stride - w;
+            job.fg_pfc = DMA2D_INPUT_RGB565;
+            job.out_address = (uint32_t)(self->buf + (y * self->stride + x) * sizeof(uint16_t));
+            job.out_offset = self->stride - w;
+            job.out_pfc = DMA2D_OUTPUT_RGB565;
+            job.width = w;
+            job.height = h;
+
+            CleanInvalidateDCacheRegion(job.fg_address, ((h - 1) * src_stride + w) * sizeof(uint16_t));
+            CleanInvalidateDCacheRegion(job.out_address, ((h - 1) * self->stride + w) * sizeof(uint16_t));
+            DMA2D_Submit(&job);
+            DMA2D_Wait();
+            return mp_const_none;
+        }
+    }
+
+    mp_obj_t inner_args[5];
+    memcpy(inner_args, args + 1, (n_args - 1) * sizeof(mp_obj_t));
+    inner_args[0] = source_obj;
+    return fb_call_inner(self, MP_QSTR_blit, n_args - 1, inner_args);
+}
+
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mp_anx7625_framebuffer_blit_obj, 4, 6, mp_anx7625_framebuffer_blit);
+
+static const mp_rom_map_elem_t mp_anx7625_framebuffer_locals_dict_table[] = {
+    {MP_ROM_QSTR(MP_QSTR_fill), MP_ROM_PTR(&mp_anx7625_framebuffer_fill_obj)},
+    {MP_ROM_QSTR(MP_QSTR_fill_rect), MP_ROM_PTR(&mp_anx7625_framebuffer_fill_rect_obj)},
+    {MP_ROM_QSTR(MP_QSTR_rect), MP_ROM_PTR(&mp_anx7625_framebuffer_rect_obj)},
+    {MP_ROM_QSTR(MP_QSTR_blit), MP_ROM_PTR(&mp_anx7625_framebuffer_blit_obj)},
+};
+
+static MP_DEFINE_CONST_DICT(mp_anx7625_framebuffer_locals_dict, mp_anx7625_framebuffer_locals_dict_table);
+
+static mp_obj_t mp_anx7625_framebuffer_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *all_args)
+{
+    mp_arg_check_num(n_args, n_kw, 4, 5, false);
+
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(all_args[0], &bufinfo, MP_BUFFER_WRITE);
+
+    /* framebuf validates the arguments and does all the CPU drawing */
+    mp_obj_t framebuf_module = mp_import_name(MP_QSTR_framebuf, mp_const_none, MP_OBJ_NEW_SMALL_INT(0));
+    mp_obj_t framebuf_type = mp_load_attr(framebuf_module, MP_QSTR_FrameBuffer);
+
+    mp_anx7625_framebuffer_t *self = mp_obj_malloc(mp_anx7625_framebuffer_t, type);
+    self->fb_obj = mp_call_function_n_kw(framebuf_type, n_args, 0, all_args);
+    self->buf_obj = all_args[0];
+    self->buf = bufinfo.buf;
+    self->width = mp_obj_get_int(all_args[1]);
+    self->height = mp_obj_get_int(all_args[2]);
+    self->format = mp_obj_get_int(all_args[3]);
+    self->stride = (n_args > 4) ? mp_obj_get_int(all_args[4]) : self->width;
+
+    return MP_OBJ_FROM_PTR(self);
+}
+
+static void mp_anx7625_framebuffer_attr(mp_obj_t obj, qstr attr, mp_obj_t *dest)
+{
+    mp_anx7625_framebuffer_t *self = MP_OBJ_TO_PTR(obj);
+    if (dest[0] == MP_OBJ_NULL)
+    {
+        const mp_obj_type_t *type = mp_obj_get_type(obj);
+        mp_map_t *locals_map = (mp_map_t *)mp_obj_dict_get_map(MP_OBJ_TYPE_GET_SLOT(type, locals_dict));
+        mp_map_elem_t *elem = mp_map_lookup(locals_map, MP_OBJ_NEW_QSTR(attr), MP_MAP_LOOKUP);
+        if (elem != NULL)
+        {
+            mp_convert_member_lookup(obj, type, elem->value, dest);
+            return;
+        }
+        /* text, pixel, line, scroll, ... stay with framebuf */
+        if (attr == MP_QSTR_text || attr == MP_QSTR_pixel || attr == MP_QSTR_line || attr == MP_QSTR_hline ||
+            attr == MP_QSTR_vline || attr == MP_QSTR_ellipse || attr == MP_QSTR_poly || attr == MP_QSTR_scroll)
+        {
+            /* where they draw is not known here, so the whole buffer is */
+            fb_invalidate(self, 0, 0, self->width, self->height);
+        }
+        mp_load_method_maybe(self->fb_obj, attr, dest);
+    }
+}
+
+static mp_int_t mp_anx7625_framebuffer_get_buffer(mp_obj_t self_obj, mp_buffer_info_t *bufinfo, mp_uint_t flags)
+{
+    mp_anx7625_framebuffer_t *self = MP_OBJ_TO_PTR(self_obj);
+    return mp_get_buffer(self->buf_obj, bufinfo, flags) ? 0 : 1;
+}
+
+MP_DEFINE_CONST_OBJ_TYPE(
+    mp_anx7625_framebuffer_type,
+    MP_QSTR_FrameBuffer,
+    MP_TYPE_FLAG_NONE,
+    make_new, mp_anx7625_framebuffer_make_new,
+    attr, mp_anx7625_framebuffer_attr,
+    buffer, mp_anx7625_framebuffer_get_buffer,
+    locals_dict, &mp_anx7625_framebuffer_locals_dict);
@@ -0,0 +1,28 @@
+/* SPDX-License-Identifier: MIT */
+
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include "py/runtime.h"
+
+/* Same values as extmod/modframebuf.c */
+#define FRAMEBUF_RGB565 (1)
+
+/* Below this many pixels the CPU beats the DMA2D set-up and cache maintenance */
+#define FRAMEBUF_DMA2D_MIN_PIXELS (512)
+
+typedef struct _mp_anx7625_framebuffer_t
+{
+    mp_obj_base_t base;
+    mp_obj_t fb_obj;
+    mp_obj_t buf_obj;
+    uint8_t *buf;
+    int32_t width;
+    int32_t height;
+    int32_t stride;
+    uint32_t format;
+} mp_anx7625_framebuffer_t;
+
+extern const mp_obj_type_t mp_anx7625_framebuffer_type;
+
+#endif /* FRAMEBUFFER_H */
@@ -0,0 +1,675 @@
+/* SPDX-License-Identifier: MIT */
+
+/*
+ * Streaming BMP, QOI and PNG decoding. Files are read through a small
+ * buffer and converted one row at a time straight into the surface; PNG
+ * data is inflated by the deflate module.
+ */
+
+#include <string.h>
+
+#include "py/stream.h"
+
+#include "anx7625.h"
+#include "image.h"
+
+/* Widest image accepted, bounds the row buffers */
+#define IMAGE_MAX_WIDTH 4096
+
+typedef struct _image_reader_t
+{
+    mp_obj_t stream;
+    size_t pos;
+    size_t len;
+    size_t offset;
+    uint8_t buf[IMAGE_CHUNK_SIZE];
+} image_reader_t;
+
+static const uint8_t image_bayer[4][4] = {
+    {0, 8, 2, 10},
+    {12, 4, 14, 6},
+    {3, 11, 1, 9},
+    {15, 7, 13, 5},
+};
+
+static inline uint32_t image_le16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t image_le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint32_t image_be32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static NORETURN void image_raise_unsupported(void)
+{
+    mp_raise_ValueError(MP_ERROR_TEXT("unsupported image"));
+}
+
+static size_t image_read_some(image_reader_t *r, uint8_t *dst, size_t n)
+{
+    if (r->pos == r->len)
+    {
+        int errcode;
+        mp_uint_t got = mp_stream_rw(r->stream, r->buf, IMAGE_CHUNK_SIZE, &errcode, MP_STREAM_RW_READ | MP_STREAM_RW_ONCE);
+        if (got == MP_STREAM_ERROR)
+        {
+            mp_raise_OSError(errcode);
+        }
+        r->pos = 0;
+        r->len = got;
+        if (got == 0)
+        {
+            return 0;
+        }
+    }
+    n = MIN(n, r->len - r->pos);
+    if (dst != NULL)
+    {
+        memcpy(dst, r->buf + r->pos, n);
+    }
+    r->pos += n;
+    r->offset += n;
+    return n;
+}
+
+/* Read exactly n bytes, or skip them when dst is NULL */
+static void image_read(image_reader_t *r, uint8_t *dst, size_t n)
+{
+    while (n > 0)
+    {
+        size_t got = image_read_some(r, dst, n);
+        if (got == 0)
+        {
+            mp_raise_ValueError(MP_ERROR_TEXT("truncated image"));
+        }
+        if (dst != NULL)
+        {
+            dst += got;
+        }
+        n -= got;
+    }
+}
+
+static uint8_t image_u8(image_reader_t *r)
+{
+    uint8_t b;
+    image_read(r, &b, 1);
+    return b;
+}
+
+/* Visible part of an image row on the target, 0 when it is off screen */
+static uint32_t image_visible(const image_target_t *t, uint32_t width)
+{
+    if (t->x >= (int32_t)t->width)
+    {
+        return 0;
+    }
+    return MIN(width, t->width - t->x);
+}
+
+/* Blend, dither and store count RGBA8888 pixels at image row y */
+static void image_put_row(const image_target_t *t, uint32_t y, const uint8_t *rgba, uint32_t count)
+{
+    int32_t dy = t->y + y;
+    if (dy >= (int32_t)t->height)
+    {
+        return;
+    }
+
+    uint16_t *line = (uint16_t *)t->address + dy * t->stride + t->x;
+    for (uint32_t i = 0; i < count; i++, rgba += 4)
+    {
+        uint32_t r = rgba[0];
+        uint32_t g = rgba[1];
+        uint32_t b = rgba[2];
+        uint32_t a = rgba[3];
+
+        if (a == 0)
+        {
+            continue;
+        }
+        if (a != 255)
+        {
+            uint16_t d = line[i];
+            uint32_t dr = ((d >> 11) << 3) | (d >> 13);
+            uint32_t dg = (((d >> 5) & 0x3F) << 2) | ((d >> 9) & 0x03);
+            uint32_t db = ((d & 0x1F) << 3) | ((d >> 2) & 0x07);
+            r = (r * a + dr * (255 - a)) / 255;
+            g = (g * a + dg * (255 - a)) / 255;
+            b = (b * a + db * (255 - a)) / 255;
+        }
+        if (t->dither)
+        {
+            uint32_t d = image_bayer[dy & 3][(t->x + i) & 3];
+            r = MIN(r + (d >> 1), 255);
+            g = MIN(g + (d >> 2), 255);
+            b = MIN(b + (d >> 1), 255);
+        }
+        line[i] = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+    }
+}
+
+/* BMP: uncompressed 1/4/8-bit paletted, 16-bit 555/565, 24 and 32-bit */
+static void image_bmp(image_reader_t *r, const image_target_t *t, uint32_t *width, uint32_t *height)
+{
+    uint8_t header[18];
+    uint8_t info[120] = {0};
+    uint8_t palette[256 * 4];
+    uint32_t masks[3] = {0};
+
+    image_read(r, header, sizeof(header));
+    uint32_t data_offset = image_le32(header + 10);
+    uint32_t dib_size = image_le32(header + 14);
+    if (dib_size < 40)
+    {
+        image_raise_unsupported();
+    }
+    /* info starts after the DIB size field */
+    uint32_t info_size = MIN(dib_size - 4, sizeof(info));
+    image_read(r, info, info_size);
+    image_read(r, NULL, dib_size - 4 - info_size);
+
+    int32_t w = (int32_t)image_le32(info + 0);
+    int32_t h = (int32_t)image_le32(info + 4);
+    uint32_t bpp = image_le16(info + 10);
+    uint32_t compression = image_le32(info + 12);
+    uint32_t colors = image_le32(info + 28);
+    bool bottom_up = h > 0;
+    h = bottom_up ? h : -h;
+
+    if (compression == 3)
+    {
+        /* BI_BITFIELDS: masks follow a 40 byte header, or are part of a larger one */
+        if (dib_size == 40)
+        {
+            image_read(r, info + 36, 12);
+        }
+        masks[0] = image_le32(info + 36);
+        masks[1] = image_le32(info + 40);
+        masks[2] = image_le32(info + 44);
+    }
+    else if (compression != 0)
+    {
+        image_raise_unsupported();
+    }
+    if (w <= 0 || w > IMAGE_MAX_WIDTH || (bpp != 1 && bpp != 4 && bpp != 8 && bpp != 16 && bpp != 24 && bpp != 32))
+    {
+        image_raise_unsupported();
+    }
+    bool rgb565 = (bpp == 16 && masks[0] == 0xF800);
+
+    if (bpp <= 8)
+    {
+        colors = (colors == 0 || colors > (1u << bpp)) ? (1u << bpp) : colors;
+        image_read(r, palette, colors * 4);
+    }
+    if (r->offset > data_offset)
+    {
+        image_raise_unsupported();
+    }
+    image_read(r, NULL, data_offset - r->offset);
+
+    *width = w;
+    *height = h;
+
+    uint32_t row_bytes = ((w * bpp + 31) / 32) * 4;
+    uint32_t count = image_visible(t, w);
+    uint8_t *row = m_new(uint8_t, row_bytes);
+    uint8_t *rgba = m_new(uint8_t, MAX(count, 1) * 4);
+
+    for (int32_t i = 0; i < h; i++)
+    {
+        image_read(r, row, row_bytes);
+        for (uint32_t x = 0; x < count; x++)
+        {
+            uint8_t *px = rgba + x * 4;
+            px[3] = 255;
+            switch (bpp)
+            {
+            case 1:
+            case 4:
+            case 8:
+            {
+                uint32_t bit = x * bpp;
+                uint32_t index = (row[bit / 8] >> (8 - bpp - (bit % 8))) & ((1 << bpp) - 1);
+                const uint8_t *c = palette + MIN(index, colors - 1) * 4;
+                px[0] = c[2];
+                px[1] = c[1];
+                px[2] = c[0];
+                break;
+            }
+            case 16:
+            {
+                uint32_t v = image_le16(row + x * 2);
+                if (rgb565)
+                {
+                    px[0] = ((v >> 11) << 3) | (v >> 13);
+                    px[1] = (((v >> 5) & 0x3F) << 2) | ((v >> 9) & 0x03);
+                }
+                else
+                {
+                    px[0] = (((v >> 10) & 0x1F) << 3) | ((v >> 12) & 0x07);
+                    px[1] = (((v >> 5) & 0x1F) << 3) | ((v >> 7) & 0x07);
+                }
+                px[2] = ((v & 0x1F) << 3) | ((v >> 2) & 0x07);
+                break;
+            }
+            default:
+            {
+                const uint8_t *p = row + x * (bpp / 8);
+                px[0] = p[2];
+                px[1] = p[1];
+                px[2] = p[0];
+                break;
+            }
+            }
+        }
+        image_put_row(t, bottom_up ? h - 1 - i : i, rgba, count);
+    }
+
+    m_del(uint8_t, row, row_bytes);
+    m_del(uint8_t, rgba, MAX(count, 1) * 4);
+}
+
+/* QOI, see https://qoiformat.org/qoi-specification.pdf */
+static void image_qoi(image_reader_t *r, const image_target_t *t, uint32_t *width, uint32_t *height)
+{
+    uint8_t header[14];
+    uint8_t index[64][4] = {{0}};
+    uint8_t px[4] = {0, 0, 0, 255};
+    uint32_t run = 0;
+
+    image_read(r, header, sizeof(header));
+    uint32_t w = image_be32(header + 4);
+    uint32_t h = image_be32(header + 8);
+    if (w == 0 || w > IMAGE_MAX_WIDTH)
+    {
+        image_raise_unsupported();
+    }
+
+    *width = w;
+    *height = h;
+
+    uint32_t count = image_visible(t, w);
+    uint8_t *rgba = m_new(uint8_t, MAX(count, 1) * 4);
+
+    for (uint32_t y = 0; y < h; y++)
+    {
+        for (uint32_t x = 0; x < w; x++)
+        {
+            if (run > 0)
+            {
+                run--;
+            }
+            else
+            {
+                uint8_t b1 = image_u8(r);
+                if (b1 == 0xFE)
+                {
+                    image_read(r, px, 3);
+                }
+                else if (b1 == 0xFF)
+                {
+                    image_read(r, px, 4);
+                }
+                else if ((b1 & 0xC0) == 0x00)
+                {
+                    memcpy(px, index[b1], 4);
+                }
+                else if ((b1 & 0xC0) == 0x40)
+                {
+                    px[0] += ((b1 >> 4) & 0x03) - 2;
+                    px[1] += ((b1 >> 2) & 0x03) - 2;
+                    px[2] += (b1 & 0x03) - 2;
+                }
+                else if ((b1 & 0xC0) == 0x80)
+                {
+                    uint8_t b2 = image_u8(r);
+                    int vg = (b1 & 0x3F) - 32;
+                    px[0] += vg - 8 + ((b2 >> 4) & 0x0F);
+                    px[1] += vg;
+                    px[2] += vg - 8 + (b2 & 0x0F);
+                }
+                else
+                {
+                    run = b1 & 0x3F;
+                }
+                memcpy(index[(px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64], px, 4);
+            }
+            if (x < count)
+            {
+                memcpy(rgba + x * 4, px, 4);
+            }
+        }
+        image_put_row(t, y, rgba, count);
+    }
+
+    m_del(uint8_t, rgba, MAX(count, 1) * 4);
+}
+
+/*
+ * Stream over the payload of consecutive IDAT chunks, handed to
+ * deflate.DeflateIO so PNG data is inflated without being loaded whole.
+ */
+typedef struct _image_idat_t
+{
+    mp_obj_base_t base;
+    image_reader_t *reader;
+    uint32_t remaining;
+    bool done;
+} image_idat_t;
+
+static mp_uint_t image_idat_read(mp_obj_t self_in, void *buf, mp_uint_t size, int *errcode)
+{
+    image_idat_t *self = MP_OBJ_TO_PTR(self_in);
+
+    while (self->remaining == 0)
+    {
+        uint8_t chunk[8];
+        if (self->done)
+        {
+            return 0;
+        }
+        /* CRC of the previous chunk, then length and type of the next */
+        image_read(self->reader, NULL, 4);
+        image_read(self->reader, chunk, 8);
+        if (memcmp(chunk + 4, "IDAT", 4) != 0)
+        {
+            self->done = true;
+            return 0;
+        }
+        self->remaining = image_be32(chunk);
+    }
+
+    mp_uint_t n = image_read_some(self->reader, buf, MIN(size, self->remaining));
+    if (n == 0)
+    {
+        mp_raise_ValueError(MP_ERROR_TEXT("truncated image"));
+    }
+    self->remaining -= n;
+    return n;
+}
+
+static const mp_stream_p_t image_idat_stream_p = {
+    .read = image_idat_read,
+};
+
+static MP_DEFINE_CONST_OBJ_TYPE(
+    image_idat_type,
+    MP_QSTR_IDAT,
+    MP_TYPE_FLAG_NONE,
+    protocol, &image_idat_stream_p);
+
+static inline uint32_t image_png_sample(const uint8_t *row, uint32_t i, uint32_t depth)
+{
+    if (depth == 16)
+    {
+        return (row[i * 2] << 8) | row[i * 2 + 1];
+    }
+    if (depth == 8)
+    {
+        return row[i];
+    }
+    uint32_t bit = i * depth;
+    return (row[bit / 8] >> (8 - depth - (bit % 8))) & ((1 << depth) - 1);
+}
+
+static inline uint8_t image_png_scale(uint32_t v, uint32_t depth)
+{
+    if (depth == 16)
+    {
+        return v >> 8;
+    }
+    return (v * 255) / ((1 << depth) - 1);
+}
+
+static inline uint8_t image_paeth(uint8_t a, uint8_t b, uint8_t c)
+{
+    int p = a + b - c;
+    int pa = p > a ? p - a : a - p;
+    int pb = p > b ? p - b : b - p;
+    int pc = p > c ? p - c : c - p;
+    if (pa <= pb && pa <= pc)
+    {
+        return a;
+    }
+    return pb <= pc ? b : c;
+}
+
+/* PNG: every colour type and bit depth, not interlaced */
+static void image_png(image_reader_t *r, const image_target_t *t, uint32_t *width, uint32_t *height)
+{
+    static const uint8_t channels_of[7] = {1, 0, 3, 1, 2, 0, 4};
+    uint8_t chunk[8];
+    uint8_t ihdr[13] = {0};
+    uint8_t palette[256 * 3] = {0};
+    uint8_t alpha[256];
+    uint32_t key[3] = {0x10000, 0x10000, 0x10000};
+    bool have_ihdr = false;
+
+    memset(alpha, 255, sizeof(alpha));
+    image_read(r, NULL, 8);
+
+    for (;;)
+    {
+        image_read(r, chunk, 8);
+        uint32_t len = image_be32(chunk);
+        if (memcmp(chunk + 4, "IDAT", 4) == 0)
+        {
+            break;
+        }
+        if (memcmp(chunk + 4, "IHDR", 4) == 0 && len == 13)
+        {
+            image_read(r, ihdr, 13);
+            have_ihdr = true;
+        }
+        else if (memcmp(chunk + 4, "PLTE", 4) == 0 && len <= sizeof(palette))
+        {
+            image_read(r, palette, len);
+        }
+        else if (memcmp(chunk + 4, "tRNS", 4) == 0 && len <= sizeof(alpha))
+        {
+            uint8_t trns[256];
+            image_read(r, trns, len);
+            if (ihdr[9] == 3)
+            {
+                memcpy(alpha, trns, len);
+            }
+            else
+            {
+                for (uint32_t i = 0; i < 3 && i * 2 + 1 < len; i++)
+                {
+                    key[i] = (trns[i * 2] << 8) | trns[i * 2 + 1];
+                }
+            }
+        }
+        else if (memcmp(chunk + 4, "IEND", 4) == 0)
+        {
+            image_raise_unsupported();
+        }
+        else
+        {
+            image_read(r, NULL, len);
+        }
+        image_read(r, NULL, 4);
+    }
+
+    uint32_t w = image_be32(ihdr);
+    uint32_t h = image_be32(ihdr + 4);
+    uint32_t depth = ihdr[8];
+    uint32_t color_type = ihdr[9];
+    uint32_t channels = color_type < sizeof(channels_of) ? channels_of[color_type] : 0;
+    if (!have_ihdr || w == 0 || w > IMAGE_MAX_WIDTH || channels == 0 || ihdr[12] != 0 ||
+        (depth != 1 && depth != 2 && depth != 4 && depth != 8 && depth != 16))
+    {
+        image_raise_unsupported();
+    }
+
+    *width = w;
+    *height = h;
+
+    image_idat_t *idat = mp_obj_malloc(image_idat_t, &image_idat_type);
+    idat->reader = r;
+    idat->remaining = image_be32(chunk);
+    idat->done = false;
+
+    mp_obj_t deflate = mp_import_name(MP_QSTR_deflate, mp_const_none, MP_OBJ_NEW_SMALL_INT(0));
+    mp_obj_t inflater_args[3] = {MP_OBJ_FROM_PTR(idat), mp_load_attr(deflate, MP_QSTR_ZLIB), MP_OBJ_NEW_SMALL_INT(IMAGE_PNG_WBITS)};
+    /* the window is the one allocation that does not scale with the rows */
+    mp_obj_t inflater = mp_call_function_n_kw(mp_load_attr(deflate, MP_QSTR_DeflateIO), 3, 0, inflater_args);
+
+    uint32_t bits = channels * depth;
+    uint32_t stride = (w * bits + 7) / 8;
+    uint32_t bpp = MAX(bits / 8, 1);
+    uint32_t count = image_visible(t, w);
+    uint8_t *cur = m_new(uint8_t, stride + 1);
+    uint8_t *prev = m_new0(uint8_t, stride + 1);
+    uint8_t *rgba = m_new(uint8_t, MAX(count, 1) * 4);
+
+    for (uint32_t y = 0; y < h; y++)
+    {
+        int errcode;
+        mp_uint_t n = mp_stream_rw(inflater, cur, stride + 1, &errcode, MP_STREAM_RW_READ);
+        if (n == MP_STREAM_ERROR)
+        {
+            mp_raise_OSError(errcode);
+        }
+        if (n != stride + 1)
+        {
+            mp_raise_ValueError(MP_ERROR_TEXT("truncated image"));
+        }
+
+        /* undo the row filter, byte 0 is the filter type */
+        uint8_t *p = cur + 1;
+        const uint8_t *q = prev + 1;
+        for (uint32_t i = 0; i < stride; i++)
+        {
+            uint8_t a = i >= bpp ? p[i - bpp] : 0;
+            uint8_t c = i >= bpp ? q[i - bpp] : 0;
+            switch (cur[0])
+            {
+            case 1:
+                p[i] += a;
+                break;
+            case 2:
+                p[i] += q[i];
+                break;
+            case 3:
+                p[i] += (a + q[i]) / 2;
+                break;
+            case 4:
+                p[i] += image_paeth(a, q[i], c);
+                break;
+            }
+        }
+
+        for (uint32_t x = 0; x < count; x++)
+        {
+            uint8_t *px = rgba + x * 4;
+            uint32_t s0 = image_png_sample(p, x * channels, depth);
+            switch (color_type)
+            {
+            case 0:
+                px[0] = px[1] = px[2] = image_png_scale(s0, depth);
+                px[3] = s0 == key[0] ? 0 : 255;
+                break;
+            case 2:
+            {
+                uint32_t s1 = image_png_sample(p, x * 3 + 1, depth);
+                uint32_t s2 = image_png_sample(p, x * 3 + 2, depth);
+                px[0] = image_png_scale(s0, depth);
+                px[1] = image_png_scale(s1, depth);
+                px[2] = image_png_scale(s2, depth);
+                px[3] = (s0 == key[0] && s1 == key[1] && s2 == key[2]) ? 0 : 255;
+                break;
+            }
+            case 3:
+                memcpy(px, palette + s0 * 3, 3);
+                px[3] = alpha[s0];
+                break;
+            case 4:
+                px[0] = px[1] = px[2] = image_png_scale(s0, depth);
+                px[3] = image_png_scale(image_png_sample(p, x * 2 + 1, depth), depth);
+                break;
+            default:
+                px[0] = image_png_scale(s0, depth);
+                px[1] = image_png_scale(image_png_sample(p, x * 4 + 1, depth), depth);
+                px[2] = image_png_scale(image_png_sample(p, x * 4 + 2, depth), depth);
+                px[3] = image_png_scale(image_png_sample(p, x * 4 + 3, depth), depth);
+                break;
+            }
+        }
+        image_put_row(t, y, rgba, count);
+
+        uint8_t *swap = prev;
+        prev = cur;
+        cur = swap;
+    }
+
+    m_del(uint8_t, cur, stride + 1);
+    m_del(uint8_t, prev, stride + 1);
+    m_del(uint8_t, rgba, MAX(count, 1) * 4);
+}
+
+void image_load(mp_obj_t stream, const image_target_t *target, uint32_t *width, uint32_t *height)
+{
+    image_reader_t reader = {.stream = stream};
+    uint8_t magic[4];
+
+    *width = 0;
+    *height = 0;
+
+    /* look at the signature without consuming it */
+    while (reader.len < sizeof(magic))
+    {
+        int errcode;
+        mp_uint_t n = mp_stream_rw(stream, reader.buf + reader.len, IMAGE_CHUNK_SIZE - reader.len, &errcode, MP_STREAM_RW_READ | MP_STREAM_RW_ONCE);
+        if (n == MP_STREAM_ERROR)
+        {
+            mp_raise_OSError(errcode);
+        }
+        if (n == 0)
+        {
+            mp_raise_ValueError(MP_ERROR_TEXT("truncated image"));
+        }
+        reader.len += n;
+    }
+    memcpy(magic, reader.buf, sizeof(magic));
+
+    /* CPU writes must not race a DMA2D transfer, and blending reads the surface */
+    DMA2D_Wait();
+    CleanInvalidateDCacheRegion(target->address, target->stride * target->height * sizeof(uint16_t));
+
+    if (magic[0] == 'B' && magic[1] == 'M')
+    {
+        image_bmp(&reader, target, width, height);
+    }
+    else if (memcmp(magic, "qoif", 4) == 0)
+    {
+        image_qoi(&reader, target, width, height);
+    }
+    else if (memcmp(magic, "\x89PNG", 4) == 0)
+    {
+        image_png(&reader, target, width, height);
+    }
+    else
+    {
+        image_raise_unsupported();
+    }
+
+    /* make the rows visible to the LTDC and DMA2D */
+    uint32_t count = image_visible(target, *width);
+    if (count > 0 && target->y < (int32_t)target->height && *height > 0)
+    {
+        uint32_t rows = MIN(*height, target->height - target->y);
+        uint32_t address = target->address + (target->y * target->stride + target->x) * sizeof(uint16_t);
+        CleanInvalidateDCacheRegion(address, ((rows - 1) * target->stride + count) * sizeof(uint16_t));
+    }
+}
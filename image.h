@@ -0,0 +1,43 @@
+/* SPDX-License-Identifier: MIT */
+
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "py/runtime.h"
+
+/* Bytes read from the stream at a time */
+#define IMAGE_CHUNK_SIZE 512
+
+/*
+ * Largest PNG deflate window, as log2 of its size. 15 takes the 32 KB one
+ * most encoders use; less saves heap but rejects streams written with a
+ * larger window.
+ */
+#ifndef IMAGE_PNG_WBITS
+#define IMAGE_PNG_WBITS 15
+#endif
+
+/* RGB565 surface an image is decoded onto, with the image origin on it */
+typedef struct _image_target_t
+{
+    uint32_t address;
+    uint32_t stride;
+    uint32_t width;
+    uint32_t height;
+    int32_t x;
+    int32_t y;
+    bool dither;
+} image_target_t;
+
+/*
+ * Decode a BMP, QOI or PNG read from a stream row by row onto the target.
+ * Only a few rows worth of memory is used whatever the image size. Pixels
+ * with alpha are blended over the surface. Raises on malformed or
+ * unsupported files.
+ */
+void image_load(mp_obj_t stream, const image_target_t *target, uint32_t *width, uint32_t *height);
+
+#endif /* IMAGE_H */
@@ -0,0 +1,232 @@
+/* SPDX-License-Identifier: MIT */
+
+/*
+ * JPEG decoding on the STM32H7 codec. The codec writes one MCU row at a
+ * time into a strip; while it fills the other strip the DMA2D converts the
+ * finished one from YCbCr straight into the surface.
+ */
+
+#include <string.h>
+
+#include "py/mphal.h"
+#include "py/stream.h"
+
+#include "anx7625.h"
+#include "jpeg.h"
+
+static JPEG_HandleTypeDef jpeg = {0};
+static jpeg_decoder_t *jpeg_active = NULL;
+
+static void jpeg_fill(jpeg_decoder_t *dec)
+{
+    int errcode;
+    mp_uint_t n = mp_stream_rw(dec->stream, dec->chunk, JPEG_CHUNK_SIZE, &errcode, MP_STREAM_RW_READ);
+    if (n == MP_STREAM_ERROR)
+    {
+        n = 0;
+    }
+    dec->data = dec->chunk;
+    dec->len = n;
+}
+
+static void jpeg_convert_gray(jpeg_decoder_t *dec, const uint8_t *strip, uint32_t out, uint32_t w, uint32_t rows)
+{
+    const pixel_format_t *format = getPixelFormat();
+
+    for (uint32_t r = 0; r < rows; r++)
+    {
+        uint8_t *line = (uint8_t *)(out + r * dec->dst_stride * format->bpp);
+        for (uint32_t px = 0; px < w; px++)
+        {
+            /* 8x8 blocks of luma, one after the other */
+            uint8_t l = strip[(px / 8) * 64 + r * 8 + (px & 7)];
+            switch (format->out)
+            {
+            case DMA2D_OUTPUT_ARGB8888:
+                ((uint32_t *)line)[px] = 0xFF000000 | (l << 16) | (l << 8) | l;
+                break;
+            case DMA2D_OUTPUT_RGB888:
+                line[px * 3] = l;
+                line[px * 3 + 1] = l;
+                line[px * 3 + 2] = l;
+                break;
+            case DMA2D_OUTPUT_ARGB4444:
+                ((uint16_t *)line)[px] = 0xF000 | (l >> 4) * 0x111;
+                break;
+            default:
+                ((uint16_t *)line)[px] = ((l >> 3) << 11) | ((l >> 2) << 5) | (l >> 3);
+                break;
+            }
+        }
+    }
+    CleanInvalidateDCacheRegion(out, ((rows - 1) * dec->dst_stride + w) * format->bpp);
+}
+
+static void jpeg_convert(jpeg_decoder_t *dec, const uint8_t *strip)
+{
+    int32_t top = dec->y + dec->row;
+    uint32_t rows = MIN(dec->mcu_height, dec->height - dec->row);
+
+    dec->row += dec->mcu_height;
+    if (top >= (int32_t)dec->dst_height || dec->x >= (int32_t)dec->dst_width)
+    {
+        return;
+    }
+
+    uint32_t w = MIN(dec->width, dec->dst_width - dec->x);
+    uint32_t bpp = getBytesPerPixel();
+    uint32_t out = dec->dst_address + (top * dec->dst_stride + dec->x) * bpp;
+    rows = MIN(rows, dec->dst_height - top);
+
+    if (dec->color_space == JPEG_GRAYSCALE_COLORSPACE)
+    {
+        jpeg_convert_gray(dec, strip, out, w, rows);
+        return;
+    }
+
+    dma2d_job_t job = {0};
+    job.mode = DMA2D_M2M_PFC;
+    job.fg_address = (uint32_t)strip;
+    /* MCU padding plus whatever hangs off the right edge */
+    job.fg_offset = ALIGN(dec->width, dec->mcu_width) - w;
+    job.fg_pfc = DMA2D_INPUT_YCBCR | (dec->css << DMA2D_FGPFCCR_CSS_Pos);
+    job.out_address = out;
+    job.out_offset = dec->dst_stride - w;
+    job.out_pfc = getPixelFormat()->out;
+    job.width = w;
+    job.height = rows;
+
+    CleanInvalidateDCacheRegion(job.fg_address, dec->strip_bytes);
+    CleanInvalidateDCacheRegion(job.out_address, ((rows - 1) * dec->dst_stride + w) * bpp);
+    DMA2D_Submit(&job);
+}
+
+void HAL_JPEG_InfoReadyCallback(JPEG_HandleTypeDef *hjpeg, JPEG_ConfTypeDef *pInfo)
+{
+    jpeg_decoder_t *dec = jpeg_active;
+    uint32_t mcu_bytes = 0;
+
+    dec->width = pInfo->ImageWidth;
+    dec->height = pInfo->ImageHeight;
+    dec->color_space = pInfo->ColorSpace;
+
+    if (pInfo->ColorSpace == JPEG_GRAYSCALE_COLORSPACE)
+    {
+        dec->mcu_width = 8;
+        dec->mcu_height = 8;
+        mcu_bytes = 64;
+    }
+    else if (pInfo->ColorSpace == JPEG_YCBCR_COLORSPACE)
+    {
+        switch (pInfo->ChromaSubsampling)
+        {
+        case JPEG_420_SUBSAMPLING:
+            dec->mcu_width = 16;
+            dec->mcu_height = 16;
+            dec->css = DMA2D_CSS_420;
+            mcu_bytes = 384;
+            break;
+        case JPEG_422_SUBSAMPLING:
+            dec->mcu_width = 16;
+            dec->mcu_height = 8;
+            dec->css = DMA2D_CSS_422;
+            mcu_bytes = 256;
+            break;
+        default:
+            dec->mcu_width = 8;
+            dec->mcu_height = 8;
+            dec->css = DMA2D_NO_CSS;
+            mcu_bytes = 192;
+            break;
+        }
+    }
+
+    dec->strip_bytes = (ALIGN(dec->width, dec->mcu_width) / dec->mcu_width) * mcu_bytes;
+    if (mcu_bytes == 0 || dec->strip_bytes > JPEG_STRIP_SIZE)
+    {
+        /* let the codec run to the end, its output is dropped */
+        dec->error = JPEG_ERR_UNSUPPORTED;
+        dec->strip_bytes = JPEG_STRIP_SIZE;
+    }
+
+    HAL_JPEG_ConfigOutputBuffer(hjpeg, dec->strip[0], dec->strip_bytes);
+}
+
+void HAL_JPEG_GetDataCallback(JPEG_HandleTypeDef *hjpeg, uint32_t NbDecodedData)
+{
+    jpeg_decoder_t *dec = jpeg_active;
+
+    dec->data += NbDecodedData;
+    dec->len -= NbDecodedData;
+    if (dec->len == 0 && dec->stream != MP_OBJ_NULL)
+    {
+        jpeg_fill(dec);
+    }
+    HAL_JPEG_ConfigInputBuffer(hjpeg, (uint8_t *)dec->data, dec->len);
+}
+
+void HAL_JPEG_DataReadyCallback(JPEG_HandleTypeDef *hjpeg, uint8_t *pDataOut, uint32_t OutDataLength)
+{
+    jpeg_decoder_t *dec = jpeg_active;
+
+    if (dec->error == 0)
+    {
+        /* time the codec spends held up by the DMA2D */
+        mp_uint_t start = mp_hal_ticks_us();
+        jpeg_convert(dec, pDataOut);
+        dec->convert_us += mp_hal_ticks_us() - start;
+    }
+
+    /*
+     * The DMA2D job that last read the other strip finished before the one
+     * just submitted could start, so the codec may overwrite it.
+     */
+    dec->current ^= 1;
+    HAL_JPEG_ConfigOutputBuffer(hjpeg, dec->strip[dec->current], dec->strip_bytes);
+}
+
+void HAL_JPEG_ErrorCallback(JPEG_HandleTypeDef *hjpeg)
+{
+    jpeg_active->error = JPEG_ERR_DECODE;
+}
+
+int jpeg_decode(jpeg_decoder_t *dec)
+{
+    if (jpeg.State == HAL_JPEG_STATE_RESET)
+    {
+        __HAL_RCC_JPGDECEN_CLK_ENABLE();
+        jpeg.Instance = JPEG;
+        if (HAL_JPEG_Init(&jpeg) != HAL_OK)
+        {
+            ANXERROR("JPEG init failed.\n");
+            return JPEG_ERR_DECODE;
+        }
+    }
+
+    dec->width = 0;
+    dec->height = 0;
+    dec->row = 0;
+    dec->current = 0;
+    dec->convert_us = 0;
+    dec->strip_bytes = JPEG_STRIP_SIZE;
+    dec->error = 0;
+    if (dec->stream != MP_OBJ_NULL)
+    {
+        jpeg_fill(dec);
+    }
+
+    jpeg_active = dec;
+    HAL_StatusTypeDef status = HAL_JPEG_Decode(&jpeg, (uint8_t *)dec->data, dec->len, dec->strip[0], JPEG_STRIP_SIZE, JPEG_TIMEOUT);
+    jpeg_active = NULL;
+
+    /* the last strip may still be converting */
+    mp_uint_t start = mp_hal_ticks_us();
+    DMA2D_Wait();
+    dec->convert_us += mp_hal_ticks_us() - start;
+
+    if (status != HAL_OK && dec->error == 0)
+    {
+        dec->error = JPEG_ERR_DECODE;
+    }
+    return dec->error;
+}
@@ -0,0 +1,63 @@
+/* SPDX-License-Identifier: MIT */
+
+#ifndef JPEG_H
+#define JPEG_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "py/runtime.h"
+
+/* Widest image the strip buffers are sized for */
+#define JPEG_MAX_WIDTH 1280
+/* One MCU row of a 4:4:4 or 4:2:0 image is 24 bytes per (aligned) column */
+#define JPEG_STRIP_SIZE (24 * JPEG_MAX_WIDTH)
+/* Input chunk read from a stream at a time */
+#define JPEG_CHUNK_SIZE (4 * 1024)
+#define JPEG_TIMEOUT 5000
+
+#define JPEG_ERR_DECODE (-1)
+#define JPEG_ERR_UNSUPPORTED (-2)
+
+/*
+ * Decode state. The caller owns the buffers so a player can keep them
+ * across frames: two MCU-row strips of JPEG_STRIP_SIZE bytes, filled by
+ * the codec and converted by the DMA2D in ping-pong, and a chunk of
+ * JPEG_CHUNK_SIZE bytes when reading from a stream.
+ */
+typedef struct _jpeg_decoder_t
+{
+    uint8_t *strip[2];
+    uint8_t *chunk;
+
+    /* input: a memory buffer or a stream */
+    mp_obj_t stream;
+    const uint8_t *data;
+    size_t len;
+
+    /* output: a surface in the framebuffer format and the image origin on it */
+    uint32_t dst_address;
+    uint32_t dst_stride;
+    uint32_t dst_width;
+    uint32_t dst_height;
+    int32_t x;
+    int32_t y;
+
+    /* filled in while decoding */
+    uint32_t width;
+    uint32_t height;
+    uint32_t mcu_width;
+    uint32_t mcu_height;
+    uint32_t strip_bytes;
+    uint32_t color_space;
+    uint32_t css;
+    uint32_t row;
+    uint32_t current;
+    uint32_t convert_us;
+    int error;
+} jpeg_decoder_t;
+
+/* Returns 0 once the whole image is on the surface or a JPEG_ERR_* code */
+int jpeg_decode(jpeg_decoder_t *dec);
+
+#endif /* JPEG_H */
@@ -6,9 +6,18 @@ CFLAGS_USERMOD += -I$(MOD_ANX7625_DIR)
 SRC_USERMOD += $(MOD_ANX7625_DIR)/modanx7625.c
 SRC_USERMOD += $(MOD_ANX7625_DIR)/anx7625.c
 SRC_USERMOD += $(MOD_ANX7625_DIR)/edid.c
+SRC_USERMOD += $(MOD_ANX7625_DIR)/drawlist.c
+SRC_USERMOD += $(MOD_ANX7625_DIR)/framebuffer.c
+SRC_USERMOD += $(MOD_ANX7625_DIR)/jpeg.c
+SRC_USERMOD += $(MOD_ANX7625_DIR)/mjpeg.c
+SRC_USERMOD += $(MOD_ANX7625_DIR)/image.c
+SRC_USERMOD += $(MOD_ANX7625_DIR)/bundle.c
+SRC_USERMOD += $(MOD_ANX7625_DIR)/font.c
+SRC_USERMOD += $(MOD_ANX7625_DIR)/stats.c
 
 HAL_SRC_C += $(addprefix $(STM32LIB_HAL_BASE)/Src/stm32$(MCU_SERIES)xx_,\
 	hal_ltdc.c \
 	hal_dma2d.c \
 	hal_dsi.c \
+	hal_jpeg.c \
 )
@@ -0,0 +1,318 @@
+/* SPDX-License-Identifier: MIT */
+
+/*
+ * MJPEG playback: a stream of concatenated JPEG frames is split on the
+ * SOI/EOI markers into a fixed buffer, walking the segments so that the
+ * EOI of an embedded thumbnail does not end the frame, each frame is decoded into the back
+ * buffer while the previous one is on screen, then flipped at its time.
+ */
+
+#include <string.h>
+
+#include "py/mphal.h"
+#include "py/stream.h"
+
+#include "anx7625.h"
+#include "mjpeg.h"
+
+/*
+ * Walk the markers from self->scan, skipping each segment by its length
+ * and the entropy-coded data after SOS up to the next marker. Returns
+ * the length of the frame at its EOI, 0 when more data is needed.
+ */
+static size_t mjpeg_walk(mp_anx7625_mjpeg_t *self)
+{
+    size_t i = self->scan;
+    while (i + 1 < self->fill)
+    {
+        uint8_t marker = self->buf[i + 1];
+        if (self->entropy)
+        {
+            /* stuffed 0xFF00 and restart markers belong to the data */
+            if (self->buf[i] != 0xFF || marker == 0x00 || (marker >= 0xD0 && marker <= 0xD7))
+            {
+                i++;
+                continue;
+            }
+            self->entropy = false;
+        }
+        if (self->buf[i] != 0xFF || marker == 0xFF)
+        {
+            /* fill bytes, or garbage to resynchronise on */
+            i++;
+            continue;
+        }
+        if (marker == 0xD9)
+        {
+            self->scan = 0;
+            return i + 2;
+        }
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8))
+        {
+            i += 2;
+            continue;
+        }
+        if (i + 4 > self->fill)
+        {
+            break;
+        }
+        size_t len = (self->buf[i + 2] << 8) | self->buf[i + 3];
+        if (len < 2)
+        {
+            i += 2;
+            continue;
+        }
+        /* an APPn thumbnail with its own EOI is stepped over here */
+        i += 2 + len;
+        self->entropy = (marker == 0xDA);
+    }
+    /* may point past the data when a segment is not all read yet */
+    self->scan = i;
+    return 0;
+}
+
+/* Length of the frame at the start of the buffer, 0 at the end of the stream */
+static size_t mjpeg_next_frame(mp_anx7625_mjpeg_t *self)
+{
+    for (;;)
+    {
+        if (self->scan == 0)
+        {
+            /* drop anything before SOI (multipart headers, padding) */
+            size_t i = 0;
+            while (i + 1 < self->fill && !(self->buf[i] == 0xFF && self->buf[i + 1] == 0xD8))
+            {
+                i++;
+            }
+            memmove(self->buf, self->buf + i, self->fill - i);
+            self->fill -= i;
+            if (self->fill >= 2)
+            {
+                self->scan = 2;
+                self->entropy = false;
+            }
+        }
+
+        if (self->scan != 0)
+        {
+            size_t len = mjpeg_walk(self);
+            if (len != 0)
+            {
+                return len;
+            }
+        }
+
+        if (self->fill == self->size)
+        {
+            mp_raise_ValueError(MP_ERROR_TEXT("frame larger than buffer"));
+        }
+
+        int errcode;
+        mp_uint_t n = mp_stream_rw(self->stream_obj, self->buf + self->fill, self->size - self->fill, &errcode, MP_STREAM_RW_READ | MP_STREAM_RW_ONCE);
+        if (n == MP_STREAM_ERROR)
+        {
+            mp_raise_OSError(errcode);
+        }
+        if (n == 0)
+        {
+            return 0;
+        }
+        self->fill += n;
+    }
+}
+
+static void mjpeg_consume(mp_anx7625_mjpeg_t *self, size_t len)
+{
+    memmove(self->buf, self->buf + len, self->fill - len);
+    self->fill -= len;
+    self->scan = 0;
+    self->entropy = false;
+}
+
+static mp_obj_t mp_anx7625_mjpeg_play(size_t n_args, const mp_obj_t *args)
+{
+    mp_anx7625_mjpeg_t *self = MP_OBJ_TO_PTR(args[0]);
+    mp_int_t count = (n_args > 1) ? mp_obj_get_int(args[1]) : 0;
+    mp_int_t presented = 0;
+    mp_uint_t start = mp_hal_ticks_us();
+
+    CheckDisplayStarted();
+    CheckDirectColorFramebuffer();
+    for (uint32_t n = 0; count <= 0 || presented < count; n++)
+    {
+        size_t len = mjpeg_next_frame(self);
+        if (len == 0)
+        {
+            break;
+        }
+
+        mp_uint_t due = start + n * self->period_us;
+        if ((mp_int_t)(mp_hal_ticks_us() - due) > (mp_int_t)self->period_us)
+        {
+            /* more than a frame late: skip it rather than fall further behind */
+            self->dropped++;
+            mjpeg_consume(self, len);
+            continue;
+        }
+
+        self->dec.data = self->buf;
+        self->dec.len = len;
+        /* run a deferred blank fill before the frame lands, not after */
+        PrepareDrawBuffer();
+        /* read per frame, set_mode() may have changed it */
+        self->dec.dst_address = getCurrentFrameBuffer();
+        self->dec.dst_stride = getXSize();
+        self->dec.dst_width = getXSize();
+        self->dec.dst_height = getYSize();
+
+        mp_uint_t t0 = mp_hal_ticks_us();
+        int ret = jpeg_decode(&self->dec);
+        mp_uint_t t1 = mp_hal_ticks_us();
+        mjpeg_consume(self, len);
+
+        if (ret < 0)
+        {
+            self->dropped++;
+            continue;
+        }
+        self->convert_us = self->dec.convert_us;
+        self->decode_us = (t1 - t0) - self->dec.convert_us;
+        InvalidateArea(self->dec.x, self->dec.y, self->dec.width, self->dec.height);
+
+        /* hold the frame until its time, the flip then waits for vblank */
+        mp_int_t early = (mp_int_t)(due - mp_hal_ticks_us());
+        if (early > 0)
+        {
+            mp_hal_delay_us(early);
+        }
+
+        mp_uint_t t2 = mp_hal_ticks_us();
+        drawCurrentFrameBuffer();
+        self->present_us = mp_hal_ticks_us() - t2;
+
+        self->frames++;
+        presented++;
+        mp_handle_pending(true);
+    }
+
+    return mp_obj_new_int(presented);
+}
+
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mp_anx7625_mjpeg_play_obj, 1, 2, mp_anx7625_mjpeg_play);
+
+static const mp_rom_map_elem_t mp_anx7625_mjpeg_locals_dict_table[] = {
+    {MP_ROM_QSTR(MP_QSTR_play), MP_ROM_PTR(&mp_anx7625_mjpeg_play_obj)},
+    {MP_ROM_QSTR(MP_QSTR_frames), MP_ROM_PTR(mp_const_none)},
+    {MP_ROM_QSTR(MP_QSTR_dropped), MP_ROM_PTR(mp_const_none)},
+    {MP_ROM_QSTR(MP_QSTR_decode_us), MP_ROM_PTR(mp_const_none)},
+    {MP_ROM_QSTR(MP_QSTR_convert_us), MP_ROM_PTR(mp_const_none)},
+    {MP_ROM_QSTR(MP_QSTR_present_us), MP_ROM_PTR(mp_const_none)},
+};
+
+static MP_DEFINE_CONST_DICT(mp_anx7625_mjpeg_locals_dict, mp_anx7625_mjpeg_locals_dict_table);
+
+static mp_obj_t mp_anx7625_mjpeg_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *all_args)
+{
+    enum
+    {
+        ARG_stream,
+        ARG_fps,
+        ARG_x,
+        ARG_y,
+        ARG_buffer_size,
+    };
+
+    static const mp_arg_t allowed_args[] = {
+        {MP_QSTR_stream, MP_ARG_OBJ | MP_ARG_REQUIRED, {.u_obj = MP_OBJ_NULL}},
+        {MP_QSTR_fps, MP_ARG_INT | MP_ARG_KW_ONLY, {.u_int = 25}},
+        {MP_QSTR_x, MP_ARG_INT | MP_ARG_KW_ONLY, {.u_int = 0}},
+        {MP_QSTR_y, MP_ARG_INT | MP_ARG_KW_ONLY, {.u_int = 0}},
+        {MP_QSTR_buffer_size, MP_ARG_INT | MP_ARG_KW_ONLY, {.u_int = MJPEG_BUFFER_SIZE}},
+    };
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all_kw_array(n_args, n_kw, all_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    mp_get_stream_raise(args[ARG_stream].u_obj, MP_STREAM_OP_READ);
+
+    if (args[ARG_fps].u_int <= 0 || args[ARG_buffer_size].u_int <= 0)
+    {
+        mp_raise_ValueError(MP_ERROR_TEXT("fps and buffer_size must be positive"));
+    }
+    if (args[ARG_x].u_int < 0 || args[ARG_y].u_int < 0)
+    {
+        mp_raise_ValueError(MP_ERROR_TEXT("image origin must be on screen"));
+    }
+
+    /* every buffer is allocated here, playback itself does not allocate */
+    mp_anx7625_mjpeg_t *self = mp_obj_malloc(mp_anx7625_mjpeg_t, type);
+    self->stream_obj = args[ARG_stream].u_obj;
+    self->size = args[ARG_buffer_size].u_int;
+    self->buf = m_new(uint8_t, self->size);
+    self->fill = 0;
+    self->scan = 0;
+    self->entropy = false;
+    self->period_us = 1000000 / args[ARG_fps].u_int;
+    self->frames = 0;
+    self->dropped = 0;
+    self->decode_us = 0;
+    self->convert_us = 0;
+    self->present_us = 0;
+
+    memset(&self->dec, 0, sizeof(self->dec));
+    self->dec.stream = MP_OBJ_NULL;
+    self->dec.strip[0] = m_new(uint8_t, 2 * JPEG_STRIP_SIZE);
+    self->dec.strip[1] = self->dec.strip[0] + JPEG_STRIP_SIZE;
+    self->dec.x = args[ARG_x].u_int;
+    self->dec.y = args[ARG_y].u_int;
+
+    return MP_OBJ_FROM_PTR(self);
+}
+
+static void mp_anx7625_mjpeg_attr(mp_obj_t obj, qstr attr, mp_obj_t *dest)
+{
+    mp_anx7625_mjpeg_t *self = MP_OBJ_TO_PTR(obj);
+    if (dest[0] == MP_OBJ_NULL)
+    {
+        const mp_obj_type_t *type = mp_obj_get_type(obj);
+        mp_map_t *locals_map = (mp_map_t *)mp_obj_dict_get_map(MP_OBJ_TYPE_GET_SLOT(type, locals_dict));
+        mp_map_elem_t *elem = mp_map_lookup(locals_map, MP_OBJ_NEW_QSTR(attr), MP_MAP_LOOKUP);
+        if (elem != NULL)
+        {
+            if (attr == MP_QSTR_frames)
+            {
+                dest[0] = mp_obj_new_int_from_uint(self->frames);
+                return;
+            }
+            if (attr == MP_QSTR_dropped)
+            {
+                dest[0] = mp_obj_new_int_from_uint(self->dropped);
+                return;
+            }
+            if (attr == MP_QSTR_decode_us)
+            {
+                dest[0] = mp_obj_new_int_from_uint(self->decode_us);
+                return;
+            }
+            if (attr == MP_QSTR_convert_us)
+            {
+                dest[0] = mp_obj_new_int_from_uint(self->convert_us);
+                return;
+            }
+            if (attr == MP_QSTR_present_us)
+            {
+                dest[0] = mp_obj_new_int_from_uint(self->present_us);
+                return;
+            }
+            mp_convert_member_lookup(obj, type, elem->value, dest);
+        }
+    }
+}
+
+MP_DEFINE_CONST_OBJ_TYPE(
+    mp_anx7625_mjpeg_type,
+    MP_QSTR_MJPEG,
+    MP_TYPE_FLAG_NONE,
+    make_new, mp_anx7625_mjpeg_make_new,
+    attr, mp_anx7625_mjpeg_attr,
+    locals_dict, &mp_anx7625_mjpeg_locals_dict);
@@ -0,0 +1,33 @@
+/* SPDX-License-Identifier: MIT */
+
+#ifndef MJPEG_H
+#define MJPEG_H
+
+#include "py/runtime.h"
+
+#include "jpeg.h"
+
+/* Default size of the buffer holding one compressed frame */
+#define MJPEG_BUFFER_SIZE (128 * 1024)
+
+typedef struct _mp_anx7625_mjpeg_t
+{
+    mp_obj_base_t base;
+    mp_obj_t stream_obj;
+    uint8_t *buf;
+    size_t size;
+    size_t fill;
+    size_t scan;
+    bool entropy;
+    jpeg_decoder_t dec;
+    uint32_t period_us;
+    uint32_t frames;
+    uint32_t dropped;
+    uint32_t decode_us;
+    uint32_t convert_us;
+    uint32_t present_us;
+} mp_anx7625_mjpeg_t;
+
+extern const mp_obj_type_t mp_anx7625_mjpeg_type;
+
+#endif /* MJPEG_H */
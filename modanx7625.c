@@ -39,105 +39,1308 @@
 #include "py/objtype.h"
 #include "py/objstr.h"
 #include "py/objint.h"
+#include "py/objarray.h"
+#include "py/stream.h"
 #include "pin.h"
 #include "extmod/modmachine.h"
+#include "shared/runtime/softtimer.h"
 
 #include "anx7625.h"
+#include "drawlist.h"
+#include "framebuffer.h"
+#include "jpeg.h"
+#include "mjpeg.h"
+#include "image.h"
+#include "bundle.h"
+#include "font.h"
+#include "stats.h"
 
 const mp_obj_type_t mp_anx7625_type;
 mp_anx7625_t anx7625_object = {0};
 mp_anx7625_t *anx7625_obj = &anx7625_object;
 
+/* asyncio polls bring-up this often while awaiting ready() */
+#define READY_POLL_MS 20
+
+/* Hot-plug polling period unless given to on_hotplug() */
+#define HOTPLUG_PERIOD_MS 500
+
+/* Kept on the GC heap so a soft reset drops it from the timer queue */
+MP_REGISTER_ROOT_POINTER(struct _soft_timer_entry_t *anx7625_bringup_timer);
+MP_REGISTER_ROOT_POINTER(struct _soft_timer_entry_t *anx7625_hotplug_timer);
+MP_REGISTER_ROOT_POINTER(mp_obj_t anx7625_hotplug_callback);
+MP_REGISTER_ROOT_POINTER(mp_obj_t anx7625_hotplug_alert);
+MP_REGISTER_ROOT_POINTER(mp_obj_t anx7625_line_callback);
+MP_REGISTER_ROOT_POINTER(mp_obj_t anx7625_line_guard);
+
 static bool mp_obj_is_machine_i2c(mp_obj_t i2c)
 {
-    const mp_obj_type_t *i2c_type = mp_obj_get_type(i2c);
-    if (i2c_type->name != MP_QSTR_I2C)
+    const mp_obj_type_t *i2c_type = mp_obj_get_type(i2c);
+    if (i2c_type->name != MP_QSTR_I2C)
+    {
+        return false;
+    }
+    const mp_machine_i2c_p_t *i2c_p = (mp_machine_i2c_p_t *)MP_OBJ_TYPE_GET_SLOT(i2c_type, protocol);
+    return (i2c_p != NULL && i2c_p->transfer != NULL);
+}
+
+static mp_obj_t mp_anx7625_image(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    enum
+    {
+        ARG_buffer,
+        ARG_width,
+        ARG_height,
+        ARG_x,
+        ARG_y,
+    };
+    static const mp_arg_t allowed_args[] = {
+        {MP_QSTR_buffer, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL}},
+        {MP_QSTR_width, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0}},
+        {MP_QSTR_height, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0}},
+        {MP_QSTR_x, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0}},
+        {MP_QSTR_y, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0}},
+    };
+
+    mp_anx7625_t *self = MP_OBJ_TO_PTR(args[0]);
+    (void)self;
+
+    mp_arg_val_t vals[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, vals);
+    CheckDisplayStarted();
+
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(vals[ARG_buffer].u_obj, &bufinfo, MP_BUFFER_READ);
+
+    mp_int_t width = vals[ARG_width].u_int;
+    mp_int_t height = vals[ARG_height].u_int;
+    mp_int_t x = vals[ARG_x].u_int;
+    mp_int_t y = vals[ARG_y].u_int;
+    mp_int_t buffer_address = (uintptr_t)bufinfo.buf;
+    uint32_t offsetPos = (x + (getXSize() * y)) * getBytesPerPixel();
+    /* sources match the framebuffer format */
+    uint32_t format = getPixelFormat()->dma2d;
+
+    InvalidateArea(x, y, width, height);
+    DrawImage((void *)buffer_address, (void *)(getDrawFrameBuffer() + offsetPos), width, height, format);
+    return mp_const_none;
+}
+
+static MP_DEFINE_CONST_FUN_OBJ_KW(mp_anx7625_image_obj, 1, mp_anx7625_image);
+
+static mp_obj_t mp_anx7625_palette(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    enum
+    {
+        ARG_colors,
+        ARG_vblank,
+    };
+    static const mp_arg_t allowed_args[] = {
+        {MP_QSTR_colors, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL}},
+        {MP_QSTR_vblank, MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = true}},
+    };
+
+    mp_anx7625_t *self = MP_OBJ_TO_PTR(args[0]);
+    (void)self;
+
+    mp_arg_val_t vals[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, vals);
+    CheckDisplayStarted();
+
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(vals[ARG_colors].u_obj, &bufinfo, MP_BUFFER_READ);
+    if (bufinfo.len < 4 || bufinfo.len > 256 * 4 || (bufinfo.len & 3) || ((uintptr_t)bufinfo.buf & 3))
+    {
+        mp_raise_ValueError(MP_ERROR_TEXT("palette must hold 1 to 256 aligned 32-bit entries"));
+    }
+    if (SetPalette((const uint32_t *)bufinfo.buf, bufinfo.len / 4, vals[ARG_vblank].u_bool) < 0)
+    {
+        mp_raise_msg(&mp_type_RuntimeError, MP_ERROR_TEXT("framebuffer is not L8"));
+    }
+    return mp_const_none;
+}
+
+static MP_DEFINE_CONST_FUN_OBJ_KW(mp_anx7625_palette_obj, 1, mp_anx7625_palette);
+
+static mp_obj_t mp_anx7625_background(mp_obj_t self_obj, mp_obj_t color_obj)
+{
+    mp_anx7625_t *self = MP_OBJ_TO_PTR(self_obj);
+    (void)self;
+
+    SetBackgroundColor(mp_obj_get_int_truncated(color_obj));
+    return mp_const_none;
+}
+
+static MP_DEFINE_CONST_FUN_OBJ_2(mp_anx7625_background_obj, mp_anx7625_background);
+
+static mp_obj_t mp_anx7625_bandwidth(size_t n_args, const mp_obj_t *args)
+{
+    mp_anx7625_t *self = MP_OBJ_TO_PTR(args[0]);
+    (void)self;
+
+    uint32_t format = (n_args > 1) ? mp_obj_get_int(args[1]) : getPixelFormat()->dma2d;
+    bandwidth_t bw;
+    if (EstimateBandwidth(format, &bw) < 0)
+    {
+        mp_raise_ValueError(MP_ERROR_TEXT("unsupported framebuffer format"));
+    }
+
+    mp_obj_t dict = mp_obj_new_dict(5);
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_frame), mp_obj_new_int_from_uint(bw.frame_bytes));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_scanout), mp_obj_new_int_from_uint(bw.scanout));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_dsi), MP_OBJ_NEW_QSTR(bw.dsi_coding == DSI_RGB888 ? MP_QSTR_RGB888 : MP_QSTR_RGB565));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_dsi_rate), mp_obj_new_int_from_uint(bw.dsi_rate));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_dsi_capacity), mp_obj_new_int_from_uint(bw.dsi_capacity));
+    return dict;
+}
+
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mp_anx7625_bandwidth_obj, 1, 2, mp_anx7625_bandwidth);
+
+static mp_obj_t mp_anx7625_map(mp_obj_t self_obj, mp_obj_t address_obj, mp_obj_t size_obj)
+{
+    mp_anx7625_t *self = MP_OBJ_TO_PTR(self_obj);
+    (void)self;
+
+    uint32_t address = mp_obj_get_int_truncated(address_obj);
+    mp_int_t size = mp_obj_get_int(size_obj);
+    if (size <= 0)
+    {
+        mp_raise_ValueError(MP_ERROR_TEXT("size must be positive"));
+    }
+    int ret = RegisterMappedRegion(address, size);
+    if (ret == -2)
+    {
+        mp_raise_ValueError(MP_ERROR_TEXT("region outside the QSPI window"));
+    }
+    if (ret < 0)
+    {
+        mp_raise_msg(&mp_type_RuntimeError, MP_ERROR_TEXT("too many mapped regions"));
+    }
+    /* read-only view, usable as a source by every drawing call */
+    return mp_obj_new_memoryview('B', size, (void *)address);
+}
+
+static MP_DEFINE_CONST_FUN_OBJ_3(mp_anx7625_map_obj, mp_anx7625_map);
+
+static mp_obj_t mp_anx7625_jpeg(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    enum
+    {
+        ARG_src,
+        ARG_x,
+        ARG_y,
+    };
+    static const mp_arg_t allowed_args[] = {
+        {MP_QSTR_src, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL}},
+        {MP_QSTR_x, MP_ARG_INT, {.u_int = 0}},
+        {MP_QSTR_y, MP_ARG_INT, {.u_int = 0}},
+    };
+
+    mp_anx7625_t *self = MP_OBJ_TO_PTR(args[0]);
+    (void)self;
+
+    mp_arg_val_t vals[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, vals);
+    CheckDisplayStarted();
+    CheckDirectColorFramebuffer();
+
+    mp_int_t x = vals[ARG_x].u_int;
+    mp_int_t y = vals[ARG_y].u_int;
+    if (x < 0 || y < 0)
+    {
+        mp_raise_ValueError(MP_ERROR_TEXT("image origin must be on screen"));
+    }
+
+    jpeg_decoder_t dec = {0};
+    mp_buffer_info_t bufinfo;
+    if (mp_get_buffer(vals[ARG_src].u_obj, &bufinfo, MP_BUFFER_READ))
+    {
+        dec.stream = MP_OBJ_NULL;
+        dec.data = bufinfo.buf;
+        dec.len = bufinfo.len;
+    }
+    else
+    {
+        mp_get_stream_raise(vals[ARG_src].u_obj, MP_STREAM_OP_READ);
+        dec.stream = vals[ARG_src].u_obj;
+        dec.chunk = m_new(uint8_t, JPEG_CHUNK_SIZE);
+    }
+    dec.strip[0] = m_new(uint8_t, 2 * JPEG_STRIP_SIZE);
+    dec.strip[1] = dec.strip[0] + JPEG_STRIP_SIZE;
+    /* a deferred blank fill must not wipe the decoded image */
+    PrepareDrawBuffer();
+    dec.dst_address = getDrawFrameBuffer();
+    dec.dst_stride = getXSize();
+    dec.dst_width = getXSize();
+    dec.dst_height = getYSize();
+    dec.x = x;
+    dec.y = y;
+
+    int ret = jpeg_decode(&dec);
+
+    m_del(uint8_t, dec.strip[0], 2 * JPEG_STRIP_SIZE);
+    if (dec.chunk != NULL)
+    {
+        m_del(uint8_t, dec.chunk, JPEG_CHUNK_SIZE);
+    }
+
+    if (ret == JPEG_ERR_UNSUPPORTED)
+    {
+        mp_raise_ValueError(MP_ERROR_TEXT("unsupported JPEG"));
+    }
+    if (ret < 0)
+    {
+        mp_raise_OSError(MP_EIO);
+    }
+
+    InvalidateArea(x, y, dec.width, dec.height);
+
+    mp_obj_t size[2] = {mp_obj_new_int(dec.width), mp_obj_new_int(dec.height)};
+    return mp_obj_new_tuple(2, size);
+}
+
+static MP_DEFINE_CONST_FUN_OBJ_KW(mp_anx7625_jpeg_obj, 1, mp_anx7625_jpeg);
+
+static mp_obj_t mp_anx7625_load_image(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    enum
+    {
+        ARG_src,
+        ARG_x,
+        ARG_y,
+        ARG_dither,
+    };
+    static const mp_arg_t allowed_args[] = {
+        {MP_QSTR_src, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL}},
+        {MP_QSTR_x, MP_ARG_INT, {.u_int = 0}},
+        {MP_QSTR_y, MP_ARG_INT, {.u_int = 0}},
+        {MP_QSTR_dither, MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = true}},
+    };
+
+    mp_anx7625_t *self = MP_OBJ_TO_PTR(args[0]);
+    (void)self;
+
+    mp_arg_val_t vals[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, vals);
+    CheckDisplayStarted();
+    CheckRGB565Framebuffer();
+
+    mp_int_t x = vals[ARG_x].u_int;
+    mp_int_t y = vals[ARG_y].u_int;
+    if (x < 0 || y < 0)
+    {
+        mp_raise_ValueError(MP_ERROR_TEXT("image origin must be on screen"));
+    }
+    mp_get_stream_raise(vals[ARG_src].u_obj, MP_STREAM_OP_READ);
+
+    PrepareDrawBuffer();
+    image_target_t target = {
+        .address = getDrawFrameBuffer(),
+        .stride = getXSize(),
+        .width = getXSize(),
+        .height = getYSize(),
+        .x = x,
+        .y = y,
+        .dither = vals[ARG_dither].u_bool,
+    };
+    uint32_t width;
+    uint32_t height;
+    image_load(vals[ARG_src].u_obj, &target, &width, &height);
+
+    InvalidateArea(x, y, width, height);
+
+    mp_obj_t size[2] = {mp_obj_new_int(width), mp_obj_new_int(height)};
+    return mp_obj_new_tuple(2, size);
+}
+
+static MP_DEFINE_CONST_FUN_OBJ_KW(mp_anx7625_load_image_obj, 1, mp_anx7625_load_image);
+
+static mp_obj_t mp_anx7625_execute(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    enum
+    {
+        ARG_list,
+        ARG_atlas,
+        ARG_atlas_width,
+        ARG_font,
+    };
+    static const mp_arg_t allowed_args[] = {
+        {MP_QSTR_list, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL}},
+        {MP_QSTR_atlas, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_rom_obj = MP_ROM_NONE}},
+        {MP_QSTR_atlas_width, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0}},
+        {MP_QSTR_font, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_rom_obj = MP_ROM_NONE}},
+    };
+
+    mp_anx7625_t *self = MP_OBJ_TO_PTR(args[0]);
+    (void)self;
+
+    mp_arg_val_t vals[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, vals);
+    CheckDisplayStarted();
+    CheckDirectColorFramebuffer();
+
+    mp_buffer_info_t listinfo;
+    mp_get_buffer_raise(vals[ARG_list].u_obj, &listinfo, MP_BUFFER_READ);
+
+    drawlist_atlas_t atlas = {0};
+    if (vals[ARG_atlas].u_obj != mp_const_none)
+    {
+        mp_buffer_info_t atlasinfo;
+        mp_get_buffer_raise(vals[ARG_atlas].u_obj, &atlasinfo, MP_BUFFER_READ);
+
+        mp_int_t atlas_width = vals[ARG_atlas_width].u_int;
+        if (atlas_width <= 0)
+        {
+            mp_raise_ValueError(MP_ERROR_TEXT("atlas_width required"));
+        }
+        atlas.pixels = (const uint16_t *)atlasinfo.buf;
+        atlas.width = atlas_width;
+        atlas.height = atlasinfo.len / (atlas_width * sizeof(uint16_t));
+    }
+
+    mp_anx7625_font_t *font = NULL;
+    if (vals[ARG_font].u_obj != mp_const_none)
+    {
+        if (!mp_obj_is_type(vals[ARG_font].u_obj, &mp_anx7625_font_type))
+        {
+            mp_raise_TypeError(MP_ERROR_TEXT("font must be a Font"));
+        }
+        font = MP_OBJ_TO_PTR(vals[ARG_font].u_obj);
+    }
+
+    int ret = drawlist_execute((const uint8_t *)listinfo.buf, listinfo.len, atlas.pixels != NULL ? &atlas : NULL, font);
+    if (ret < 0)
+    {
+        mp_raise_msg_varg(&mp_type_ValueError, MP_ERROR_TEXT("malformed draw-list op at offset %d"), -ret - 1);
+    }
+    return mp_obj_new_int(ret);
+}
+
+static MP_DEFINE_CONST_FUN_OBJ_KW(mp_anx7625_execute_obj, 1, mp_anx7625_execute);
+
+static mp_obj_t mp_anx7625_clear(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    enum
+    {
+        ARG_color,
+        ARG_blank,
+    };
+    static const mp_arg_t allowed_args[] = {
+        {MP_QSTR_color, MP_ARG_OBJ, {.u_obj = mp_const_none}},
+        {MP_QSTR_blank, MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = false}},
+    };
+
+    mp_anx7625_t *self = MP_OBJ_TO_PTR(args[0]);
+
+    mp_arg_val_t vals[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, vals);
+    CheckDisplayStarted();
+
+    if (vals[ARG_color].u_obj != mp_const_none)
+    {
+        self->background_color = mp_obj_get_int(vals[ARG_color].u_obj);
+    }
+    if (vals[ARG_blank].u_bool)
+    {
+        BlankScreen(self->background_color);
+    }
+    else
+    {
+        Clear(self->background_color);
+    }
+    return mp_const_none;
+}
+
+static MP_DEFINE_CONST_FUN_OBJ_KW(mp_anx7625_clear_obj, 1, mp_anx7625_clear);
+
+static mp_obj_t mp_anx7625_flush(mp_obj_t self_obj)
+{
+    mp_anx7625_t *self = MP_OBJ_TO_PTR(self_obj);
+    (void)self;
+    drawCurrentFrameBuffer();
+    return mp_const_none;
+}
+
+static MP_DEFINE_CONST_FUN_OBJ_1(mp_anx7625_flush_obj, mp_anx7625_flush);
+
+/*
+ * Awaitable returned by ready(). Until bring-up ends every resume lets
+ * asyncio.sleep_ms() requeue the task, then yields to the event loop.
+ */
+static mp_obj_t mp_anx7625_ready_iternext(mp_obj_t self_obj)
+{
+    (void)self_obj;
+
+    switch (anx7625_obj->bringup.state)
+    {
+    case ANX7625_STATE_READY:
+        return MP_OBJ_STOP_ITERATION;
+    case ANX7625_STATE_FAILED:
+        mp_raise_msg(&mp_type_RuntimeError, MP_ERROR_TEXT("anx7625 bring-up failed"));
+    default:
+        break;
+    }
+
+    mp_obj_t asyncio = mp_import_name(MP_QSTR_asyncio, mp_const_none, MP_OBJ_NEW_SMALL_INT(0));
+    mp_obj_t sleep = mp_call_function_1(mp_load_attr(asyncio, MP_QSTR_sleep_ms), MP_OBJ_NEW_SMALL_INT(READY_POLL_MS));
+    return mp_iternext(sleep);
+}
+
+static MP_DEFINE_CONST_OBJ_TYPE(
+    mp_anx7625_ready_type,
+    MP_QSTR_ready,
+    MP_TYPE_FLAG_ITER_IS_ITERNEXT,
+    iter, mp_anx7625_ready_iternext);
+
+static const mp_obj_base_t mp_anx7625_ready_obj = {&mp_anx7625_ready_type};
+
+static mp_obj_t mp_anx7625_ready(mp_obj_t self_obj)
+{
+    (void)self_obj;
+    return MP_OBJ_FROM_PTR(&mp_anx7625_ready_obj);
+}
+
+static MP_DEFINE_CONST_FUN_OBJ_1(mp_anx7625_ready_fun_obj, mp_anx7625_ready);
+
+/* Settings that need the framebuffers set up */
+static void mp_anx7625_started(mp_anx7625_t *self)
+{
+    /* after the initial clears so they leave both buffers identical */
+    SetCopyForward(self->copy_forward);
+    SetSkipUnchanged(self->skip_unchanged, self->crc_rows);
+}
+
+/*
+ * Change resolution without a new bring-up. Returns True when the
+ * framebuffers changed size and were cleared, False when they kept
+ * their content.
+ */
+static mp_obj_t mp_anx7625_set_mode(mp_obj_t self_obj, mp_obj_t width_obj, mp_obj_t height_obj)
+{
+    mp_anx7625_t *self = MP_OBJ_TO_PTR(self_obj);
+    if (self->bringup.state != ANX7625_STATE_READY)
+    {
+        mp_raise_msg(&mp_type_RuntimeError, MP_ERROR_TEXT("display not ready"));
+    }
+
+    mp_int_t width = mp_obj_get_int(width_obj);
+    mp_int_t height = mp_obj_get_int(height_obj);
+    int32_t mode = video_modes_search_edid(width, height);
+    if (mode == EDID_MODE_AUTO && (width != 0 || height != 0))
+    {
+        /* 0, 0 asks for the preferred timing of the EDID */
+        mp_raise_ValueError(MP_ERROR_TEXT("unsupported mode"));
+    }
+
+    struct display_timing dt;
+    anx7625_get_timing(&self->bringup.edid, mode, &dt);
+
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(self->buffer_obj, &bufinfo, MP_BUFFER_RW);
+    if (getFramebufferBytes(&dt) > bufinfo.len)
+    {
+        mp_raise_ValueError(MP_ERROR_TEXT("buffer too small for this mode"));
+    }
+
+    stats_phase_t outer = stats_begin(STATS_SET_MODE);
+    int resized = anx7625_set_mode(0, &self->bringup, mode, &dt);
+    stats_end(STATS_SET_MODE, outer);
+    if (resized < 0)
+    {
+        mp_raise_msg(&mp_type_RuntimeError, MP_ERROR_TEXT("mode switch failed"));
+    }
+    self->width = dt.hactive;
+    self->height = dt.vactive;
+    self->mode = mode;
+    if (resized)
+    {
+        mp_anx7625_started(self);
+    }
+    return mp_obj_new_bool(resized);
+}
+
+static MP_DEFINE_CONST_FUN_OBJ_3(mp_anx7625_set_mode_obj, mp_anx7625_set_mode);
+
+/* One pass of the hot-plug service, run from the scheduler */
+static mp_obj_t mp_anx7625_hotplug_poll(mp_obj_t self_obj)
+{
+    mp_anx7625_t *self = MP_OBJ_TO_PTR(self_obj);
+    if (self->bringup.state != ANX7625_STATE_READY)
+    {
+        return mp_const_none;
+    }
+
+    stats_phase_t outer = stats_begin(STATS_HOTPLUG);
+    int event = anx7625_hotplug_poll(0, &self->hotplug, &self->bringup);
+    if (self->hotplug.connected)
+    {
+        anx7625_mipi_alert_poll(0);
+    }
+    if (event == 1 && self->hotplug.resized)
+    {
+        /* the new monitor took another timing, as set_mode() would */
+        self->width = getActiveTiming()->hactive;
+        self->height = getActiveTiming()->vactive;
+        mp_anx7625_started(self);
+    }
+    stats_end(STATS_HOTPLUG, outer);
+    mp_obj_t callback = MP_STATE_PORT(anx7625_hotplug_callback);
+    if (event >= 0 && callback != MP_OBJ_NULL && callback != mp_const_none)
+    {
+        mp_call_function_1(callback, mp_obj_new_bool(event));
+    }
+    return mp_const_none;
+}
+
+static MP_DEFINE_CONST_FUN_OBJ_1(mp_anx7625_hotplug_poll_obj, mp_anx7625_hotplug_poll);
+
+static void mp_anx7625_hotplug_timer_cb(soft_timer_entry_t *timer)
+{
+    (void)timer;
+    mp_sched_schedule(MP_OBJ_FROM_PTR(&mp_anx7625_hotplug_poll_obj), MP_OBJ_FROM_PTR(anx7625_obj));
+}
+
+/* Pin.irq() handler for the bridge alert line, soft so it runs in the VM */
+static mp_obj_t mp_anx7625_hotplug_alert(mp_obj_t pin_obj)
+{
+    (void)pin_obj;
+    return mp_anx7625_hotplug_poll(MP_OBJ_FROM_PTR(anx7625_obj));
+}
+
+static MP_DEFINE_CONST_FUN_OBJ_1(mp_anx7625_hotplug_alert_obj, mp_anx7625_hotplug_alert);
+
+static void mp_anx7625_hotplug_stop(void)
+{
+    soft_timer_entry_t *timer = MP_STATE_PORT(anx7625_hotplug_timer);
+    if (timer != NULL)
+    {
+        soft_timer_remove(timer);
+    }
+
+    mp_obj_t alert = MP_STATE_PORT(anx7625_hotplug_alert);
+    if (alert != MP_OBJ_NULL && alert != mp_const_none)
+    {
+        mp_obj_t dest[4];
+        mp_load_method(alert, MP_QSTR_irq, dest);
+        dest[2] = MP_OBJ_NEW_QSTR(MP_QSTR_handler);
+        dest[3] = mp_const_none;
+        mp_call_method_n_kw(0, 1, dest);
+    }
+    MP_STATE_PORT(anx7625_hotplug_alert) = mp_const_none;
+}
+
+/*
+ * Keep the display alive across cable swaps: poll HPD every period ms
+ * and, with alert given, also on the falling edge of the bridge alert
+ * line. callback(connected) runs on each change, it may be None.
+ * period=0 without alert stops the service.
+ */
+static mp_obj_t mp_anx7625_on_hotplug(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    enum
+    {
+        ARG_callback,
+        ARG_period,
+        ARG_alert,
+    };
+
+    static const mp_arg_t allowed_args[] = {
+        {MP_QSTR_callback, MP_ARG_OBJ | MP_ARG_REQUIRED, {.u_obj = mp_const_none}},
+        {MP_QSTR_period, MP_ARG_INT | MP_ARG_KW_ONLY, {.u_int = HOTPLUG_PERIOD_MS}},
+        {MP_QSTR_alert, MP_ARG_OBJ | MP_ARG_KW_ONLY, {.u_obj = mp_const_none}},
+    };
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    mp_obj_t callback = args[ARG_callback].u_obj;
+    if (callback != mp_const_none && !mp_obj_is_callable(callback))
+    {
+        mp_raise_TypeError(MP_ERROR_TEXT("callback must be callable"));
+    }
+    MP_STATE_PORT(anx7625_hotplug_callback) = callback;
+
+    mp_anx7625_hotplug_stop();
+    mp_int_t period = args[ARG_period].u_int;
+    if (period > 0)
+    {
+        soft_timer_entry_t *timer = MP_STATE_PORT(anx7625_hotplug_timer);
+        if (timer == NULL)
+        {
+            timer = m_new_obj(soft_timer_entry_t);
+            MP_STATE_PORT(anx7625_hotplug_timer) = timer;
+        }
+        soft_timer_static_init(timer, SOFT_TIMER_MODE_PERIODIC, period, mp_anx7625_hotplug_timer_cb);
+        timer->flags |= SOFT_TIMER_FLAG_GC_ALLOCATED;
+        soft_timer_insert(timer, period);
+    }
+
+    mp_obj_t alert = args[ARG_alert].u_obj;
+    if (alert != mp_const_none)
+    {
+        mp_obj_t dest[6];
+        mp_load_method(alert, MP_QSTR_irq, dest);
+        dest[2] = MP_OBJ_NEW_QSTR(MP_QSTR_handler);
+        dest[3] = MP_OBJ_FROM_PTR(&mp_anx7625_hotplug_alert_obj);
+        dest[4] = MP_OBJ_NEW_QSTR(MP_QSTR_trigger);
+        dest[5] = mp_load_attr(alert, MP_QSTR_IRQ_FALLING);
+        mp_call_method_n_kw(0, 2, dest);
+        MP_STATE_PORT(anx7625_hotplug_alert) = alert;
+    }
+    return mp_const_none;
+}
+
+static MP_DEFINE_CONST_FUN_OBJ_KW(mp_anx7625_on_hotplug_obj, 1, mp_anx7625_on_hotplug);
+
+/*
+ * Profiler figures per phase, see stats.h. reset=True clears them once
+ * read.
+ */
+static mp_obj_t mp_anx7625_stats(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    enum
+    {
+        ARG_reset
+    };
+    static const mp_arg_t allowed_args[] = {
+        {MP_QSTR_reset, MP_ARG_BOOL, {.u_bool = false}},
+    };
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    mp_obj_t stats = stats_dict();
+    if (args[ARG_reset].u_bool)
+    {
+        stats_reset();
+    }
+    return stats;
+}
+
+static MP_DEFINE_CONST_FUN_OBJ_KW(mp_anx7625_stats_obj, 1, mp_anx7625_stats);
+
+/*
+ * Refreshes, presented and missed flips and the flush to scanout latency
+ * histogram. reset=True clears them once read.
+ */
+static mp_obj_t mp_anx7625_frame_stats(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    enum
+    {
+        ARG_reset
+    };
+    static const mp_arg_t allowed_args[] = {
+        {MP_QSTR_reset, MP_ARG_BOOL, {.u_bool = false}},
+    };
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    frame_stats_t fs;
+    GetFrameStats(&fs);
+    if (args[ARG_reset].u_bool)
+    {
+        ResetFrameStats();
+    }
+
+    mp_obj_t latency[FRAME_LATENCY_BUCKETS];
+    for (uint32_t i = 0; i < FRAME_LATENCY_BUCKETS; i++)
+    {
+        latency[i] = mp_obj_new_int_from_uint(fs.latency[i]);
+    }
+
+    mp_obj_t dict = mp_obj_new_dict(7);
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_refreshes), mp_obj_new_int_from_uint(fs.refreshes));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_period_us), mp_obj_new_int_from_uint(fs.period_us));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_presented), mp_obj_new_int_from_uint(fs.presented));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_missed), mp_obj_new_int_from_uint(fs.missed));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_max_latency_us), mp_obj_new_int_from_uint(fs.max_latency_us));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_latency), mp_obj_new_list(FRAME_LATENCY_BUCKETS, latency));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_bucket_us), MP_OBJ_NEW_SMALL_INT(FRAME_LATENCY_BUCKET_US));
+    return dict;
+}
+
+static MP_DEFINE_CONST_FUN_OBJ_KW(mp_anx7625_frame_stats_obj, 1, mp_anx7625_frame_stats);
+
+/*
+ * Link error counts; the bridge MIPI alert is polled first. reset=True
+ * clears them once read.
+ */
+static mp_obj_t mp_anx7625_health(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    enum
+    {
+        ARG_reset
+    };
+    static const mp_arg_t allowed_args[] = {
+        {MP_QSTR_reset, MP_ARG_BOOL, {.u_bool = false}},
+    };
+
+    mp_anx7625_t *self = MP_OBJ_TO_PTR(pos_args[0]);
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    if (self->bringup.state == ANX7625_STATE_READY && self->hotplug.connected)
+    {
+        anx7625_mipi_alert_poll(0);
+    }
+
+    link_health_t health;
+    GetLinkHealth(&health);
+    if (args[ARG_reset].u_bool)
+    {
+        ResetLinkHealth();
+    }
+
+    mp_obj_t dict = mp_obj_new_dict(6);
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_ltdc_underruns), mp_obj_new_int_from_uint(health.ltdc_underruns));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_ltdc_errors), mp_obj_new_int_from_uint(health.ltdc_errors));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_dsi_errors), mp_obj_new_int_from_uint(health.dsi_errors));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_dsi_error_flags), mp_obj_new_int_from_uint(health.dsi_error_flags));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_mipi_alerts), mp_obj_new_int_from_uint(health.mipi_alerts));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_dead_time), mp_obj_new_int_from_uint(health.dead_time));
+    return dict;
+}
+
+static MP_DEFINE_CONST_FUN_OBJ_KW(mp_anx7625_health_obj, 1, mp_anx7625_health);
+
+/*
+ * DMA2D pacing: dead_time in AHB cycles between its accesses, bands in
+ * rows per slice of a framebuffer job, -1 for either to follow the scanout
+ * load of the mode. adaptive raises the dead time on underruns. Returns
+ * the settings in force.
+ */
+static mp_obj_t mp_anx7625_throttle(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    enum
+    {
+        ARG_dead_time,
+        ARG_bands,
+        ARG_adaptive
+    };
+    static const mp_arg_t allowed_args[] = {
+        {MP_QSTR_dead_time, MP_ARG_OBJ | MP_ARG_KW_ONLY, {.u_obj = mp_const_none}},
+        {MP_QSTR_bands, MP_ARG_OBJ | MP_ARG_KW_ONLY, {.u_obj = mp_const_none}},
+        {MP_QSTR_adaptive, MP_ARG_OBJ | MP_ARG_KW_ONLY, {.u_obj = mp_const_none}},
+    };
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    if (args[ARG_dead_time].u_obj != mp_const_none || args[ARG_bands].u_obj != mp_const_none)
+    {
+        mp_int_t dead_time = DMA2D_THROTTLE_KEEP;
+        mp_int_t bands = DMA2D_THROTTLE_KEEP;
+        if (args[ARG_dead_time].u_obj != mp_const_none)
+        {
+            dead_time = mp_obj_get_int(args[ARG_dead_time].u_obj);
+            if (dead_time < -1 || dead_time > 255)
+            {
+                mp_raise_ValueError(MP_ERROR_TEXT("dead_time must be -1 to 255"));
+            }
+        }
+        if (args[ARG_bands].u_obj != mp_const_none)
+        {
+            bands = mp_obj_get_int(args[ARG_bands].u_obj);
+            if (bands < -1)
+            {
+                mp_raise_ValueError(MP_ERROR_TEXT("bands must be -1 or more"));
+            }
+        }
+        SetDMA2DThrottle(dead_time, bands);
+    }
+    if (args[ARG_adaptive].u_obj != mp_const_none)
+    {
+        SetUnderrunThrottle(mp_obj_is_true(args[ARG_adaptive].u_obj));
+    }
+
+    dma2d_throttle_t throttle;
+    GetDMA2DThrottle(&throttle);
+    mp_obj_t dict = mp_obj_new_dict(4);
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_dead_time), mp_obj_new_int_from_uint(throttle.dead_time));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_bands), mp_obj_new_int_from_uint(throttle.band_lines));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_adaptive), mp_obj_new_bool(throttle.adaptive));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_load), mp_obj_new_int_from_uint(throttle.load));
+    return dict;
+}
+
+static MP_DEFINE_CONST_FUN_OBJ_KW(mp_anx7625_throttle_obj, 1, mp_anx7625_throttle);
+
+/* Layer row being scanned out, negative or past the height in the blanking */
+static mp_obj_t mp_anx7625_scanline(mp_obj_t self_obj)
+{
+    mp_anx7625_t *self = MP_OBJ_TO_PTR(self_obj);
+    if (!self->drawable)
     {
-        return false;
+        mp_raise_msg(&mp_type_RuntimeError, MP_ERROR_TEXT("display not ready"));
     }
-    const mp_machine_i2c_p_t *i2c_p = (mp_machine_i2c_p_t *)MP_OBJ_TYPE_GET_SLOT(i2c_type, protocol);
-    return (i2c_p != NULL && i2c_p->transfer != NULL);
+    return mp_obj_new_int(GetScanline());
 }
 
-static mp_obj_t mp_anx7625_image(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args)
+static MP_DEFINE_CONST_FUN_OBJ_1(mp_anx7625_scanline_obj, mp_anx7625_scanline);
+
+/* From the LTDC interrupt: the Python callback runs from the scheduler */
+static void mp_anx7625_line_event(uint32_t refresh)
+{
+    mp_sched_schedule(MP_STATE_PORT(anx7625_line_callback), MP_OBJ_NEW_SMALL_INT(refresh & MP_SMALL_INT_POSITIVE_MASK));
+}
+
+/*
+ * The LTDC keeps running across a soft reset, so the line callback is
+ * tied to an object finalised with the heap: gc_sweep_all() stops it
+ * before the callback it schedules is freed.
+ */
+static mp_obj_t mp_anx7625_line_guard_del(mp_obj_t self_obj)
+{
+    if (MP_STATE_PORT(anx7625_line_guard) == self_obj)
+    {
+        SetLineEvent(0, NULL);
+        MP_STATE_PORT(anx7625_line_guard) = MP_OBJ_NULL;
+    }
+    return mp_const_none;
+}
+
+static MP_DEFINE_CONST_FUN_OBJ_1(mp_anx7625_line_guard_del_obj, mp_anx7625_line_guard_del);
+
+static const mp_rom_map_elem_t mp_anx7625_line_guard_locals_dict_table[] = {
+    {MP_ROM_QSTR(MP_QSTR___del__), MP_ROM_PTR(&mp_anx7625_line_guard_del_obj)},
+};
+
+static MP_DEFINE_CONST_DICT(mp_anx7625_line_guard_locals_dict, mp_anx7625_line_guard_locals_dict_table);
+
+static MP_DEFINE_CONST_OBJ_TYPE(
+    mp_anx7625_line_guard_type,
+    MP_QSTR_LineGuard,
+    MP_TYPE_FLAG_NONE,
+    locals_dict, &mp_anx7625_line_guard_locals_dict);
+
+/*
+ * Run callback(refresh) each time the scanout reaches row of the layer,
+ * None to stop.
+ */
+static mp_obj_t mp_anx7625_on_line(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
 {
     enum
     {
-        ARG_buffer,
-        ARG_width,
-        ARG_height,
-        ARG_x,
-        ARG_y,
+        ARG_callback,
+        ARG_row
     };
     static const mp_arg_t allowed_args[] = {
-        {MP_QSTR_buffer, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL}},
-        {MP_QSTR_width, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0}},
-        {MP_QSTR_height, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0}},
-        {MP_QSTR_x, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0}},
-        {MP_QSTR_y, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0}},
+        {MP_QSTR_callback, MP_ARG_OBJ | MP_ARG_REQUIRED, {.u_obj = mp_const_none}},
+        {MP_QSTR_row, MP_ARG_INT, {.u_int = 0}},
     };
 
-    mp_anx7625_t *self = MP_OBJ_TO_PTR(args[0]);
-    (void)self;
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
 
-    mp_arg_val_t vals[MP_ARRAY_SIZE(allowed_args)];
-    mp_arg_parse_all(n_args - 1, args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, vals);
+    mp_obj_t callback = args[ARG_callback].u_obj;
+    if (callback == mp_const_none)
+    {
+        SetLineEvent(0, NULL);
+        MP_STATE_PORT(anx7625_line_callback) = mp_const_none;
+        MP_STATE_PORT(anx7625_line_guard) = MP_OBJ_NULL;
+        return mp_const_none;
+    }
+    if (!mp_obj_is_callable(callback))
+    {
+        mp_raise_TypeError(MP_ERROR_TEXT("callback must be callable"));
+    }
+    mp_int_t row = args[ARG_row].u_int;
+    if (row < 0 || row >= (mp_int_t)getYSize())
+    {
+        mp_raise_ValueError(MP_ERROR_TEXT("row outside the layer"));
+    }
 
-    mp_buffer_info_t bufinfo;
-    mp_get_buffer_raise(vals[ARG_buffer].u_obj, &bufinfo, MP_BUFFER_RW);
+    /* a guard replaced here finds itself stale when collected */
+    mp_obj_base_t *guard = mp_obj_malloc_with_finaliser(mp_obj_base_t, &mp_anx7625_line_guard_type);
+    MP_STATE_PORT(anx7625_line_guard) = MP_OBJ_FROM_PTR(guard);
+    MP_STATE_PORT(anx7625_line_callback) = callback;
+    SetLineEvent(row, mp_anx7625_line_event);
+    return mp_const_none;
+}
 
-    mp_int_t width = vals[ARG_width].u_int;
-    mp_int_t height = vals[ARG_height].u_int;
-    mp_int_t x = vals[ARG_x].u_int;
-    mp_int_t y = vals[ARG_y].u_int;
-    mp_int_t buffer_address = (uintptr_t)bufinfo.buf;
-    uint32_t offsetPos = (x + (getXSize() * y)) * sizeof(uint16_t);
+static MP_DEFINE_CONST_FUN_OBJ_KW(mp_anx7625_on_line_obj, 2, mp_anx7625_on_line);
 
-    DrawImage((void *)buffer_address, (void *)(getActiveFrameBuffer() + offsetPos), width, height, DMA2D_INPUT_RGB565);
+/* Tag the next presented frame for an input to photon measurement */
+static mp_obj_t mp_anx7625_mark(mp_obj_t self_obj, mp_obj_t id_obj)
+{
+    (void)self_obj;
+    MarkFrame(mp_obj_get_int_truncated(id_obj));
     return mp_const_none;
 }
 
-static MP_DEFINE_CONST_FUN_OBJ_KW(mp_anx7625_image_obj, 1, mp_anx7625_image);
+static MP_DEFINE_CONST_FUN_OBJ_2(mp_anx7625_mark_obj, mp_anx7625_mark);
 
-static mp_obj_t mp_anx7625_clear(size_t n_args, const mp_obj_t *args)
+/* Completed markers as (id, latency_us, refresh) tuples, oldest first */
+static mp_obj_t mp_anx7625_markers(mp_obj_t self_obj)
 {
-    mp_anx7625_t *self = MP_OBJ_TO_PTR(args[0]);
-    (void)self;
+    (void)self_obj;
+    frame_marker_t markers[FRAME_MARKERS_MAX];
+    uint32_t count = TakeFrameMarkers(markers, FRAME_MARKERS_MAX);
 
-    if (n_args == 2)
+    mp_obj_t list = mp_obj_new_list(0, NULL);
+    for (uint32_t i = 0; i < count; i++)
     {
-        self->background_color = mp_obj_get_int(args[1]);
+        mp_obj_t items[3] = {
+            mp_obj_new_int_from_uint(markers[i].id),
+            mp_obj_new_int_from_uint(markers[i].latency_us),
+            mp_obj_new_int_from_uint(markers[i].refresh),
+        };
+        mp_obj_list_append(list, mp_obj_new_tuple(3, items));
     }
-    Clear(self->background_color);
-    return mp_const_none;
+    return list;
 }
 
-static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mp_anx7625_clear_obj, 1, 2, mp_anx7625_clear);
+static MP_DEFINE_CONST_FUN_OBJ_1(mp_anx7625_markers_obj, mp_anx7625_markers);
 
-static mp_obj_t mp_anx7625_flush(mp_obj_t self_obj)
+static mp_obj_t mp_anx7625_invalidate(size_t n_args, const mp_obj_t *args)
 {
-    mp_anx7625_t *self = MP_OBJ_TO_PTR(self_obj);
+    mp_anx7625_t *self = MP_OBJ_TO_PTR(args[0]);
     (void)self;
-    drawCurrentFrameBuffer();
+
+    CheckDisplayStarted();
+    InvalidateArea(mp_obj_get_int(args[1]), mp_obj_get_int(args[2]), mp_obj_get_int(args[3]), mp_obj_get_int(args[4]));
     return mp_const_none;
 }
 
-static MP_DEFINE_CONST_FUN_OBJ_1(mp_anx7625_flush_obj, mp_anx7625_flush);
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mp_anx7625_invalidate_obj, 5, 5, mp_anx7625_invalidate);
 
 static const mp_rom_map_elem_t mp_anx7625_locals_dict_table[] = {
+    {MP_ROM_QSTR(MP_QSTR_background), MP_ROM_PTR(&mp_anx7625_background_obj)},
+    {MP_ROM_QSTR(MP_QSTR_bandwidth), MP_ROM_PTR(&mp_anx7625_bandwidth_obj)},
     {MP_ROM_QSTR(MP_QSTR_clear), MP_ROM_PTR(&mp_anx7625_clear_obj)},
+    {MP_ROM_QSTR(MP_QSTR_execute), MP_ROM_PTR(&mp_anx7625_execute_obj)},
     {MP_ROM_QSTR(MP_QSTR_flush), MP_ROM_PTR(&mp_anx7625_flush_obj)},
+    {MP_ROM_QSTR(MP_QSTR_frame_stats), MP_ROM_PTR(&mp_anx7625_frame_stats_obj)},
+    {MP_ROM_QSTR(MP_QSTR_health), MP_ROM_PTR(&mp_anx7625_health_obj)},
     {MP_ROM_QSTR(MP_QSTR_image), MP_ROM_PTR(&mp_anx7625_image_obj)},
+    {MP_ROM_QSTR(MP_QSTR_invalidate), MP_ROM_PTR(&mp_anx7625_invalidate_obj)},
+    {MP_ROM_QSTR(MP_QSTR_jpeg), MP_ROM_PTR(&mp_anx7625_jpeg_obj)},
+    {MP_ROM_QSTR(MP_QSTR_load_image), MP_ROM_PTR(&mp_anx7625_load_image_obj)},
+    {MP_ROM_QSTR(MP_QSTR_map), MP_ROM_PTR(&mp_anx7625_map_obj)},
+    {MP_ROM_QSTR(MP_QSTR_mark), MP_ROM_PTR(&mp_anx7625_mark_obj)},
+    {MP_ROM_QSTR(MP_QSTR_markers), MP_ROM_PTR(&mp_anx7625_markers_obj)},
+    {MP_ROM_QSTR(MP_QSTR_palette), MP_ROM_PTR(&mp_anx7625_palette_obj)},
+    {MP_ROM_QSTR(MP_QSTR_on_hotplug), MP_ROM_PTR(&mp_anx7625_on_hotplug_obj)},
+    {MP_ROM_QSTR(MP_QSTR_on_line), MP_ROM_PTR(&mp_anx7625_on_line_obj)},
+    {MP_ROM_QSTR(MP_QSTR_ready), MP_ROM_PTR(&mp_anx7625_ready_fun_obj)},
+    {MP_ROM_QSTR(MP_QSTR_scanline), MP_ROM_PTR(&mp_anx7625_scanline_obj)},
+    {MP_ROM_QSTR(MP_QSTR_set_mode), MP_ROM_PTR(&mp_anx7625_set_mode_obj)},
+    {MP_ROM_QSTR(MP_QSTR_stats), MP_ROM_PTR(&mp_anx7625_stats_obj)},
+    {MP_ROM_QSTR(MP_QSTR_throttle), MP_ROM_PTR(&mp_anx7625_throttle_obj)},
+    {MP_ROM_QSTR(MP_QSTR_blanked), MP_ROM_PTR(mp_const_none)},
     {MP_ROM_QSTR(MP_QSTR_buffer), MP_ROM_PTR(mp_const_none)},
+    {MP_ROM_QSTR(MP_QSTR_connected), MP_ROM_PTR(mp_const_none)},
+    {MP_ROM_QSTR(MP_QSTR_draw_buffer), MP_ROM_PTR(mp_const_none)},
+    {MP_ROM_QSTR(MP_QSTR_skipped_frames), MP_ROM_PTR(mp_const_none)},
+    {MP_ROM_QSTR(MP_QSTR_state), MP_ROM_PTR(mp_const_none)},
+    {MP_ROM_QSTR(MP_QSTR_timings), MP_ROM_PTR(mp_const_none)},
     {MP_ROM_QSTR(MP_QSTR_width), MP_ROM_PTR(mp_const_none)},
     {MP_ROM_QSTR(MP_QSTR_height), MP_ROM_PTR(mp_const_none)},
+    {MP_ROM_QSTR(MP_QSTR_window), MP_ROM_PTR(mp_const_none)},
 };
 
 static MP_DEFINE_CONST_DICT(mp_anx7625_locals_dict, mp_anx7625_locals_dict_table);
 
+
+static uint32_t mp_anx7625_format_bits(uint32_t format)
+{
+    switch (format)
+    {
+    case DMA2D_INPUT_ARGB8888:
+        return 32;
+    case DMA2D_INPUT_RGB888:
+        return 24;
+    case DMA2D_INPUT_RGB565:
+    case DMA2D_INPUT_ARGB1555:
+    case DMA2D_INPUT_ARGB4444:
+        return 16;
+    case DMA2D_INPUT_L8:
+    case DMA2D_INPUT_A8:
+        return 8;
+    case DMA2D_INPUT_A4:
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+static mp_obj_t mp_anx7625_blit_draw(mp_obj_t self_obj, mp_obj_t x_obj, mp_obj_t y_obj)
+{
+    mp_anx7625_blit_t *self = MP_OBJ_TO_PTR(self_obj);
+
+    CheckDisplayStarted();
+    const pixel_format_t *fb = getPixelFormat();
+    if (fb->dma2d == DMA2D_INPUT_L8 && self->format != DMA2D_INPUT_L8)
+    {
+        mp_raise_msg(&mp_type_RuntimeError, MP_ERROR_TEXT("an L8 framebuffer only takes L8 sources"));
+    }
+
+    mp_int_t x = mp_obj_get_int(x_obj);
+    mp_int_t y = mp_obj_get_int(y_obj);
+    mp_int_t sx = 0;
+    mp_int_t sy = 0;
+    mp_int_t w = self->width;
+    mp_int_t h = self->height;
+    mp_int_t xsize = getXSize();
+    mp_int_t ysize = getYSize();
+
+    if (x < 0)
+    {
+        sx = -x;
+        w += x;
+        x = 0;
+    }
+    if (y < 0)
+    {
+        sy = -y;
+        h += y;
+        y = 0;
+    }
+    if (self->format == DMA2D_INPUT_A4 && (sx & 1))
+    {
+        /* 4-bit sources must start on a byte boundary */
+        sx++;
+        x++;
+        w--;
+    }
+    if (x + w > xsize)
+    {
+        w = xsize - x;
+    }
+    if (y + h > ysize)
+    {
+        h = ysize - y;
+    }
+    if (w <= 0 || h <= 0)
+    {
+        return mp_const_none;
+    }
+
+    uint32_t bits = mp_anx7625_format_bits(self->format);
+    uint32_t bpp = fb->bpp;
+    dma2d_job_t job = self->job;
+    job.bg_pfc = fb->dma2d;
+    job.out_pfc = fb->out;
+    if (fb->dma2d == DMA2D_INPUT_L8)
+    {
+        /* L8 framebuffer: indices are copied as they are, nothing to blend */
+        job.mode = DMA2D_M2M;
+        job.fg_pfc = DMA2D_INPUT_L8;
+        job.fg_clut = 0;
+    }
+    else if (job.mode == DMA2D_M2M_PFC && self->format == fb->dma2d)
+    {
+        job.mode = DMA2D_M2M;
+    }
+    job.fg_address += ((sy * self->stride + sx) * bits) / 8;
+    job.fg_offset = self->stride - w;
+    job.out_address = getDrawFrameBuffer() + (y * xsize + x) * bpp;
+    job.out_offset = xsize - w;
+    job.bg_address = job.out_address;
+    job.bg_offset = job.out_offset;
+    job.width = w;
+    job.height = h;
+
+    InvalidateArea(x, y, w, h);
+    CleanInvalidateDCacheRegion(job.fg_address, (((h - 1) * self->stride + w) * bits) / 8);
+    if (job.fg_clut != 0)
+    {
+        CleanInvalidateDCacheRegion(job.fg_clut, job.fg_clut_size * sizeof(uint32_t));
+    }
+    CleanInvalidateDCacheRegion(job.out_address, ((h - 1) * xsize + w) * bpp);
+    DMA2D_Submit(&job);
+    return mp_const_none;
+}
+
+static MP_DEFINE_CONST_FUN_OBJ_3(mp_anx7625_blit_draw_obj, mp_anx7625_blit_draw);
+
+static const mp_rom_map_elem_t mp_anx7625_blit_locals_dict_table[] = {
+    {MP_ROM_QSTR(MP_QSTR_draw), MP_ROM_PTR(&mp_anx7625_blit_draw_obj)},
+    {MP_ROM_QSTR(MP_QSTR_width), MP_ROM_PTR(mp_const_none)},
+    {MP_ROM_QSTR(MP_QSTR_height), MP_ROM_PTR(mp_const_none)},
+};
+
+static MP_DEFINE_CONST_DICT(mp_anx7625_blit_locals_dict, mp_anx7625_blit_locals_dict_table);
+
+static mp_obj_t mp_anx7625_blit_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *all_args)
+{
+    enum
+    {
+        ARG_src,
+        ARG_width,
+        ARG_height,
+        ARG_format,
+        ARG_stride,
+        ARG_alpha,
+        ARG_color,
+        ARG_clut,
+    };
+
+    static const mp_arg_t allowed_args[] = {
+        {MP_QSTR_src, MP_ARG_OBJ | MP_ARG_REQUIRED, {.u_obj = MP_OBJ_NULL}},
+        {MP_QSTR_width, MP_ARG_INT | MP_ARG_REQUIRED, {.u_int = 0}},
+        {MP_QSTR_height, MP_ARG_INT | MP_ARG_REQUIRED, {.u_int = 0}},
+        {MP_QSTR_format, MP_ARG_INT, {.u_int = DMA2D_INPUT_RGB565}},
+        {MP_QSTR_stride, MP_ARG_INT | MP_ARG_KW_ONLY, {.u_int = 0}},
+        {MP_QSTR_alpha, MP_ARG_INT | MP_ARG_KW_ONLY, {.u_int = 255}},
+        {MP_QSTR_color, MP_ARG_INT | MP_ARG_KW_ONLY, {.u_int = 0xFFFF}},
+        {MP_QSTR_clut, MP_ARG_OBJ | MP_ARG_KW_ONLY, {.u_obj = mp_const_none}},
+    };
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all_kw_array(n_args, n_kw, all_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    mp_buffer_info_t clutinfo = {0};
+    if (args[ARG_clut].u_obj != mp_const_none)
+    {
+        mp_get_buffer_raise(args[ARG_clut].u_obj, &clutinfo, MP_BUFFER_READ);
+    }
+
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(args[ARG_src].u_obj, &bufinfo, MP_BUFFER_READ);
+
+    mp_int_t width = args[ARG_width].u_int;
+    mp_int_t height = args[ARG_height].u_int;
+    mp_int_t stride = args[ARG_stride].u_int ? args[ARG_stride].u_int : width;
+    uint32_t format = args[ARG_format].u_int;
+    uint32_t alpha = args[ARG_alpha].u_int & 0xFF;
+    uint32_t bits = mp_anx7625_format_bits(format);
+
+    if (bits == 0)
+    {
+        mp_raise_ValueError(MP_ERROR_TEXT("unsupported format"));
+    }
+    if (width <= 0 || height <= 0 || stride < width || (bits == 4 && (stride & 1)))
+    {
+        mp_raise_ValueError(MP_ERROR_TEXT("invalid dimensions"));
+    }
+    if ((((height - 1) * stride + width) * bits + 7) / 8 > bufinfo.len)
+    {
+        mp_raise_ValueError(MP_ERROR_TEXT("buffer too small"));
+    }
+    if (format == DMA2D_INPUT_L8 && (clutinfo.len < 4 || clutinfo.len > 256 * 4 || (clutinfo.len & 3)))
+    {
+        mp_raise_ValueError(MP_ERROR_TEXT("L8 needs a clut of 1 to 256 ARGB8888 entries"));
+    }
+
+    mp_anx7625_blit_t *self = mp_obj_malloc(mp_anx7625_blit_t, type);
+    self->src_obj = args[ARG_src].u_obj;
+    self->clut_obj = args[ARG_clut].u_obj;
+    self->width = width;
+    self->height = height;
+    self->stride = stride;
+    self->format = format;
+
+    /* register image shared by every draw(), only addresses and clipping change */
+    memset(&self->job, 0, sizeof(self->job));
+    self->job.fg_address = (uint32_t)bufinfo.buf;
+    self->job.fg_offset = stride - width;
+    /* framebuffer formats are filled in by draw() */
+    self->job.width = width;
+    self->job.height = height;
+    if (format == DMA2D_INPUT_L8)
+    {
+        /* the palette alpha blends like any other source with alpha */
+        self->job.fg_clut = (uint32_t)clutinfo.buf;
+        self->job.fg_clut_size = clutinfo.len / 4;
+    }
+
+    switch (format)
+    {
+    case DMA2D_INPUT_RGB565:
+    case DMA2D_INPUT_RGB888:
+        if (alpha == 255)
+        {
+            self->job.mode = DMA2D_M2M_PFC;
+            self->job.fg_pfc = format;
+        }
+        else
+        {
+            self->job.mode = DMA2D_M2M_BLEND;
+            self->job.fg_pfc = format | (DMA2D_REPLACE_ALPHA << DMA2D_FGPFCCR_AM_Pos) | (alpha << DMA2D_FGPFCCR_ALPHA_Pos);
+        }
+        break;
+    case DMA2D_INPUT_A8:
+    case DMA2D_INPUT_A4:
+        self->job.fg_color = ConvertRGB565ToRGB888(args[ARG_color].u_int);
+        /* fall through */
+    default:
+        self->job.mode = DMA2D_M2M_BLEND;
+        self->job.fg_pfc = format | (DMA2D_COMBINE_ALPHA << DMA2D_FGPFCCR_AM_Pos) | (alpha << DMA2D_FGPFCCR_ALPHA_Pos);
+        break;
+    }
+
+    return MP_OBJ_FROM_PTR(self);
+}
+
+static void mp_anx7625_blit_attr(mp_obj_t obj, qstr attr, mp_obj_t *dest)
+{
+    mp_anx7625_blit_t *self = MP_OBJ_TO_PTR(obj);
+    if (dest[0] == MP_OBJ_NULL)
+    {
+        const mp_obj_type_t *type = mp_obj_get_type(obj);
+        mp_map_t *locals_map = (mp_map_t *)mp_obj_dict_get_map(MP_OBJ_TYPE_GET_SLOT(type, locals_dict));
+        mp_map_elem_t *elem = mp_map_lookup(locals_map, MP_OBJ_NEW_QSTR(attr), MP_MAP_LOOKUP);
+        if (elem != NULL)
+        {
+            if (attr == MP_QSTR_width)
+            {
+                dest[0] = mp_obj_new_int(self->width);
+                return;
+            }
+            if (attr == MP_QSTR_height)
+            {
+                dest[0] = mp_obj_new_int(self->height);
+                return;
+            }
+            mp_convert_member_lookup(obj, type, elem->value, dest);
+        }
+    }
+}
+
+MP_DEFINE_CONST_OBJ_TYPE(
+    mp_anx7625_blit_type,
+    MP_QSTR_Blit,
+    MP_TYPE_FLAG_NONE,
+    make_new, mp_anx7625_blit_make_new,
+    attr, mp_anx7625_blit_attr,
+    locals_dict, &mp_anx7625_blit_locals_dict);
+
+static mp_obj_t mp_anx7625_bringup_step(mp_obj_t self_obj)
+{
+    mp_anx7625_t *self = MP_OBJ_TO_PTR(self_obj);
+
+    int delay = anx7625_bringup_step(0, &self->bringup);
+    if (delay >= 0)
+    {
+        soft_timer_insert(MP_STATE_PORT(anx7625_bringup_timer), delay);
+    }
+
+    /* a fixed mode has its framebuffers from the first step on */
+    bool drawable = IsDisplayPrepared();
+    if ((drawable && !self->drawable) || self->bringup.state == ANX7625_STATE_READY)
+    {
+        mp_anx7625_started(self);
+    }
+    /* a monitor is there when bring-up ends */
+    self->hotplug.connected = (self->bringup.state == ANX7625_STATE_READY);
+    self->drawable = drawable;
+    return mp_const_none;
+}
+
+static MP_DEFINE_CONST_FUN_OBJ_1(mp_anx7625_bringup_step_obj, mp_anx7625_bringup_step);
+
+static void mp_anx7625_bringup_timer_cb(soft_timer_entry_t *timer)
+{
+    (void)timer;
+    /* I2C needs the VM, so the step itself runs from the scheduler */
+    mp_sched_schedule(MP_OBJ_FROM_PTR(&mp_anx7625_bringup_step_obj), MP_OBJ_FROM_PTR(anx7625_obj));
+}
+
 static mp_obj_t mp_anx7625_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *all_args)
 {
-    mp_arg_check_num(n_args, n_kw, 0, 9, true);
+    mp_arg_check_num(n_args, n_kw, 0, 17, true);
 
     enum
     {
@@ -150,6 +1353,14 @@ static mp_obj_t mp_anx7625_make_new(const mp_obj_type_t *type, size_t n_args, si
         ARG_height,
         ARG_timeout,
         ARG_background_color,
+        ARG_copy_forward,
+        ARG_skip_unchanged,
+        ARG_crc_rows,
+        ARG_format,
+        ARG_window,
+        ARG_block,
+        ARG_throttle,
+        ARG_single_buffer,
     };
 
     static const mp_arg_t allowed_args[] = {
@@ -162,6 +1373,14 @@ static mp_obj_t mp_anx7625_make_new(const mp_obj_type_t *type, size_t n_args, si
         {MP_QSTR_height, MP_ARG_INT | MP_ARG_KW_ONLY, {.u_int = 480}},
         {MP_QSTR_timeout, MP_ARG_INT | MP_ARG_KW_ONLY, {.u_int = 500}},
         {MP_QSTR_background_color, MP_ARG_INT | MP_ARG_KW_ONLY, {.u_int = 0}},
+        {MP_QSTR_copy_forward, MP_ARG_BOOL | MP_ARG_KW_ONLY, {.u_bool = false}},
+        {MP_QSTR_skip_unchanged, MP_ARG_BOOL | MP_ARG_KW_ONLY, {.u_bool = false}},
+        {MP_QSTR_crc_rows, MP_ARG_INT | MP_ARG_KW_ONLY, {.u_int = 0}},
+        {MP_QSTR_format, MP_ARG_INT | MP_ARG_KW_ONLY, {.u_int = DMA2D_INPUT_RGB565}},
+        {MP_QSTR_window, MP_ARG_OBJ | MP_ARG_KW_ONLY, {.u_obj = mp_const_none}},
+        {MP_QSTR_block, MP_ARG_BOOL | MP_ARG_KW_ONLY, {.u_bool = true}},
+        {MP_QSTR_throttle, MP_ARG_BOOL | MP_ARG_KW_ONLY, {.u_bool = false}},
+        {MP_QSTR_single_buffer, MP_ARG_BOOL | MP_ARG_KW_ONLY, {.u_bool = false}},
     };
 
     mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
@@ -197,6 +1416,51 @@ static mp_obj_t mp_anx7625_make_new(const mp_obj_type_t *type, size_t n_args, si
 
     mp_int_t background_color = args[ARG_background_color].u_int;
 
+    /* everything is checked before any display state changes */
+    const pixel_format_t *format = FindPixelFormat(args[ARG_format].u_int);
+    if (format == NULL)
+    {
+        mp_raise_ValueError(MP_ERROR_TEXT("unsupported framebuffer format"));
+    }
+
+    if (args[ARG_skip_unchanged].u_bool && !args[ARG_copy_forward].u_bool && args[ARG_crc_rows].u_int <= 0)
+    {
+        /* every flip would count as changed */
+        mp_raise_ValueError(MP_ERROR_TEXT("skip_unchanged needs copy_forward or crc_rows"));
+    }
+
+    if (args[ARG_single_buffer].u_bool && args[ARG_copy_forward].u_bool)
+    {
+        mp_raise_ValueError(MP_ERROR_TEXT("copy_forward needs two framebuffers"));
+    }
+
+    mp_int_t wx = 0, wy = 0, ww = 0, wh = 0;
+    if (args[ARG_window].u_obj != mp_const_none)
+    {
+        mp_obj_t *items;
+        mp_obj_get_array_fixed_n(args[ARG_window].u_obj, 4, &items);
+        wx = mp_obj_get_int(items[0]);
+        wy = mp_obj_get_int(items[1]);
+        ww = mp_obj_get_int(items[2]);
+        wh = mp_obj_get_int(items[3]);
+        if (wx < 0 || wy < 0 || ww <= 0 || wh <= 0)
+        {
+            mp_raise_ValueError(MP_ERROR_TEXT("window must be a non-empty rectangle on screen"));
+        }
+    }
+
+    int32_t mode = video_modes_search_edid(width, height);
+    if (mode != EDID_MODE_AUTO)
+    {
+        /* an EDID mode is only known, and checked, at bring-up */
+        struct display_timing dt = {0};
+        anx7625_mode_timing(mode, &dt);
+        if (FramebufferBytesFor(&dt, format, wx, wy, ww, wh, args[ARG_single_buffer].u_bool) > bufinfo.len)
+        {
+            mp_raise_ValueError(MP_ERROR_TEXT("buffer too small for this mode"));
+        }
+    }
+
     anx7625_obj->base.type = &mp_anx7625_type;
     anx7625_obj->i2c_obj = i2c_obj;
     anx7625_obj->pin_video_on_obj = pin_video_on_obj;
@@ -208,42 +1472,52 @@ static mp_obj_t mp_anx7625_make_new(const mp_obj_type_t *type, size_t n_args, si
     anx7625_obj->height = height;
     anx7625_obj->timeout = timeout;
     anx7625_obj->background_color = background_color;
-    anx7625_obj->mode = video_modes_search_edid(anx7625_obj->width, anx7625_obj->height);
-
-    /* video on */
-    mp_hal_pin_config(mp_hal_get_pin_obj(anx7625_obj->pin_video_on_obj), MP_HAL_PIN_MODE_OUTPUT, MP_HAL_PIN_PULL_NONE, 0);
-    mp_hal_pin_config_speed(mp_hal_get_pin_obj(anx7625_obj->pin_video_on_obj), MP_HAL_PIN_SPEED_HIGH);
-    mp_hal_pin_low(mp_hal_get_pin_obj(anx7625_obj->pin_video_on_obj));
-
-    /* video rst */
-    mp_hal_pin_config(mp_hal_get_pin_obj(anx7625_obj->pin_video_rst_obj), MP_HAL_PIN_MODE_OUTPUT, MP_HAL_PIN_PULL_NONE, 0);
-    mp_hal_pin_config_speed(mp_hal_get_pin_obj(anx7625_obj->pin_video_rst_obj), MP_HAL_PIN_SPEED_HIGH);
-    mp_hal_pin_low(mp_hal_get_pin_obj(anx7625_obj->pin_video_rst_obj));
-
-    /* otg on */
-    mp_hal_pin_config(mp_hal_get_pin_obj(anx7625_obj->pin_otg_on_obj), MP_HAL_PIN_MODE_OUTPUT, MP_HAL_PIN_PULL_NONE, 0);
-    mp_hal_pin_config_speed(mp_hal_get_pin_obj(anx7625_obj->pin_otg_on_obj), MP_HAL_PIN_SPEED_HIGH);
-    mp_hal_pin_low(mp_hal_get_pin_obj(anx7625_obj->pin_otg_on_obj));
+    anx7625_obj->mode = mode;
 
-    mp_hal_pin_config(mp_hal_get_pin_obj(anx7625_obj->pin_otg_on_obj), MP_HAL_PIN_MODE_INPUT, MP_HAL_PIN_PULL_UP, 0);
-    mp_hal_pin_config_speed(mp_hal_get_pin_obj(anx7625_obj->pin_otg_on_obj), MP_HAL_PIN_SPEED_HIGH);
+    anx7625_obj->copy_forward = args[ARG_copy_forward].u_bool;
+    anx7625_obj->skip_unchanged = args[ARG_skip_unchanged].u_bool;
+    anx7625_obj->crc_rows = MAX(args[ARG_crc_rows].u_int, 0);
 
-    int ret = -1;
-    if ((ret = anx7625_init(0)) < 0)
+    soft_timer_entry_t *timer = MP_STATE_PORT(anx7625_bringup_timer);
+    if (timer != NULL)
     {
-        mp_raise_TypeError(MP_ERROR_TEXT("anx7625_init failed."));
+        soft_timer_remove(timer);
     }
+    SetPixelFormat(format->dma2d);
+    SetSingleBuffer(args[ARG_single_buffer].u_bool);
+    SetLayerWindow(wx, wy, ww, wh);
+    SetBackgroundColor(background_color);
+    stats_init();
+    SetUnderrunThrottle(args[ARG_throttle].u_bool);
+    anx7625_bringup_init(&anx7625_obj->bringup, anx7625_obj->mode, anx7625_obj->buffer_address, bufinfo.len);
+    memset(&anx7625_obj->hotplug, 0, sizeof(anx7625_obj->hotplug));
+    mp_anx7625_hotplug_stop();
+    MP_STATE_PORT(anx7625_hotplug_callback) = mp_const_none;
+    SetLineEvent(0, NULL);
+    MP_STATE_PORT(anx7625_line_callback) = mp_const_none;
+    MP_STATE_PORT(anx7625_line_guard) = MP_OBJ_NULL;
 
-    if ((ret = anx7625_wait_hpd_event(0)) < 0)
+    if (args[ARG_block].u_bool)
     {
-        mp_raise_TypeError(MP_ERROR_TEXT("anx7625_wait_hpd_event failed."));
+        if (anx7625_bringup_run(0, &anx7625_obj->bringup) < 0)
+        {
+            mp_raise_TypeError(MP_ERROR_TEXT("anx7625 bring-up failed."));
+        }
+        mp_anx7625_started(anx7625_obj);
+        anx7625_obj->hotplug.connected = true;
     }
-
-    struct edid recognized_edid = {0};
-    anx7625_dp_get_edid(0, &recognized_edid);
-    if ((ret = anx7625_dp_start(0, &recognized_edid, anx7625_obj->mode, anx7625_obj->buffer_address)) < 0)
+    else
     {
-        mp_raise_TypeError(MP_ERROR_TEXT("anx7625_dp_start failed."));
+        if (timer == NULL)
+        {
+            timer = m_new_obj(soft_timer_entry_t);
+            MP_STATE_PORT(anx7625_bringup_timer) = timer;
+        }
+        soft_timer_static_init(timer, SOFT_TIMER_MODE_ONE_SHOT, 0, mp_anx7625_bringup_timer_cb);
+        timer->flags |= SOFT_TIMER_FLAG_GC_ALLOCATED;
+        /* the first step sets up the framebuffers, drawing can start on return */
+        anx7625_obj->drawable = false;
+        mp_anx7625_bringup_step(MP_OBJ_FROM_PTR(anx7625_obj));
     }
 
     return MP_OBJ_FROM_PTR(anx7625_obj);
@@ -264,14 +1538,69 @@ static void mp_anx7625_attr(mp_obj_t obj, qstr attr, mp_obj_t *dest)
                 dest[0] = self->buffer_obj;
                 return;
             }
+            if (attr == MP_QSTR_skipped_frames)
+            {
+                dest[0] = mp_obj_new_int_from_uint(getSkippedFrames());
+                return;
+            }
+            if (attr == MP_QSTR_draw_buffer)
+            {
+                /* the caller is about to draw, so a deferred clear has to land */
+                PrepareDrawBuffer();
+                dest[0] = mp_obj_new_memoryview('B' | MP_OBJ_ARRAY_TYPECODE_FLAG_RW, getXSize() * getYSize() * getBytesPerPixel(), (void *)getDrawFrameBuffer());
+                return;
+            }
+            /* the size of the layer, which is the window when one is set */
             if (attr == MP_QSTR_width)
             {
-                dest[0] = mp_obj_new_int(self->width);
+                dest[0] = mp_obj_new_int(IsDisplayPrepared() ? getXSize() : self->width);
                 return;
             }
             if (attr == MP_QSTR_height)
             {
-                dest[0] = mp_obj_new_int(self->height);
+                dest[0] = mp_obj_new_int(IsDisplayPrepared() ? getYSize() : self->height);
+                return;
+            }
+            if (attr == MP_QSTR_connected)
+            {
+                dest[0] = mp_obj_new_bool(self->hotplug.connected);
+                return;
+            }
+            if (attr == MP_QSTR_state)
+            {
+                const char *name = anx7625_state_name(self->bringup.state);
+                dest[0] = mp_obj_new_str(name, strlen(name));
+                return;
+            }
+            if (attr == MP_QSTR_timings)
+            {
+                const anx7625_bringup_t *b = &self->bringup;
+                mp_obj_t dict = mp_obj_new_dict(ANX7625_STATE_READY + 2);
+                for (uint32_t i = ANX7625_STATE_PROBE; i < ANX7625_STATE_READY; i++)
+                {
+                    const char *name = anx7625_state_name(i);
+                    mp_obj_dict_store(dict, mp_obj_new_str(name, strlen(name)), mp_obj_new_int_from_uint(b->phase_ms[i]));
+                }
+                mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_local), mp_obj_new_int_from_uint(b->local_ms));
+                mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_hidden), mp_obj_new_int_from_uint(b->hidden_ms));
+                mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_total), mp_obj_new_int_from_uint(b->total_ms));
+                dest[0] = dict;
+                return;
+            }
+            if (attr == MP_QSTR_blanked)
+            {
+                dest[0] = mp_obj_new_bool(IsBlanked());
+                return;
+            }
+            if (attr == MP_QSTR_window)
+            {
+                mp_obj_t items[4] = {
+                    mp_obj_new_int(getWindowX()),
+                    mp_obj_new_int(getWindowY()),
+                    mp_obj_new_int(getXSize()),
+                    mp_obj_new_int(getYSize()),
+                };
+                dest[0] = mp_obj_new_tuple(4, items);
                 return;
             }
             mp_convert_member_lookup(obj, type, elem->value, dest);
@@ -290,6 +1619,21 @@ MP_DEFINE_CONST_OBJ_TYPE(
 static const mp_rom_map_elem_t mp_module_anx7625_globals_table[] = {
     {MP_ROM_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR__anx7625)},
     {MP_ROM_QSTR(MP_QSTR_ANX7625), MP_ROM_PTR(&mp_anx7625_type)},
+    {MP_ROM_QSTR(MP_QSTR_Blit), MP_ROM_PTR(&mp_anx7625_blit_type)},
+    {MP_ROM_QSTR(MP_QSTR_Bundle), MP_ROM_PTR(&mp_anx7625_bundle_type)},
+    {MP_ROM_QSTR(MP_QSTR_Font), MP_ROM_PTR(&mp_anx7625_font_type)},
+    {MP_ROM_QSTR(MP_QSTR_FrameBuffer), MP_ROM_PTR(&mp_anx7625_framebuffer_type)},
+    {MP_ROM_QSTR(MP_QSTR_MJPEG), MP_ROM_PTR(&mp_anx7625_mjpeg_type)},
+    {MP_ROM_QSTR(MP_QSTR_RGB565), MP_ROM_INT(DMA2D_INPUT_RGB565)},
+    {MP_ROM_QSTR(MP_QSTR_RGB888), MP_ROM_INT(DMA2D_INPUT_RGB888)},
+    {MP_ROM_QSTR(MP_QSTR_ARGB8888), MP_ROM_INT(DMA2D_INPUT_ARGB8888)},
+    {MP_ROM_QSTR(MP_QSTR_ARGB1555), MP_ROM_INT(DMA2D_INPUT_ARGB1555)},
+    {MP_ROM_QSTR(MP_QSTR_ARGB4444), MP_ROM_INT(DMA2D_INPUT_ARGB4444)},
+    {MP_ROM_QSTR(MP_QSTR_L8), MP_ROM_INT(DMA2D_INPUT_L8)},
+    {MP_ROM_QSTR(MP_QSTR_A8), MP_ROM_INT(DMA2D_INPUT_A8)},
+    {MP_ROM_QSTR(MP_QSTR_A4), MP_ROM_INT(DMA2D_INPUT_A4)},
+    {MP_ROM_QSTR(MP_QSTR_QSPI_BASE), MP_ROM_INT(QSPI_MAP_BASE)},
+    {MP_ROM_QSTR(MP_QSTR_QSPI_SIZE), MP_ROM_INT(QSPI_MAP_SIZE)},
 };
 
 static MP_DEFINE_CONST_DICT(mp_module_anx7625_globals, mp_module_anx7625_globals_table);
@@ -0,0 +1,160 @@
+/* SPDX-License-Identifier: MIT */
+
+/*
+ * Phase profiler. Intervals are counted in CPU cycles on the DWT, next to
+ * the microsecond tick: past half the counter range (about 4 s at 480 MHz)
+ * the tick is taken instead, as the cycle count may have wrapped.
+ */
+
+#include <string.h>
+
+#include "py/mphal.h"
+#include "py/runtime.h"
+
+#include "stats.h"
+
+static const char *const stats_names[STATS_PHASES] = {
+    [STATS_PROBE] = "probe",
+    [STATS_VBUS] = "vbus",
+    [STATS_OCM] = "ocm",
+    [STATS_HPD] = "hpd",
+    [STATS_EDID_READ] = "edid_read",
+    [STATS_EDID_DECODE] = "edid_decode",
+    [STATS_DSI_CONFIG] = "dsi_config",
+    [STATS_LTDC_CONFIG] = "ltdc_config",
+    [STATS_DP_START] = "dp_start",
+    [STATS_HOTPLUG] = "hotplug",
+    [STATS_SET_MODE] = "set_mode",
+    [STATS_DMA2D] = "dma2d",
+    [STATS_FLIP] = "flip",
+    [STATS_OTHER] = "other",
+};
+
+static stats_entry_t stats_entries[STATS_PHASES];
+static stats_phase_t stats_current = STATS_OTHER;
+
+#if defined(DWT) && defined(CoreDebug)
+#define STATS_CLOCK SystemCoreClock
+#define STATS_CYCLES() (DWT->CYCCNT)
+#else
+#define STATS_CLOCK 1000000
+#define STATS_CYCLES() ((uint32_t)mp_hal_ticks_us())
+#endif
+
+void stats_init(void)
+{
+#if defined(DWT) && defined(CoreDebug)
+    if (!(DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk))
+    {
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+#if defined(__CORTEX_M) && (__CORTEX_M == 7)
+        /* the M7 DWT is write locked out of reset */
+        DWT->LAR = 0xC5ACCE55;
+#endif
+        DWT->CYCCNT = 0;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    }
+#endif
+}
+
+void stats_start(stats_phase_t phase)
+{
+    stats_entry_t *e = &stats_entries[phase];
+    e->start_us = mp_hal_ticks_us();
+    e->start_cycles = STATS_CYCLES();
+    e->running = true;
+}
+
+void stats_stop(stats_phase_t phase)
+{
+    if (phase >= STATS_PHASES || !stats_entries[phase].running)
+    {
+        return;
+    }
+
+    stats_entry_t *e = &stats_entries[phase];
+    uint32_t cycles = STATS_CYCLES() - e->start_cycles;
+    uint32_t us = mp_hal_ticks_us() - e->start_us;
+    uint32_t per_us = STATS_CLOCK / 1000000;
+
+    if (us > UINT32_MAX / 2 / per_us)
+    {
+        e->cycles += (uint64_t)us * per_us;
+    }
+    else
+    {
+        e->cycles += cycles;
+        us = cycles / per_us;
+    }
+    if (us > e->max_us)
+    {
+        e->max_us = us;
+    }
+    e->count++;
+    e->running = false;
+}
+
+stats_phase_t stats_enter(stats_phase_t phase)
+{
+    stats_phase_t outer = stats_current;
+    stats_current = phase;
+    return outer;
+}
+
+void stats_leave(stats_phase_t outer)
+{
+    stats_current = outer;
+}
+
+stats_phase_t stats_begin(stats_phase_t phase)
+{
+    stats_start(phase);
+    return stats_enter(phase);
+}
+
+void stats_end(stats_phase_t phase, stats_phase_t outer)
+{
+    stats_leave(outer);
+    stats_stop(phase);
+}
+
+void stats_i2c(size_t len)
+{
+    stats_entries[stats_current].i2c_count++;
+    stats_entries[stats_current].i2c_bytes += len;
+}
+
+void stats_reset(void)
+{
+    for (uint32_t i = 0; i < STATS_PHASES; i++)
+    {
+        /* intervals under way are kept open */
+        stats_entry_t *e = &stats_entries[i];
+        e->count = 0;
+        e->cycles = 0;
+        e->max_us = 0;
+        e->i2c_count = 0;
+        e->i2c_bytes = 0;
+    }
+}
+
+mp_obj_t stats_dict(void)
+{
+    uint32_t per_us = STATS_CLOCK / 1000000;
+    mp_obj_t dict = mp_obj_new_dict(STATS_PHASES + 1);
+
+    for (uint32_t i = 0; i < STATS_PHASES; i++)
+    {
+        const stats_entry_t *e = &stats_entries[i];
+        mp_obj_t phase = mp_obj_new_dict(6);
+        mp_obj_dict_store(phase, MP_OBJ_NEW_QSTR(MP_QSTR_count), mp_obj_new_int_from_uint(e->count));
+        mp_obj_dict_store(phase, MP_OBJ_NEW_QSTR(MP_QSTR_cycles), mp_obj_new_int_from_ull(e->cycles));
+        mp_obj_dict_store(phase, MP_OBJ_NEW_QSTR(MP_QSTR_us), mp_obj_new_int_from_ull(e->cycles / per_us));
+        mp_obj_dict_store(phase, MP_OBJ_NEW_QSTR(MP_QSTR_max_us), mp_obj_new_int_from_uint(e->max_us));
+        mp_obj_dict_store(phase, MP_OBJ_NEW_QSTR(MP_QSTR_i2c), mp_obj_new_int_from_uint(e->i2c_count));
+        mp_obj_dict_store(phase, MP_OBJ_NEW_QSTR(MP_QSTR_i2c_bytes), mp_obj_new_int_from_uint(e->i2c_bytes));
+        mp_obj_dict_store(dict, mp_obj_new_str(stats_names[i], strlen(stats_names[i])), phase);
+    }
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_clock), mp_obj_new_int_from_uint(STATS_CLOCK));
+    return dict;
+}
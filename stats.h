@@ -0,0 +1,71 @@
+/* SPDX-License-Identifier: MIT */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "py/runtime.h"
+
+/*
+ * Where the time goes: bring-up phases and runtime operations timed on the
+ * DWT cycle counter, or on the microsecond tick where there is none, with
+ * the bridge I2C traffic made meanwhile.
+ */
+
+typedef enum
+{
+    STATS_PROBE,
+    STATS_VBUS,
+    STATS_OCM,
+    STATS_HPD,
+    STATS_EDID_READ,
+    STATS_EDID_DECODE,
+    STATS_DSI_CONFIG,
+    STATS_LTDC_CONFIG,
+    STATS_DP_START,
+    STATS_HOTPLUG,
+    STATS_SET_MODE,
+    STATS_DMA2D,
+    STATS_FLIP,
+    STATS_OTHER,
+    STATS_PHASES
+} stats_phase_t;
+
+typedef struct _stats_entry_t
+{
+    uint32_t count;
+    uint64_t cycles;
+    uint32_t max_us;
+    uint32_t i2c_count;
+    uint32_t i2c_bytes;
+    bool running;
+    uint32_t start_cycles;
+    uint32_t start_us;
+} stats_entry_t;
+
+/* Turn the cycle counter on */
+void stats_init(void);
+
+/* Open and close one interval of a phase, closing one not open does nothing */
+void stats_start(stats_phase_t phase);
+void stats_stop(stats_phase_t phase);
+
+/* Charge the I2C traffic to phase until stats_leave(), returns the outer phase */
+stats_phase_t stats_enter(stats_phase_t phase);
+void stats_leave(stats_phase_t outer);
+
+/* Both of the above, for a phase run in one go */
+stats_phase_t stats_begin(stats_phase_t phase);
+void stats_end(stats_phase_t phase, stats_phase_t outer);
+
+/* One bridge I2C transfer of len bytes */
+void stats_i2c(size_t len);
+
+void stats_reset(void);
+
+/* Phase name to a dict of the figures, and the counter frequency */
+mp_obj_t stats_dict(void);
+
+#endif /* STATS_H */
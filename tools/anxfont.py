@@ -0,0 +1,144 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: MIT
+"""Render a TrueType/OpenType font into a glyph atlas for _anx7625.Font.
+
+    anxfont.py -o sans16.anxf [--size 16] [--a4] [--chars TEXT] font.ttf
+
+The atlas holds printable ASCII plus any characters given with --chars.
+Kerning pairs between those characters are taken from the font. A4 atlases
+are half the size of A8 ones, at the cost of 16 coverage levels. See font.h
+for the layout.
+
+Needs Pillow.
+"""
+
+import argparse
+import struct
+
+from PIL import Image, ImageDraw, ImageFont
+
+MAGIC = b"ANXF"
+VERSION = 1
+HEADER_SIZE = 24
+GLYPH_SIZE = 16
+KERN_SIZE = 8
+ALIGN = 32
+
+# DMA2D input colour modes, the same values as the module constants
+FORMAT_A8 = 9
+FORMAT_A4 = 10
+
+
+def render(font, chars):
+    """(codepoint, image, left, top above the baseline, advance) per glyph."""
+    ascent, _ = font.getmetrics()
+    glyphs = []
+    for ch in chars:
+        left, top, right, bottom = font.getbbox(ch)
+        image = Image.new("L", (max(right - left, 0), max(bottom - top, 0)))
+        if image.width and image.height:
+            ImageDraw.Draw(image).text((-left, -top), ch, font=font, fill=255)
+        advance = round(font.getlength(ch))
+        glyphs.append((ord(ch), image, left, ascent - top, advance))
+    return glyphs
+
+
+def kerning(font, chars):
+    """Pairs of glyph indices whose advance differs once kerned."""
+    widths = [font.getlength(ch) for ch in chars]
+    pairs = []
+    for i, a in enumerate(chars):
+        for j, b in enumerate(chars):
+            adjust = round(font.getlength(a + b) - widths[i] - widths[j])
+            if adjust:
+                pairs.append((i, j, max(-128, min(127, adjust))))
+    return pairs
+
+
+def pack_atlas(glyphs, width, a4):
+    """Shelf packing, tallest glyphs first. Returns positions and height."""
+    order = sorted(range(len(glyphs)), key=lambda i: -glyphs[i][1].height)
+    positions = [(0, 0)] * len(glyphs)
+    x = y = shelf = 0
+    for i in order:
+        image = glyphs[i][1]
+        if image.width > width:
+            raise ValueError("glyph wider than the atlas")
+        if x + image.width > width:
+            x = 0
+            y += shelf
+            shelf = 0
+        positions[i] = (x, y)
+        x += image.width + (image.width & 1 if a4 else 0)
+        shelf = max(shelf, image.height)
+    return positions, y + shelf
+
+
+def build(glyphs, pairs, ascent, line_height, a4=False, atlas_width=256):
+    for _, image, left, top, advance in glyphs:
+        if image.width > 255 or image.height > 255 or not -128 <= left < 128 or not -128 <= top < 128 or advance > 255:
+            raise ValueError("font too large")
+
+    positions, atlas_height = pack_atlas(glyphs, atlas_width, a4)
+    atlas = Image.new("L", (atlas_width, max(atlas_height, 1)))
+    for (x, y), glyph in zip(positions, glyphs):
+        atlas.paste(glyph[1], (x, y))
+
+    pixels = bytes(atlas.getdata())
+    if a4:
+        # two pixels per byte, the first one in the low nibble
+        pixels = bytes((pixels[i] >> 4) | (pixels[i + 1] & 0xF0) for i in range(0, len(pixels), 2))
+
+    table = bytearray()
+    for (x, y), (cp, image, left, top, advance) in zip(positions, glyphs):
+        table += struct.pack("<IHHBBbbB3x", cp, x, y, image.width, image.height, left, top, advance)
+    for left, right, adjust in sorted(pairs):
+        table += struct.pack("<HHb3x", left, right, adjust)
+
+    atlas_offset = HEADER_SIZE + len(table)
+    atlas_offset = (atlas_offset + ALIGN - 1) // ALIGN * ALIGN
+    header = struct.pack(
+        "<4sHHHBxHHHHI",
+        MAGIC,
+        VERSION,
+        len(glyphs),
+        len(pairs),
+        FORMAT_A4 if a4 else FORMAT_A8,
+        atlas_width,
+        atlas.height,
+        ascent,
+        line_height,
+        atlas_offset,
+    )
+    out = header + table
+    return out + bytes(atlas_offset - len(out)) + pixels
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("-o", "--output", required=True, help="font file to write")
+    parser.add_argument("--size", type=int, default=16, help="pixel size")
+    parser.add_argument("--a4", action="store_true", help="4-bit atlas")
+    parser.add_argument("--chars", default="", help="characters beyond printable ASCII")
+    parser.add_argument("--width", type=int, default=256, help="atlas width in pixels")
+    parser.add_argument("font")
+    args = parser.parse_args()
+
+    if args.a4 and args.width & 1:
+        parser.error("A4 atlases need an even width")
+
+    font = ImageFont.truetype(args.font, args.size)
+    ascent, descent = font.getmetrics()
+    chars = sorted(set(chr(c) for c in range(32, 127)) | set(args.chars))
+
+    glyphs = render(font, chars)
+    pairs = kerning(font, chars)
+    data = build(glyphs, pairs, ascent, ascent + descent, args.a4, args.width)
+    with open(args.output, "wb") as f:
+        f.write(data)
+
+    print("%d glyphs, %d kerning pairs, %d bytes" % (len(glyphs), len(pairs), len(data)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,218 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: MIT
+"""Pack images into an asset bundle for _anx7625.Bundle.
+
+    anxpack.py -o assets.anxb [--rle] [--align N] image.png[:format[:name]] ...
+
+format is one of rgb565, argb4444, l8, a8 or a4. It defaults to rgb565, or
+argb4444 for images with transparency. name defaults to the file name without
+its extension. a8 and a4 masks take the alpha channel of the image, or its
+luminance when it has none. See bundle.h for the layout.
+
+Needs Pillow.
+"""
+
+import argparse
+import os
+import struct
+import sys
+
+from PIL import Image
+
+MAGIC = b"ANXB"
+VERSION = 1
+HEADER_SIZE = 16
+ENTRY_SIZE = 48
+NAME_SIZE = 24
+ALIGN = 32
+FLAG_RLE = 0x01
+
+# DMA2D input colour modes, the same values as the module constants
+FORMATS = {
+    "rgb565": (2, 16),
+    "argb4444": (4, 16),
+    "l8": (5, 8),
+    "a8": (9, 8),
+    "a4": (10, 4),
+}
+
+
+def align(value, to):
+    return (value + to - 1) // to * to
+
+
+def has_alpha(image):
+    if image.mode in ("RGBA", "LA") or "transparency" in image.info:
+        return image.convert("RGBA").getextrema()[3][0] < 255
+    return False
+
+
+def encode(image, fmt, stride):
+    """Pixel rows padded to stride pixels, and the palette of an l8 image."""
+    width, height = image.size
+    clut = b""
+    out = bytearray()
+
+    if fmt == "l8":
+        rgba = image.convert("RGBA")
+        quantized = rgba.quantize(256, method=Image.Quantize.FASTOCTREE)
+        palette = quantized.getpalette("RGBA")
+        used = max(quantized.getdata()) + 1
+        for i in range(used):
+            r, g, b, a = palette[i * 4 : i * 4 + 4]
+            clut += struct.pack("<I", (a << 24) | (r << 16) | (g << 8) | b)
+        pixels = list(quantized.getdata())
+        for y in range(height):
+            out += bytes(pixels[y * width : (y + 1) * width])
+            out += bytes(stride - width)
+        return bytes(out), clut
+
+    if fmt in ("a8", "a4"):
+        if has_alpha(image):
+            values = list(image.convert("RGBA").getdata(3))
+        else:
+            values = list(image.convert("L").getdata())
+        for y in range(height):
+            row = values[y * width : (y + 1) * width] + [0] * (stride - width)
+            if fmt == "a8":
+                out += bytes(row)
+            else:
+                # two pixels per byte, the first one in the low nibble
+                for x in range(0, stride, 2):
+                    out.append((row[x] >> 4) | (row[x + 1] & 0xF0))
+        return bytes(out), clut
+
+    pixels = list(image.convert("RGBA").getdata())
+    for y in range(height):
+        for r, g, b, a in pixels[y * width : (y + 1) * width]:
+            if fmt == "rgb565":
+                value = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3)
+            else:
+                value = ((a >> 4) << 12) | ((r >> 4) << 8) | ((g >> 4) << 4) | (b >> 4)
+            out += struct.pack("<H", value)
+        out += bytes((stride - width) * 2)
+    return bytes(out), clut
+
+
+def rle(data, unit):
+    """Runs of 1 to 128 repeated or literal units, see bundle.h."""
+    units = [data[i : i + unit] for i in range(0, len(data), unit)]
+    out = bytearray()
+    literal = []
+
+    def flush():
+        while literal:
+            chunk = literal[:128]
+            del literal[:128]
+            out.append(len(chunk) - 1)
+            out.extend(b"".join(chunk))
+
+    i = 0
+    while i < len(units):
+        run = 1
+        while i + run < len(units) and run < 128 and units[i + run] == units[i]:
+            run += 1
+        if run > 1:
+            flush()
+            out.append(0x7F + run)
+            out.extend(units[i])
+            i += run
+        else:
+            literal.append(units[i])
+            i += 1
+    flush()
+    return bytes(out)
+
+
+def pack(assets, use_rle=False, row_align=1):
+    """assets is a list of (name, PIL image, format) tuples."""
+    index = bytearray()
+    blobs = bytearray()
+    base = align(HEADER_SIZE + ENTRY_SIZE * len(assets), ALIGN)
+
+    def place(data):
+        offset = base + len(blobs)
+        blobs.extend(data)
+        blobs.extend(bytes(align(len(blobs), ALIGN) - len(blobs)))
+        return offset
+
+    for name, image, fmt in assets:
+        code, bits = FORMATS[fmt]
+        encoded_name = name.encode()
+        if len(encoded_name) >= NAME_SIZE:
+            raise ValueError("name too long: %s" % name)
+        width, height = image.size
+        if width > 0xFFFF or height > 0xFFFF:
+            raise ValueError("image too large: %s" % name)
+
+        # 4-bit rows must start on a byte
+        stride = align(width, max(row_align, 2 if bits == 4 else 1))
+        data, clut = encode(image, fmt, stride)
+
+        flags = 0
+        if use_rle:
+            packed = rle(data, max(bits // 8, 1))
+            if len(packed) < len(data):
+                data = packed
+                flags |= FLAG_RLE
+
+        offset = place(data)
+        clut_offset = place(clut) if clut else 0
+        index += struct.pack(
+            "<24sIIHHHBBIHH",
+            encoded_name,
+            offset,
+            len(data),
+            width,
+            height,
+            stride,
+            code,
+            flags,
+            clut_offset,
+            len(clut) // 4,
+            0,
+        )
+
+    header = struct.pack("<4sHH8x", MAGIC, VERSION, len(assets))
+    out = header + index
+    return out + bytes(base - len(out)) + blobs
+
+
+def parse_spec(spec):
+    path, _, rest = spec.partition(":")
+    fmt, _, name = rest.partition(":")
+    image = Image.open(path)
+    image.load()
+    if not fmt:
+        fmt = "argb4444" if has_alpha(image) else "rgb565"
+    if fmt not in FORMATS:
+        raise ValueError("unknown format: %s" % fmt)
+    if not name:
+        name = os.path.splitext(os.path.basename(path))[0]
+    return name, image, fmt
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("-o", "--output", required=True, help="bundle to write")
+    parser.add_argument("--rle", action="store_true", help="run-length encode assets where it helps")
+    parser.add_argument("--align", type=int, default=1, help="pad rows to a multiple of this many pixels")
+    parser.add_argument("images", nargs="+", metavar="image[:format[:name]]")
+    args = parser.parse_args()
+
+    assets = [parse_spec(spec) for spec in args.images]
+    names = [name for name, _, _ in assets]
+    if len(set(names)) != len(names):
+        sys.exit("duplicate asset names")
+
+    data = pack(assets, args.rle, args.align)
+    with open(args.output, "wb") as f:
+        f.write(data)
+
+    for name, image, fmt in assets:
+        print("%-24s %4dx%-4d %s" % (name, image.size[0], image.size[1], fmt))
+    print("%d assets, %d bytes" % (len(assets), len(data)))
+
+
+if __name__ == "__main__":
+    main()